@@ -2,6 +2,8 @@
 
 #include "app.h"
 #include "util.h"
+#include "warp.h"
+#include "render.h"
 
 #include <thread>
 #include <chrono>
@@ -11,9 +13,19 @@
 
 #include <omp.h>
 
+static_assert(BODY_COUNT == SkeletonBodyCount && JointType::JointType_Count == SkeletonJointCount, "skeleton layout must match the sensor");
+
 // Constructor
 Kinect::Kinect()
+	: gridMode(false)
 {
+	overBudget.fill(false);
+
+	// Room for the warps of every quality level
+	RendererSettings settings;
+	settings.cacheBytes = 64 << 20;
+	tattooRenderer.setSettings(settings);
+
 	// Initialize
 	initialize();
 }
@@ -27,37 +39,116 @@ Kinect::~Kinect()
 
 void Kinect::setTattoo(const char* filename)
 {
+	MemoryScope scope(Memory_Assets);
+	tattoo = loadTattoo(filename);
+	tattooMat = tattooLevel(tattoo, 0, 0).clone();
+	tattooSpans.reset();
+	tattooId++;
+}
+
+PreparedTattoo Kinect::loadTattoo(const char* filename, int maxSide)
+{
+	MemoryScope scope(Memory_Assets);
+
+	// Vector tattoos start at a typical size, until the render thread asks for the one shown
+	if (isVectorTattoo(filename)){
+		std::shared_ptr<VectorTattoo> vector = readVectorTattoo(filename);
+		PreparedTattoo prepared = prepareTattoo(rasterizeVector(*vector, maxSide > 0 ? std::min(300, maxSide) : 300), tattooRadii, governor.tier().bilinearProjection);
+		prepared.name = filename;
+		prepared.source = vector;
+		return prepared;
+	}
+
 	// -1 is to guarantee that the transparancy is read
-	tattooSrcMat = cv::imread(filename, -1);
-	tattooMat = tattooSrcMat.clone();
+	cv::Mat image = cv::imread(filename, -1);
 
-	if (!tattooMat.data) {
+	if (!image.data) {
 		std::cout << "ERROR: There is no image" << std::endl;
-		ERROR("There is no image");
+		throw std::runtime_error("There is no image");
+	}
+
+	if (maxSide > 0 && std::max(image.cols, image.rows) > maxSide){
+		const double factor = static_cast<double>(maxSide) / std::max(image.cols, image.rows);
+		cv::resize(image, image, cv::Size(), factor, factor, cv::INTER_AREA);
 	}
 
-	tattooSrcMat = cylinderProjection(tattooSrcMat, .5, .8);
+	PreparedTattoo prepared = prepareTattoo(image, tattooRadii, governor.tier().bilinearProjection);
+	prepared.name = filename;
+	return prepared;
 }
 
 // Processing
 void Kinect::run()
 {
+	if (outputs.sinks().empty()){
+		OutputSink body;
+		body.name = "Body";
+		body.overlays = Overlay_Skeleton | Overlay_UI;
+		outputs.addSink(body);
+	}
+
 	// Main Loop
 	while (true){
 		// Update Data
 		update();
 
-		// Draw Data
-		draw();
+		// Nothing to draw until a color frame is paired
+		if (changes.stage("frame", frameReady)){
+			// Draw Data
+			draw();
+
+			// Publish Data
+			if (!publishName.empty()){
+				publish();
+			}
 
-		// Show Data
-		show();
+			// Show Data
+			show();
+
+			// Evict caches over budget, here where nothing is using them
+			enforceBudgets();
+
+			// Adapt quality to the time this frame took
+			governor.endFrame();
+			for (const auto& decision : governor.takeDecisions()){
+				std::cout << "quality: " << governor.tier(decision.from).name << " -> " << governor.tier(decision.to).name
+					<< " ( " << decision.frameMs << " ms, budget " << decision.budgetMs << " ms )" << std::endl;
+			}
+		}
 
 		// Key Check
 		const int key = cv::waitKey(10);
 		if (key == VK_ESCAPE){
 			break;
 		}
+		if ((key == 'p' || key == 'P') && profiler){
+			profiler->report(std::cout);
+		}
+		if (key == 's' || key == 'S'){
+			const SyncStats& stats = frameSync.statistics();
+			std::cout << "sync: " << stats.pairs << " pairs, " << stats.interpolated << " interpolated, " << stats.dropped << " dropped, "
+				<< "error " << stats.lastError / 1e4 << " ms ( mean " << stats.meanError / 1e4 << ", max " << stats.maxError / 1e4 << " ), "
+				<< "nearest body " << stats.meanOffset / 1e4 << " ms" << std::endl;
+		}
+		if (key == 'g' || key == 'G'){
+			ui.post([this]{ toggleGrid(); });
+		}
+		if (key == 'c' || key == 'C'){
+			changes.report(std::cout);
+		}
+		if (key == 'f' || key == 'F'){
+			foreshortening = !foreshortening;
+		}
+		if (key == 'k' || key == 'K'){
+			skinClipping = !skinClipping;
+		}
+		if (key == 'm' || key == 'M'){
+			MemoryAccounting::instance().report(std::cout);
+		}
+	}
+
+	if (profiler){
+		profiler->report(std::cout);
 	}
 }
 
@@ -66,9 +157,15 @@ void Kinect::initialize()
 {
 	cv::setUseOptimized(true);
 
+	// Count image buffers per subsystem against their budgets ( key M )
+	MemoryAccounting::instance().install();
+
 	// Initialize Sensor
 	initializeSensor();
 
+	// Initialize UI
+	initializeUI();
+
 	// Initialize Tattoo
 	initializeTattoo();
 
@@ -101,11 +198,37 @@ inline void Kinect::initializeSensor()
 	ERROR_CHECK(kinect->get_CoordinateMapper(&coordinateMapper));
 }
 
+// Initialize UI
+inline void Kinect::initializeUI()
+{
+	// Buttons are laid out bottom to top in this order
+	const size_t bigger = ui.addButton("+", ButtonMode::Hold);
+	const size_t smaller = ui.addButton("-", ButtonMode::Hold);
+	const size_t image = ui.addButton("C", ButtonMode::Dwell, 0.6);
+	const size_t next = ui.addButton(">", ButtonMode::Dwell, 0.6);
+	const size_t compare = ui.addButton("#", ButtonMode::Dwell, 0.6);
+
+	// Zoom is a rate per second ( 2% per frame at 30 fps ), so it does not depend on frame rate
+	const double zoomRate = pow(1.02, 30.);
+	ui.button(bigger).onHold = [this, zoomRate](double elapsed){ zoomFactor *= static_cast<float>(pow(zoomRate, elapsed)); };
+	ui.button(smaller).onHold = [this, zoomRate](double elapsed){ zoomFactor /= static_cast<float>(pow(zoomRate, elapsed)); };
+
+	ui.button(image).onActivate = [this]{ changeTattoo(); };
+	ui.button(next).onActivate = [this]{ nextTattoo(); };
+	ui.button(compare).onActivate = [this]{ toggleGrid(); };
+}
+
 // Initialize Tattoo
 inline void Kinect::initializeTattoo()
 {
-	rightElbow = cv::Point(0, 0);
-	rightWrist = cv::Point(0, 0);
+	// Middle of the right forearm
+	tattooAnchor.bone = Joint_WristRight;
+	tattooAnchor.body = -1;
+	tattooAnchor.along = .5f;
+	tattooAnchor.across = 0;
+
+	joints.clear();
+	computeBoneFrames(joints, boneFrames);
 
 	tattooLocation = cv::Point(0, 0);
 }
@@ -125,8 +248,6 @@ inline void Kinect::initializeColor()
 	ERROR_CHECK(colorFrameDescription->get_Height(&colorHeight)); // 1080
 	ERROR_CHECK(colorFrameDescription->get_BytesPerPixel(&colorBytesPerPixel)); // 4
 
-	// Allocation Color Buffer
-	colorBuffer.resize(colorWidth * colorHeight * colorBytesPerPixel);
 }
 
 // Initialize Body
@@ -137,10 +258,10 @@ inline void Kinect::initializeBody()
 	ERROR_CHECK(kinect->get_BodyFrameSource(&bodyFrameSource));
 	ERROR_CHECK(bodyFrameSource->OpenReader(&bodyFrameReader));
 
-	// Initialize Body Buffer
-	for (auto& body : bodies){
-		body = nullptr;
-	}
+	// Initialize Body Snapshots
+	bodySample.clear();
+	bodies.clear();
+	drawnHands.clear();
 
 	// Color Table for Visualization
 	colors[0] = cv::Vec3b(255, 0, 0); // Blue
@@ -159,11 +280,6 @@ void Kinect::finalize()
 {
 	cv::destroyAllWindows();
 
-	// Release Body Buffer
-	for (auto& body : bodies){
-		SafeRelease(body);
-	}
-
 	// Close Sensor
 	if (kinect != nullptr){
 		kinect->Close();
@@ -173,22 +289,54 @@ void Kinect::finalize()
 // Update Data
 void Kinect::update()
 {
+	// Frame Timestamp ( seconds )
+	frameTime = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
 	// Update Color
-	updateColor();
+	{
+		QualityGovernor::Stage stage(governor, "color");
+		updateColor();
+	}
 
 	// Update Body
-	updateBody();
+	{
+		QualityGovernor::Stage stage(governor, "body");
+		updateBody();
+	}
+
+	// Pair the newest color frame with the body sample of the same moment
+	frameReady = frameSync.pop(pairedFrame);
+	if (!frameReady){
+		return;
+	}
+	colorMat = pairedFrame.image;
+	joints = pairedFrame.joints;
+	updateSkeleton();
+
+	// Record the frame before anything is drawn on it
+	if (recorder){
+		MemoryScope scope(Memory_Ingest);
+		recorder->write(colorMat, static_cast<int64_t>(pairedFrame.time / 10), joints);
+	}
 
 	// Update Tattoo
-	updateTattoo();
+	{
+		QualityGovernor::Stage stage(governor, "tattoo");
+		updateTattoo();
+	}
 
 	// Update UI
-	updateUI();
+	{
+		QualityGovernor::Stage stage(governor, "ui");
+		updateUI();
+	}
 }
 
 // Update Color
 inline void Kinect::updateColor()
 {
+	MemoryScope scope(Memory_Ingest);
+
 	// Retrieve Color Frame
 	ComPtr<IColorFrame> colorFrame;
 	const HRESULT ret = colorFrameReader->AcquireLatestFrame(&colorFrame);
@@ -196,8 +344,13 @@ inline void Kinect::updateColor()
 		return;
 	}
 
-	// Convert Format ( YUY2 -> BGRA )
-	ERROR_CHECK(colorFrame->CopyConvertedFrameDataToArray(static_cast<UINT>(colorBuffer.size()), &colorBuffer[0], ColorImageFormat::ColorImageFormat_Bgra));
+	TIMESPAN time;
+	ERROR_CHECK(colorFrame->get_RelativeTime(&time));
+
+	// Convert Format ( YUY2 -> BGRA ) into a new image, it waits in the synchronizer until it is paired
+	cv::Mat color(colorHeight, colorWidth, CV_8UC4);
+	ERROR_CHECK(colorFrame->CopyConvertedFrameDataToArray(static_cast<UINT>(color.total() * color.elemSize()), color.data, ColorImageFormat::ColorImageFormat_Bgra));
+	frameSync.pushColor(time, color);
 }
 
 // Update Body
@@ -210,621 +363,505 @@ inline void Kinect::updateBody()
 		return;
 	}
 
-	// Release Previous Bodies
-	for (auto& body : bodies){
-		SafeRelease(body);
-	}
-
-	// Retrieve Body Data
-	ERROR_CHECK(bodyFrame->GetAndRefreshBodyData(static_cast<UINT>(bodies.size()), &bodies[0]));
-}
-
-// Update Image
-inline void Kinect::updateTattoo()
-{
-
-	double prevZoom = zoomFactor;
-
-	const double distLeftHandButBigger = cv::norm(leftHand - buttonBiggerLocation);
-	const double distLeftHandButSmaller = cv::norm(leftHand - buttonSmallerLocation);
-	const double distRightHandButBigger = cv::norm(rightHand - buttonBiggerLocation);
-	const double distRightHandButSmaller = cv::norm(rightHand - buttonSmallerLocation);
-	if (distLeftHandButBigger < buttonRadius || distRightHandButBigger < buttonRadius) {
-		zoomFactor = zoomFactor * 1.02;
-	}
-	if (distLeftHandButSmaller < buttonRadius || distRightHandButSmaller < buttonRadius) {
-		zoomFactor = zoomFactor * 0.98;
-	}
-
-
-
-	// centro da imagem
-	//cv::Point2f center = cv::Point2f(round(tattooSrcMat.cols / 2), round(tattooSrcMat.rows / 2));
-	cv::Point2f center = cv::Point2f(round(tattooMat.cols / 2), round(tattooMat.rows / 2));
-
-	// vetor normalizado entre os pontos desejados
-	cv::Point2f vector = cv::Point2f(rightWrist.x - rightElbow.x, rightWrist.y - rightElbow.y);
-	float norm = sqrt((vector.x*vector.x) + (vector.y*vector.y));
-	vector.x /= norm;
-	vector.y /= norm;
-
-	cv::Point2f axisVector(0, 1);
-	float factor = 1;
-
-	// angulo do vetor entre os pontos desejados
-	double cossine = (axisVector.x * vector.x) + (axisVector.y * vector.y);
-
-	// z value of the cross product
-	if ((vector.x*axisVector.y - vector.y*axisVector.x) < 0)
-		factor = -1;
-	
-	double angleInRadians = acos(cossine);
-	double angle = factor * angleInRadians*(57.2958);    // in degrees / counter-clockwise
-	double scale = norm / (tattooSrcMat.rows*2);
-	scale *= zoomFactor;
-
-	// transform tattoo
-	cv::Mat R = cv::getRotationMatrix2D(center, angle, scale);
-	cv::warpAffine(tattooSrcMat, tattooMat, R, tattooSrcMat.size(), cv::INTER_CUBIC);
+	// Retrieve Body Data, released as soon as it is decoded
+	std::array<IBody*, BODY_COUNT> frameBodies;
+	frameBodies.fill(nullptr);
+	ERROR_CHECK(bodyFrame->GetAndRefreshBodyData(static_cast<UINT>(frameBodies.size()), &frameBodies[0]));
 
+	TIMESPAN time;
+	ERROR_CHECK(bodyFrame->get_RelativeTime(&time));
 
+	// Decode the joints and hands of every body once, mapped to color space in one call per body,
+	// into the snapshot handed to the synchronizer and the overlays
+	bodySample.clear();
+	bodySample.time = time;
+	JointBuffer& joints = bodySample.joints;
+	for (int index = 0; index < BODY_COUNT; index++){
+		IBody* body = frameBodies[index];
+		if (body == nullptr){
+			continue;
+		}
 
+		BOOLEAN tracked = FALSE;
+		ERROR_CHECK(body->get_IsTracked(&tracked));
+		if (!tracked){
+			continue;
+		}
 
-	///////////////////////////////////////
+		HandState leftState, rightState;
+		TrackingConfidence leftConfidence, rightConfidence;
+		ERROR_CHECK(body->get_HandLeftState(&leftState));
+		ERROR_CHECK(body->get_HandLeftConfidence(&leftConfidence));
+		ERROR_CHECK(body->get_HandRightState(&rightState));
+		ERROR_CHECK(body->get_HandRightConfidence(&rightConfidence));
+		bodySample.hands.left[index] = static_cast<unsigned char>(leftState);
+		bodySample.hands.right[index] = static_cast<unsigned char>(rightState);
+		bodySample.hands.leftConfident[index] = leftConfidence == TrackingConfidence::TrackingConfidence_High;
+		bodySample.hands.rightConfident[index] = rightConfidence == TrackingConfidence::TrackingConfidence_High;
 
-	//CameraIntrinsics calib;
-	//coordinateMapper->GetDepthCameraIntrinsics(&calib);
-	//cv::Point3f vector3d = target2 - target1;
-	//float norm3d = sqrt((vector3d.x*vector3d.x) + (vector3d.y*vector3d.y) + (vector3d.z*vector3d.z));
-	//vector3d.x /= norm3d;
-	//vector3d.y /= norm3d;
-	//vector3d.z /= norm3d;
+		std::array<Joint, JointType::JointType_Count> bodyJoints;
+		ERROR_CHECK(body->GetJoints(static_cast<UINT>(bodyJoints.size()), &bodyJoints[0]));
 
-	//cv::Point3f axisX(1, 0, 0);
-	//cv::Point3f axisY(0, 1, 0);
-	//cv::Point3f axisZ(0, 0, 1);
+		std::array<JointOrientation, JointType::JointType_Count> orientations;
+		ERROR_CHECK(body->GetJointOrientations(static_cast<UINT>(orientations.size()), &orientations[0]));
 
-	//double cos_alpha = (axisX.x * vector3d.x) + (axisX.y * vector3d.y) + (axisX.z * vector3d.z);
-	//double cos_beta = (axisY.x * vector3d.x) + (axisY.y * vector3d.y) + (axisY.z * vector3d.z);
-	//double cos_gamma = (axisZ.x * vector3d.x) + (axisZ.y * vector3d.y) + (axisZ.z * vector3d.z);
-	//
-	//double alpha = acos(cos_alpha);
-	//double beta = acos(cos_beta);
-	//double gamma = acos(cos_gamma);
+		std::array<CameraSpacePoint, JointType::JointType_Count> cameraPoints;
+		std::array<ColorSpacePoint, JointType::JointType_Count> colorPoints;
+		for (int type = 0; type < JointType::JointType_Count; type++){
+			cameraPoints[type] = bodyJoints[type].Position;
+		}
+		ERROR_CHECK(coordinateMapper->MapCameraPointsToColorSpace(static_cast<UINT>(cameraPoints.size()), &cameraPoints[0], static_cast<UINT>(colorPoints.size()), &colorPoints[0]));
 
-	//rotateImage(tattooSrcMat, tattooMat, alpha, beta, gamma, 0, 0, 1000, calib.FocalLengthX, calib.FocalLengthY);
+		joints.tracked[index] = true;
+		for (int type = 0; type < JointType::JointType_Count; type++){
+			const int slot = index * SkeletonJointCount + type;
+			joints.x[slot] = cameraPoints[type].X;
+			joints.y[slot] = cameraPoints[type].Y;
+			joints.z[slot] = cameraPoints[type].Z;
+			joints.u[slot] = colorPoints[type].X;
+			joints.v[slot] = colorPoints[type].Y;
+			joints.qx[slot] = orientations[type].Orientation.x;
+			joints.qy[slot] = orientations[type].Orientation.y;
+			joints.qz[slot] = orientations[type].Orientation.z;
+			joints.qw[slot] = orientations[type].Orientation.w;
+			joints.state[slot] = static_cast<unsigned char>(bodyJoints[type].TrackingState);
+		}
+	}
 
-	//////////////////////////////////////////////////
+	for (auto& body : frameBodies){
+		SafeRelease(body);
+	}
 
+	bodyExchange.publish(bodySample);
+	frameSync.pushBody(time, joints);
+}
 
+// Update Skeleton of the paired body sample
+inline void Kinect::updateSkeleton()
+{
+	// Bone frames for every body
+	computeBoneFrames(joints, boneFrames);
+
+	// Hands of the first tracked body drive the UI ( walked backwards so the first one wins )
+	leftHand = cv::Point(0, 0);
+	rightHand = cv::Point(0, 0);
+	for (int index = BODY_COUNT - 1; index >= 0; index--){
+		const int left = index * SkeletonJointCount + Joint_HandLeft;
+		const int right = index * SkeletonJointCount + Joint_HandRight;
+		if (!joints.tracked[index]){
+			continue;
+		}
+		if (joints.state[left] != JointState_NotTracked){
+			leftHand = cv::Point(static_cast<int>(joints.u[left] + 0.5f), static_cast<int>(joints.v[left] + 0.5f));
+		}
+		if (joints.state[right] != JointState_NotTracked){
+			rightHand = cv::Point(static_cast<int>(joints.u[right] + 0.5f), static_cast<int>(joints.v[right] + 0.5f));
+		}
+	}
+}
 
-	// pega o vetor 3d e projeta o ponto medio dele nas coord de tela
-	CameraSpacePoint* cameraLocationPoint = new CameraSpacePoint();
-	cameraLocationPoint->X = (target1.x + target2.x) / 2;
-	cameraLocationPoint->Y = (target1.y + target2.y) / 2;
-	cameraLocationPoint->Z = (target1.z + target2.z) / 2;
+// Update Image
+inline void Kinect::updateTattoo()
+{
+	MemoryScope scope(Memory_Warp);
 
-	ColorSpacePoint colorLocationPoint;
-	ERROR_CHECK(coordinateMapper->MapCameraPointToColorSpace(*cameraLocationPoint, &colorLocationPoint));
-	// define the tattoo print location
-	tattooLocation = cv::Point(colorLocationPoint.X, colorLocationPoint.Y);
+	// Pick up a tattoo loaded by the UI
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		if (!pendingTattoo.empty()){
+			tattoo = pendingTattoo;
+			pendingTattoo = PreparedTattoo();
+			tattooId++;
+		}
+	}
 
+	if (tattoo.empty()){
+		return;
+	}
 
+	// Pick up a vector tattoo rasterized for the current scale
+	if (tattoo.source){
+		PreparedTattoo sharper;
+		if (rasterizer.take(sharper) && sharper.source == tattoo.source){
+			tattoo = sharper;
+			tattooId++;
+		}
+	}
 
+	// pose of the anchor bone
+	AnchorPose pose;
+	if (!resolveAnchor(boneFrames, tattooAnchor, pose)){
+		tattooLocation = cv::Point(0, 0);
+		return;
+	}
 
-	///////////////////////////////////// testes /////////////////////////////////////////////
-	//// mostrando o vetor do braco e o angulo (teste)
-	//cv::line(colorMat, rightHand, rightElbow, cv::Scalar(255, 0, 0), 3);
-	//cv::putText(colorMat, std::to_string(cossine), rightElbow, cv::FONT_HERSHEY_SCRIPT_SIMPLEX, 1.5, cv::Scalar(0,255,0), 3);
-	//cv::putText(colorMat, std::to_string(angle), rightElbow, cv::FONT_HERSHEY_SCRIPT_SIMPLEX, 1.5, cv::Scalar(0, 255, 0), 3);
+	// the projected tattoo spans half the bone and the source is half of it, rasterized so that the warp scale is 1
+	if (tattoo.source && tattoo.source->size.height > 0){
+		rasterizer.request(tattoo.source, pose.length * zoomFactor / 4 / tattoo.source->size.height, governor.tier().bilinearProjection);
+	}
 
+	// cylinder radius of the limb under the tattoo, smoothed and quantized so the warp cache still hits
+	const QualityTier& quality = governor.tier();
+	RendererSettings settings = tattooRenderer.settings();
+	settings.anchor = tattooAnchor;
+	settings.zoom = zoomFactor;
+	settings.foreshortening = foreshortening;
+	settings.interpolation = foreshortening ? quality.rotateInterpolation : quality.warpInterpolation;
+	settings.mipBias = quality.mipBias;
+	tattooRenderer.adjustSettings(settings);
+	const int radiusStep = tattooRenderer.smoothRadius(tattoo, pose, limbRadius(tattooAnchor, pose));
+
+	// nothing that shapes the tattoo moved enough to see, the last warp and location still hold
+	const int variant = governor.level() + radiusStep * 16;
+	const bool changed = tattooLocation == cv::Point(0, 0) || tattooId != warpedTattoo || variant != warpedVariant ||
+		foreshortening != warpedForeshortening || zoomFactor != warpedZoom || changes.poseMoved(tattooPose, pose);
+	if (!changes.stage("warp", changed)){
+		return;
+	}
+	warpedTattoo = tattooId;
+	warpedVariant = variant;
+	warpedForeshortening = foreshortening;
+	warpedZoom = zoomFactor;
+
+	// quantized pose, a customer holding still reuses the last warp; foreshortened warps follow the arm depth and are not cached
+	PlacedTattoo placed;
+	if (!tattooRenderer.place(tattoo, tattooId, pose, radiusStep, governor.level(), 1., placed)){
+		tattooLocation = cv::Point(0, 0);
+		return;
+	}
+	tattooMat = placed.image;
+	tattooSpans = placed.spans;
+	tattooLocation = placed.location;
+	tattooPose = pose;
 }
 
 void Kinect::updateUI()
 {
-	buttonRadius = 90;
-	const float padding = 30;
+	MemoryScope scope(Memory_UI);
 
-	buttonBiggerLocation = cv::Point2d(250 + buttonRadius + padding, colorMat.rows - buttonRadius * 2 - padding);
-	buttonSmallerLocation = cv::Point2d(250 + buttonRadius + padding, colorMat.rows - buttonRadius * 4 - 2 * padding);
-	buttonImageLocation = cv::Point2d(250 + buttonRadius + padding, colorMat.rows - buttonRadius * 6 - 3 * padding);
-	buttonNextLocation = cv::Point2d(250 + buttonRadius + padding, colorMat.rows - buttonRadius * 8 - 4 * padding);
+	if (colorMat.empty()){
+		return;
+	}
 
-	const int fontFace = cv::FONT_HERSHEY_DUPLEX;
-	const float fontScale = 5;
-	const float fontThickness = 10;
-	const cv::Scalar fontColor = cv::Scalar::all(255);
-	const cv::Scalar buttonColor = cv::Scalar::all(60);
+	const float padding = 30;
+	ui.layout(colorMat.size(), buttonRadius, padding, 250);
 
-	cv::Size textSizePlus = cv::getTextSize("+", cv::FONT_HERSHEY_DUPLEX, fontScale, fontThickness, 0);
-	cv::Size textSizeMinus = cv::getTextSize("-", cv::FONT_HERSHEY_DUPLEX, fontScale, fontThickness, 0);
-	cv::Size textSizeImg = cv::getTextSize("C", cv::FONT_HERSHEY_DUPLEX, fontScale, fontThickness, 0);
-	cv::Size textSizeNext = cv::getTextSize(">", cv::FONT_HERSHEY_DUPLEX, fontScale, fontThickness, 0);
+	// Only tracked hands can hover a button
+	std::vector<cv::Point> hands;
+	if (leftHand != cv::Point(0, 0)){
+		hands.push_back(leftHand);
+	}
+	if (rightHand != cv::Point(0, 0)){
+		hands.push_back(rightHand);
+	}
+	ui.update(hands, frameTime);
+}
 
-	cv::circle(colorMat, buttonBiggerLocation, buttonRadius, buttonColor, -1);
-	cv::putText(colorMat, "+", buttonBiggerLocation + cv::Point(-62, 50), fontFace, fontScale, fontColor, fontThickness);
+// Update Skin
+inline void Kinect::updateSkin()
+{
+	MemoryScope scope(Memory_Composite);
 
-	cv::circle(colorMat, buttonSmallerLocation, buttonRadius, buttonColor, -1);
-	cv::putText(colorMat, "-", buttonSmallerLocation + cv::Point(-65, 50), fontFace, fontScale, fontColor, fontThickness);
-	
-	cv::circle(colorMat, buttonImageLocation, buttonRadius, buttonColor, -1);
-	cv::putText(colorMat, "C", buttonImageLocation + cv::Point(-62, 47), fontFace, fontScale, fontColor, fontThickness);
+	skin.clear();
+	const int slot = tattooPose.body * SkeletonJointCount + tattooAnchor.bone;
+	if (!skinClipping || tattooPose.body < 0 || !boneFrames.valid[slot] || tattooPose.length3d <= 0){
+		return;
+	}
 
-	cv::circle(colorMat, buttonNextLocation, buttonRadius, buttonColor, -1);
-	cv::putText(colorMat, ">", buttonNextLocation + cv::Point(-65, 47), fontFace, fontScale, fontColor, fontThickness);
+	// Only the anchor bone is segmented ( elbow to wrist by default ), widened by the limb radius in pixels
+	// and half again, so the edge of the arm is inside the mask
+	const cv::Point2f parent(boneFrames.u[slot], boneFrames.v[slot]);
+	const cv::Point2f child = parent + cv::Point2f(boneFrames.du[slot], boneFrames.dv[slot]) * boneFrames.length2d[slot];
+	const float radius = limbRadius(tattooAnchor, tattooPose) * tattooPose.length / tattooPose.length3d * 1.5f;
+	skin.update(colorMat, parent, child, radius);
 }
 
 // Draw Data
 void Kinect::draw()
 {
-	// Draw Color
-	drawColor();
+	// Overlays are drawn apart from the composite, only for the outputs that show them
+	const int overlays = outputs.overlays();
 
-	// Draw Body
-	drawBody();
+	// Pick up the tattoos of a grid loaded by the UI
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		if (!pendingGrid.empty()){
+			grid.setTattoos(pendingGrid);
+			pendingGrid.clear();
+		}
+	}
 
-	// Draw Tattoo
-	if (tattooLocation.x != 0 && tattooLocation.y != 0)
-		drawTattoo();
-}
+	// The grid replaces the composite, with the UI on top
+	gridShown = gridMode && !grid.empty();
+	if (gridShown){
+		QualityGovernor::Stage stage(governor, "grid");
+		drawGrid();
+	}
 
-// Draw Color
-inline void Kinect::drawColor()
-{
-	// Create cv::Mat from Color Buffer
-	colorMat = cv::Mat(colorHeight, colorWidth, CV_8UC4, &colorBuffer[0]);
+	// Draw Body, the last overlay holds while no joint moved and no hand changed
+	if (!gridShown && governor.tier().drawSkeleton && (overlays & Overlay_Skeleton)){
+		bodyExchange.read(bodies, bodies.version);
+		if (changes.stage("skeleton", skeletonOverlay.size() != colorMat.size() || changes.jointsMoved(drawnJoints, joints) || !sameHands(drawnHands, bodies.hands))){
+			QualityGovernor::Stage stage(governor, "skeleton");
+			drawBody();
+			drawnJoints = joints;
+			drawnHands = bodies.hands;
+		}
+	}
+	else {
+		skeletonOverlay.release();
+	}
+
+	// Draw UI, again only when a button changed
+	if (overlays & Overlay_UI){
+		if (changes.stage("ui", uiOverlay.size() != colorMat.size() || ui.revision() != drawnRevision)){
+			drawUI();
+			drawnRevision = ui.revision();
+		}
+	}
+	else {
+		uiOverlay.release();
+	}
+
+	// Draw Tattoo, every new color frame is blended again even when the warp was reused
+	if (!gridShown && tattooLocation.x != 0 && tattooLocation.y != 0){
+		changes.stage("blend", true);
+		{
+			QualityGovernor::Stage stage(governor, "skin");
+			updateSkin();
+		}
+		QualityGovernor::Stage stage(governor, "blend");
+		drawTattoo();
+	}
 }
 
 // Draw Color
 inline void Kinect::drawTattoo()
 {
-	overlayTattoo(colorMat, tattooMat, tattooLocation, .85);
-}
-
-
-inline void Kinect::rotateImage(const cv::Mat &input, cv::Mat &output, cv::Point3f rotationVector, double gamma, double dx, double dy, double dz, double fx, double fy)
-{
-	cv::Mat mat;
-	cv::Rodrigues(cv::Mat(rotationVector), mat);
-
-
-	double zer[3] = { 0.0 };
-	double zer1[4] = { 0.0 };
-	cv::vconcat(mat, cv::Mat(1, 3, CV_32F, zer), mat);
-	cv::hconcat(mat, cv::Mat(4, 1, CV_32F, zer1), mat);
-	mat.at<float>(3, 3) = 1.0;
-
-
-	//alpha = (alpha)*CV_PI / 180.;
-	//beta = (beta)*CV_PI / 180.;
-	gamma = (gamma)*CV_PI / 180.;
-
-	// get width and height for ease of use in matrices
-	double w = (double)input.cols;
-	double h = (double)input.rows;
-
-	// Projection 2D -> 3D matrix
-	cv::Mat A1 = (cv::Mat_<double>(4, 3) <<
-		1, 0, -w / 2,
-		0, 1, -h / 2,
-		0, 0, 0,
-		0, 0, 1);
-
-	//// Rotation matrices around the X, Y, and Z axis
-	//Mat RX = (Mat_<double>(4, 4) <<
-	//	1, 0, 0, 0,
-	//	0, cos(alpha), -sin(alpha), 0,
-	//	0, sin(alpha), cos(alpha), 0,
-	//	0, 0, 0, 1);
-	//Mat RY = (Mat_<double>(4, 4) <<
-	//	cos(beta), 0, -sin(beta), 0,
-	//	0, 1, 0, 0,
-	//	sin(beta), 0, cos(beta), 0,
-	//	0, 0, 0, 1);
-
-	cv::Mat RZ = (cv::Mat_<double>(4, 4) <<
-		cos(gamma), -sin(gamma), 0, 0,
-		sin(gamma), cos(gamma), 0, 0,
-		0, 0, 1, 0,
-		0, 0, 0, 1);
-
-	// Composed rotation matrix with (RX, RY, RZ)
-	//Mat R = RX * RY * RZ;
-	mat.convertTo(mat, A1.type());
-	cv::Mat R = mat * RZ;
-
-	// Translation matrix
-	cv::Mat T = (cv::Mat_<double>(4, 4) <<
-		1, 0, 0, dx,
-		0, 1, 0, dy,
-		0, 0, 1, dz,
-		0, 0, 0, 1);
-
-	// 3D -> 2D matrix
-	cv::Mat A2 = (cv::Mat_<double>(3, 4) <<
-		fx, 0, w / 2, 0,
-		0, fy, h / 2, 0,
-		0, 0, 1, 0);
+	MemoryScope scope(Memory_Composite);
 
+	layers.clear();
 
-	// Final transformation matrix
-	cv::Mat trans = A2 * (T * (R * A1));
+	Layer layer;
+	layer.image = &tattooMat;
+	layer.location = tattooLocation;
+	layer.opacity = .85;
+	layer.shading = shading;
+	layer.spans = tattooSpans.get();
+	layer.mask = skin.mask().empty() ? nullptr : &skin.mask();
+	layer.maskOrigin = skin.location();
+	layers.push_back(layer);
 
-
-	// Apply matrix transformation
-	cv::warpPerspective(input, output, trans, input.size(), cv::INTER_LANCZOS4);
+	compositor.composite(colorMat, layers);
 }
 
-inline void Kinect::rotateImage(const cv::Mat &input, cv::Mat &output, double alpha, double beta, double gamma, double dx, double dy, double dz, double fx, double fy)
+// Draw Grid
+inline void Kinect::drawGrid()
 {
-	//alpha = (alpha)*CV_PI / 180.;
-	//beta = (beta)*CV_PI / 180.;
-	//gamma = (gamma)*CV_PI / 180.;
-
-	// get width and height for ease of use in matrices
-	double w = (double)input.cols;
-	double h = (double)input.rows;
-
-	// Projection 2D -> 3D matrix
-	cv::Mat A1 = (cv::Mat_<double>(4, 3) <<
-		1, 0, -w / 2,
-		0, 1, -h / 2,
-		0, 0, 0,
-		0, 0, 1);
-
-	// Rotation matrices around the X, Y, and Z axis
-	cv::Mat RX = (cv::Mat_<double>(4, 4) <<
-		1, 0, 0, 0,
-		0, cos(alpha), -sin(alpha), 0,
-		0, sin(alpha), cos(alpha), 0,
-		0, 0, 0, 1);
-	cv::Mat RY = (cv::Mat_<double>(4, 4) <<
-		cos(beta), 0, -sin(beta), 0,
-		0, 1, 0, 0,
-		sin(beta), 0, cos(beta), 0,
-		0, 0, 0, 1);
-	cv::Mat RZ = (cv::Mat_<double>(4, 4) <<
-		cos(gamma), -sin(gamma), 0, 0,
-		sin(gamma), cos(gamma), 0, 0,
-		0, 0, 1, 0,
-		0, 0, 0, 1);
-
-	// Composed rotation matrix with (RX, RY, RZ)
-	cv::Mat R = RX * RY * RZ;
-
-
-	// Translation matrix
-	cv::Mat T = (cv::Mat_<double>(4, 4) <<
-		1, 0, 0, dx,
-		0, 1, 0, dy,
-		0, 0, 1, dz,
-		0, 0, 0, 1);
-
-	// 3D -> 2D matrix
-	cv::Mat A2 = (cv::Mat_<double>(3, 4) <<
-		fx, 0, w / 2, 0,
-		0, fy, h / 2, 0,
-		0, 0, 1, 0);
-
-
-	// Final transformation matrix
-	cv::Mat trans = A2 * (T * (R * A1));
+	MemoryScope scope(Memory_Composite);
+
+	// Every tile places its tattoo where the main one would be
+	TryOnPlacement placement;
+	const bool placed = tattooLocation.x != 0 && tattooLocation.y != 0;
+	if (placed){
+		const QualityTier& quality = governor.tier();
+		placement.pose = tattooPose;
+		placement.limbRadius = limbRadius(tattooAnchor, tattooPose);
+		placement.zoom = zoomFactor;
+		placement.interpolation = quality.warpInterpolation;
+		placement.mipBias = quality.mipBias;
+		placement.variant = governor.level();
+		placement.opacity = .85;
+		placement.shading = shading;
+	}
 
-
-	// Apply matrix transformation
-	cv::warpPerspective(input, output, trans, input.size(), cv::INTER_LANCZOS4);
+	grid.render(colorMat, placed ? &placement : nullptr, gridMat);
 }
 
-// overlay an image with another given the point in the middle
-inline void Kinect::overlayTattoo(cv::Mat& src, cv::Mat& overlay, const cv::Point& point, const double opacitasdy)
+// Free cached buffers of the tags over their memory budget. Allocations are never refused,
+// so a tag without anything cached to free stays over budget and only its overruns are counted.
+inline void Kinect::enforceBudgets()
 {
-	cv::Point location = cv::Point(point.x - (overlay.cols / 2), point.y - (overlay.rows / 2));
-
-#pragma omp parallel for
-	for (int y = cv::max(location.y, 0); y < src.rows; ++y) {
-		int fY = y - location.y;
-
-		if (fY >= overlay.rows)
-			break;
+	MemoryAccounting& memory = MemoryAccounting::instance();
 
-#pragma omp parallel for
-		for (int x = cv::max(location.x, 0); x < src.cols; ++x) {
-			int fX = x - location.x;
-
-			if (fX >= overlay.cols)
-				break;
-
-			double opacity =
-				((double)overlay.data[fY * overlay.step + fX * overlay.channels() + 3]) / 255.;
-
-#pragma omp parallel for
-			for (int c = 0; opacity > 0 && c < src.channels(); ++c) {
-				unsigned char overlayPx = overlay.data[fY * overlay.step + fX * overlay.channels() + c];
-				unsigned char srcPx = src.data[y * src.step + x * src.channels() + c];
-				src.data[y * src.step + src.channels() * x + c] = srcPx * (1. - opacity) + overlayPx * opacity;
-				//src.data[y * src.step + src.channels() * x + c] = overlayPx;
-			}
+	// Warps: least recently used poses first, then the warps of the grid
+	if (memory.overBudget(Memory_Warp) > 0){
+		WarpCache& warpCache = tattooRenderer.cache();
+		while (memory.overBudget(Memory_Warp) > 0 && warpCache.size() > 0){
+			warpCache.trim(warpCache.bytes() / 2);
+		}
+		if (memory.overBudget(Memory_Warp) > 0){
+			grid.clearCaches();
 		}
 	}
-}
 
+	// Assets: tiles of vector tattoos ( freed by the rasterizer thread ), then the grid tattoos while it is hidden
+	if (memory.overBudget(Memory_Assets) > 0){
+		rasterizer.dropTiles();
+		if (!gridShown && !grid.empty()){
+			grid.setTattoos(std::vector<PreparedTattoo>());
+		}
+	}
 
-inline cv::Point2f Kinect::convertPointCylinder(const cv::Point2f point, int w, int h, double r_factor)
-{
-	//center the point at 0,0
-	cv::Point2f pc(point.x - w / 2, point.y - h / 2);
-
-	// these are your free parameters
-	// cylinder focal length and radius
-	float f = -w;
-	float r = w*r_factor;
-
-	float omega = w / 2;
-	float z0 = f - sqrt(r*r - omega*omega);
+	// Ingest: color frames still waiting for a body sample
+	if (memory.overBudget(Memory_Ingest) > 0){
+		frameSync.clear();
+	}
 
-	float zc = (2 * z0 + sqrt(4 * z0*z0 - 4 * (pc.x*pc.x / (f*f) + 1)*(z0*z0 - r*r))) / (2 * (pc.x*pc.x / (f*f) + 1));
-	cv::Point2f final_point(pc.x*zc / f, pc.y*zc / f);
-	final_point.x += w / 2;
-	final_point.y += h / 2;
-	return final_point;
+	for (int i = 0; i < MemoryTagCount; i++){
+		const MemoryTag tag = static_cast<MemoryTag>(i);
+		const size_t over = memory.overBudget(tag);
+		if (over > 0 && !overBudget[i]){
+			std::cout << "memory: " << memoryTagName(tag) << " " << over / (1 << 20) << " MB over its budget of "
+				<< memory.budget(tag) / (1 << 20) << " MB" << std::endl;
+		}
+		overBudget[i] = over > 0;
+	}
 }
 
-inline cv::Mat Kinect::cylinderProjection(const cv::Mat &input, double focalLength, double radius)
+// Draw UI
+inline void Kinect::drawUI()
 {
-	int height = input.rows;
-	int width = input.cols;
-
-	cv::Mat output = cv::Mat(2 * height, 2 * width, input.type());
-
-#pragma omp parallel for
-	for (int y = 0; y < output.rows; y++)
-	{
-		//std::cout << "for " << "y " << y << std::endl;
-#pragma omp parallel for
-		for (int x = 0; x < output.cols; x++)
-		{
-
-			if (output.channels() == 4) {
-				const cv::Vec4b val(0, 0, 0, 0);
-				output.at<cv::Vec4b>(y, x) = val;
-			}
-
-			cv::Point2f current_pos(x - height / 2, y - width / 2);
-			current_pos = convertPointCylinder(current_pos, width, height, radius);
+	MemoryScope scope(Memory_UI);
 
-			cv::Point2i top_left((int)current_pos.x, (int)current_pos.y); //top left because of integer rounding
-
-			//make sure the point is actually inside the original image
-			if (top_left.x < 0 ||
-				top_left.x > width - 2 ||
-				top_left.y < 0 ||
-				top_left.y > height - 2)
-			{
-				continue;
-			}
-
-			//bilinear interpolation
-			float dx = current_pos.x - top_left.x;
-			float dy = current_pos.y - top_left.y;
-
-			float weight_tl = (1.0 - dx) * (1.0 - dy);
-			float weight_tr = dx * (1.0 - dy);
-			float weight_bl = (1.0 - dx) * dy;
-			float weight_br = dx*dy;
-
-			if (input.channels() == 3) 
-			{
-				//std::cout << "antes de pegar as coisa" << std::endl;
-				cv::Vec3b v1 = input.at<cv::Vec3b>(top_left);
-				cv::Vec3b v2 = input.at<cv::Vec3b>(top_left.y, top_left.x + 1);
-				cv::Vec3b v3 = input.at<cv::Vec3b>(top_left.y + 1, top_left.x);
-				cv::Vec3b v4 = input.at<cv::Vec3b>(top_left.y + 1, top_left.x + 1);
-				cv::Vec3b value(0, 0, 0);
-
-				for (int c = 0; c < input.channels(); ++c) {
-					value[c] = weight_tl * v1[c] +
-						weight_tr * v2[c] +
-						weight_bl * v3[c] +
-						weight_br * v4[c];
-				}
-				output.at<cv::Vec3b>(y, x) = value;
-			}
-			else if (input.channels() == 4)
-			{
-				//std::cout << "antes de pegar as coisa" << std::endl;
-				cv::Vec4b v1 = input.at<cv::Vec4b>(top_left);
-				cv::Vec4b v2 = input.at<cv::Vec4b>(top_left.y, top_left.x + 1);
-				cv::Vec4b v3 = input.at<cv::Vec4b>(top_left.y + 1, top_left.x);
-				cv::Vec4b v4 = input.at<cv::Vec4b>(top_left.y + 1, top_left.x + 1);
-				cv::Vec4b value(0, 0, 0, 0);
-
-				for (int c = 0; c < input.channels(); ++c) {
-					value[c] = weight_tl * v1[c] +
-						weight_tr * v2[c] +
-						weight_bl * v3[c] +
-						weight_br * v4[c];
-				}
-				output.at<cv::Vec4b>(y, x) = value;
-			}
-			else if (input.channels() == 1)
-			{
-				uchar value = weight_tl * input.at<uchar>(top_left) +
-					weight_tr * input.at<uchar>(top_left.y, top_left.x + 1) +
-					weight_bl * input.at<uchar>(top_left.y + 1, top_left.x) +
-					weight_br * input.at<uchar>(top_left.y + 1, top_left.x + 1);
-
-				output.at<uchar>(y, x) = value;
-			}
-
-		}
-	}
-
-	return output;
+	uiOverlay.create(colorMat.size(), CV_8UC3);
+	uiOverlay.setTo(cv::Scalar::all(0));
+	ui.draw(uiOverlay);
 }
 
 // Draw Body
 inline void Kinect::drawBody()
 {
-	// Draw Body Data to Color Data
+	MemoryScope scope(Memory_UI);
+
+	skeletonOverlay.create(colorMat.size(), CV_8UC3);
+	skeletonOverlay.setTo(cv::Scalar::all(0));
+
+	// Draw the paired joints, already in color space, with the hands of the newest body frame
 #pragma omp parallel for
 	for (int index = 0; index < BODY_COUNT; index++){
-		ComPtr<IBody> body = bodies[index];
-		if (body == nullptr){
-			continue;
-		}
-
-		// Check Body Tracked
-		BOOLEAN tracked = FALSE;
-		ERROR_CHECK(body->get_IsTracked(&tracked));
-		if (!tracked){
+		if (!joints.tracked[index]){
 			continue;
 		}
 
-		// Retrieve Joints
-		std::array<Joint, JointType::JointType_Count> joints;
-		ERROR_CHECK(body->GetJoints(static_cast<UINT>(joints.size()), &joints[0]));
-
-#pragma omp parallel for
-		for (int type = 0; type < JointType::JointType_Count; type++){
+		for (int type = 0; type < SkeletonJointCount; type++){
 			// Check Joint Tracked
-			const Joint joint = joints[type];
-			if (joint.TrackingState == TrackingState::TrackingState_NotTracked){
+			const int slot = index * SkeletonJointCount + type;
+			if (joints.state[slot] == JointState_NotTracked){
 				continue;
 			}
 
 			// Draw Joint Position
-			drawEllipse(colorMat, joint, 5, colors[index]);
-
-			// Draw Left Hand State
-			if (joint.JointType == JointType::JointType_HandLeft){
-				HandState handState;
-				TrackingConfidence handConfidence;
-				ERROR_CHECK(body->get_HandLeftState(&handState));
-				ERROR_CHECK(body->get_HandLeftConfidence(&handConfidence));
-
-				drawHandState(colorMat, joint, handState, handConfidence);
-			}
+			const cv::Point2f point(joints.u[slot], joints.v[slot]);
+			drawEllipse(skeletonOverlay, point, 5, colors[index]);
 
-			// Draw Right Hand State
-			if (joint.JointType == JointType::JointType_HandRight){
-				HandState handState;
-				TrackingConfidence handConfidence;
-				ERROR_CHECK(body->get_HandRightState(&handState));
-				ERROR_CHECK(body->get_HandRightConfidence(&handConfidence));
-
-				drawHandState(colorMat, joint, handState, handConfidence);
-			}
-
-
-
-			// TESTE
-			if (joint.JointType == JointType::JointType_HandLeft) {
-				ColorSpacePoint colorSpacePoint;
-				ERROR_CHECK(coordinateMapper->MapCameraPointToColorSpace(joint.Position, &colorSpacePoint));
-				const int x = static_cast<int>(colorSpacePoint.X + 0.5f);
-				const int y = static_cast<int>(colorSpacePoint.Y + 0.5f);
-				leftHand = cv::Point(x, y);
+			// Draw Hand States
+			if (type == Joint_HandLeft){
+				drawHandState(skeletonOverlay, point, bodies.hands.left[index], bodies.hands.leftConfident[index]);
 			}
-
-			if (joint.JointType == JointType::JointType_HandRight) {
-				ColorSpacePoint colorSpacePoint;
-				ERROR_CHECK(coordinateMapper->MapCameraPointToColorSpace(joint.Position, &colorSpacePoint));
-				const int x = static_cast<int>(colorSpacePoint.X + 0.5f);
-				const int y = static_cast<int>(colorSpacePoint.Y + 0.5f);
-				rightHand = cv::Point(x, y);
-			}
-
-			if (joint.JointType == JointType::JointType_WristRight) {
-				ColorSpacePoint colorSpacePoint;
-				ERROR_CHECK(coordinateMapper->MapCameraPointToColorSpace(joint.Position, &colorSpacePoint));
-				const int x = static_cast<int>(colorSpacePoint.X + 0.5f);
-				const int y = static_cast<int>(colorSpacePoint.Y + 0.5f);
-				rightWrist = cv::Point(x, y);
-
-				///////////////////////////////
-				CameraSpacePoint cameraPoint = joint.Position;
-				target1 = cv::Point3d(cameraPoint.X, cameraPoint.Y, cameraPoint.Z);
+			if (type == Joint_HandRight){
+				drawHandState(skeletonOverlay, point, bodies.hands.right[index], bodies.hands.rightConfident[index]);
 			}
-
-			if (joint.JointType == JointType::JointType_ElbowRight) {
-				ColorSpacePoint colorSpacePoint;
-				ERROR_CHECK(coordinateMapper->MapCameraPointToColorSpace(joint.Position, &colorSpacePoint));
-				const int x = static_cast<int>(colorSpacePoint.X + 0.5f);
-				const int y = static_cast<int>(colorSpacePoint.Y + 0.5f);
-				rightElbow = cv::Point(x, y);
-
-				///////////////////////////////
-				CameraSpacePoint cameraPoint = joint.Position;
-				target2 = cv::Point3d(cameraPoint.X, cameraPoint.Y, cameraPoint.Z);
-			}
-	
 		}
-
-		/*
-		// Retrieve Joint Orientations
-		std::array<JointOrientation, JointType::JointType_Count> orientations;
-		ERROR_CHECK( body->GetJointOrientations( JointType::JointType_Count, &orientations[0] ) );
-		*/
-
-		/*
-		// Retrieve Amount of Body Lean
-		PointF amount;
-		ERROR_CHECK( body->get_Lean( &amount ) );
-		*/
 	}
 }
 
 // Draw Ellipse
-inline void Kinect::drawEllipse(cv::Mat& image, const Joint& joint, const int radius, const cv::Vec3b& color, const int thickness)
+inline void Kinect::drawEllipse(cv::Mat& image, const cv::Point2f& point, const int radius, const cv::Vec3b& color, const int thickness)
 {
 	if (image.empty()){
 		return;
 	}
 
-	// Convert Coordinate System and Draw Joint
-	ColorSpacePoint colorSpacePoint;
-	ERROR_CHECK(coordinateMapper->MapCameraPointToColorSpace(joint.Position, &colorSpacePoint));
-	const int x = static_cast<int>(colorSpacePoint.X + 0.5f);
-	const int y = static_cast<int>(colorSpacePoint.Y + 0.5f);
+	// Joints the mapper could not place are at infinity
+	if (!(point.x > -1 && point.x < image.cols && point.y > -1 && point.y < image.rows)){
+		return;
+	}
+	const int x = static_cast<int>(point.x + 0.5f);
+	const int y = static_cast<int>(point.y + 0.5f);
 	if ((0 <= x) && (x < image.cols) && (0 <= y) && (y < image.rows)){
-		cv::circle(image, cv::Point(x, y), radius, static_cast<cv::Scalar>(color), thickness, cv::LINE_AA);
+		cv::circle(image, cv::Point(x, y), radius, static_cast<cv::Scalar>(color), thickness, governor.tier().lineType);
 	}
 }
 
 // Draw Hand State
-inline void Kinect::drawHandState(cv::Mat& image, const Joint& joint, HandState handState, TrackingConfidence handConfidence)
+inline void Kinect::drawHandState(cv::Mat& image, const cv::Point2f& point, int handState, bool confident)
 {
 	if (image.empty()){
 		return;
 	}
 
 	// Check Tracking Confidence
-	if (handConfidence != TrackingConfidence::TrackingConfidence_High){
+	if (!confident){
 		return;
 	}
 
-
 	// Draw Hand State 
 	const int radius = 75;
 	const cv::Vec3b blue = cv::Vec3b(128, 0, 0), green = cv::Vec3b(0, 128, 0), red = cv::Vec3b(0, 0, 128);
 	switch (handState){
 		// Open
-	case HandState::HandState_Open:
-		drawEllipse(image, joint, radius, green, 5);
+	case BodyHand_Open:
+		drawEllipse(image, point, radius, green, 5);
 		break;
 		// Close
-	case HandState::HandState_Closed:
-		drawEllipse(image, joint, radius, red, 5);
+	case BodyHand_Closed:
+		drawEllipse(image, point, radius, red, 5);
 		break;
 		// Lasso
-	case HandState::HandState_Lasso:
-		drawEllipse(image, joint, radius, blue, 5);
+	case BodyHand_Lasso:
+		drawEllipse(image, point, radius, blue, 5);
 		break;
 	default:
 		break;
 	}
 }
 
+void Kinect::publishFrames(const std::string& name)
+{
+	publishName = name;
+}
+
+void Kinect::addOutput(const OutputSink& sink)
+{
+	outputs.addSink(sink);
+}
+
+void Kinect::recordSession(const std::string& directory)
+{
+	recorder.reset(new SessionWriter(directory));
+}
+
+void Kinect::profileStages()
+{
+	// Counters follow the thread that opens them, the main loop runs here
+	profiler.reset(new PerfProfiler);
+	governor.setProfiler(profiler.get());
+}
+
+// Publish the composited frame to shared memory
+inline void Kinect::publish()
+{
+	MemoryScope scope(Memory_Composite);
+
+	SharedPose shared = {};
+	if (tattooLocation.x != 0 && tattooLocation.y != 0){
+		shared.x = tattooPose.location.x;
+		shared.y = tattooPose.location.y;
+		shared.angle = tattooPose.angle;
+		shared.length = tattooPose.length;
+		shared.px = tattooPose.position.x;
+		shared.py = tattooPose.position.y;
+		shared.pz = tattooPose.position.z;
+		shared.placed = 1;
+	}
+
+	if (!publisher.publish(colorMat, static_cast<int64_t>(frameTime * 1e6), shared, publishName)){
+		std::cout << "ERROR: cannot publish frames to " << publishName << std::endl;
+		publishName.clear();
+	}
+}
+
 // Show Data
 void Kinect::show()
 {
@@ -839,62 +876,83 @@ inline void Kinect::showBody()
 		return;
 	}
 
-	// Resize Image
-	cv::Mat resizeMat;
-	const double scale = 0.5;
-	cv::resize(colorMat, resizeMat, cv::Size(), scale, scale);
+	// Resize, mirror and overlay every output in one pass
+	{
+		MemoryScope scope(Memory_Composite);
+		QualityGovernor::Stage stage(governor, "outputs");
+		outputs.render(gridShown ? gridMat : colorMat, skeletonOverlay, uiOverlay);
+	}
+
+	// Show Images
+	for (auto& sink : outputs.sinks()){
+		if (sink.fullscreen && !shownFullscreen){
+			cv::namedWindow(sink.name, CV_WINDOW_NORMAL);
+			cv::setWindowProperty(sink.name, CV_WND_PROP_FULLSCREEN, CV_WINDOW_FULLSCREEN);
+		}
+		cv::imshow(sink.name, sink.image);
+	}
+	shownFullscreen = true;
 
-	// Show Image
-	cv::imshow("Body", resizeMat);
-	changeTattoo();
-	nextTattoo();
+	// HighGUI is only used from this thread, so the preview loaded by the UI is shown here
+	cv::Mat preview;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		preview = pendingPreview;
+		pendingPreview.release();
+	}
+	if (!preview.empty()){
+		cv::imshow("Next image", preview);
+	}
 }
 
-// index of image
-int index = 0;
+// Runs on the UI thread
+void Kinect::nextTattoo(){
+	updateNextImageFrame();
+}
 
-inline void Kinect::nextTattoo(){
-	const double distLeftHandButNext = cv::norm(leftHand - buttonNextLocation);
-	const double distRightHandButNext = cv::norm(rightHand - buttonNextLocation);
-	if (distLeftHandButNext < buttonRadius || distRightHandButNext < buttonRadius) {
-		// colocar aqui ação que deve acontecer quando a mão passar no botão 
-		updateNextImageFrame();
+// Runs on the UI thread
+void Kinect::changeTattoo(){
+	std::string path = "images/" + imagesPath[tattooIndex];
+	PreparedTattoo prepared = loadTattoo(path.c_str());
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pendingTattoo = prepared;
 	}
+
+	tattooIndex = (tattooIndex + 1) % imagesCount;
+	updateNextImageFrame();
 }
 
-inline void Kinect::changeTattoo(){
-	const double distLeftHandButNext = cv::norm(leftHand - buttonImageLocation);
-	const double distRightHandButNext = cv::norm(rightHand - buttonImageLocation);
-	if (distLeftHandButNext < buttonRadius || distRightHandButNext < buttonRadius) {
-		
-		//colocar aqui ação que deve acontecer quando a mão passar no botão 
-		std::string path = "images/" + imagesPath[index];
-		setTattoo(path.c_str());
+// Runs on the UI thread
+void Kinect::toggleGrid()
+{
+	if (gridMode){
+		gridMode = false;
+		return;
+	}
 
-		if (index == 18){
-			index = 0;
-		}
-		else
-		{
-			index++;
-		}
-		updateNextImageFrame();
+	// The tattoos from the current one on, small enough for a tile, so they all stay in memory
+	std::vector<PreparedTattoo> tattoos;
+	for (int i = 0; i < grid.capacity() && i < static_cast<int>(imagesCount); i++){
+		const std::string path = "images/" + imagesPath[(tattooIndex + i) % imagesCount];
+		tattoos.push_back(loadTattoo(path.c_str(), 256));
+	}
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pendingGrid = tattoos;
 	}
+	gridMode = true;
 }
 
+// Runs on the UI thread
 void Kinect::updateNextImageFrame()
 {
-	cv::Mat image;
-	if (index == 18){
-		cv::String imageName("images/" + imagesPath[0]);
-		image = imread(imageName, cv::IMREAD_COLOR); // Read the file
-	}
-	else
-	{
-		cv::String imageName("images/" + imagesPath[index]);
-		image = imread(imageName, cv::IMREAD_COLOR); // Read the file
-	}
-	cv::imshow("Next image", image);
+	MemoryScope scope(Memory_Assets);
+
+	cv::String imageName("images/" + imagesPath[tattooIndex]);
+	cv::Mat image = isVectorTattoo(imageName) ? rasterizeVector(*readVectorTattoo(imageName), 300) : imread(imageName, cv::IMREAD_COLOR); // Read the file
+
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	pendingPreview = image;
 }
@@ -10,8 +10,29 @@
 #include <vector>
 #include <array>
 #include <string>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+#include "ui.h"
+#include "compositor.h"
+#include "skeleton.h"
+#include "quality.h"
+#include "warpcache.h"
+#include "renderer.h"
+#include "sharedframe.h"
+#include "render.h"
+#include "recording.h"
+#include "framesync.h"
+#include "outputs.h"
+#include "changes.h"
+#include "grid.h"
+#include "memorybudget.h"
+#include "skin.h"
+#include "bodysnapshot.h"
 using std::string;
-const string imagesPath[] = { "emoticon.png", "rose.png", "windows.png", "yy.png", "ancora.png", "cruz.png", "escorpiao.png", "flor.png", "heart.png", "leao.png", "patas.png", "rose2.png", "seta.png", "tat.png", "tat4.png", "tr.png" };
+const string imagesPath[] = { "emoticon.png", "rose.png", "windows.png", "yy.png", "ancora.png", "cruz.png", "escorpiao.png", "flor.png", "heart.png", "leao.png", "patas.png", "rose2.png", "seta.png", "tat.png", "tat4.png", "tr.png", "estrela.svg" };
+const size_t imagesCount = sizeof(imagesPath) / sizeof(imagesPath[0]);
 
 #include <wrl/client.h>
 using namespace Microsoft::WRL;
@@ -29,34 +50,122 @@ private:
 	ComPtr<IColorFrameReader> colorFrameReader;
 	ComPtr<IBodyFrameReader> bodyFrameReader;
 
-	// Color Buffer
-	std::vector<BYTE> colorBuffer;
+	// Color Size
 	int colorWidth;
 	int colorHeight;
 	unsigned int colorBytesPerPixel;
-	cv::Mat colorMat, tattooSrcMat, tattooMat;
+	cv::Mat colorMat, tattooMat;
+
+	// Visible spans of tattooMat, so the blend skips its transparent pixels
+	std::shared_ptr<const TattooSpans> tattooSpans;
+
+	// Projected tattoo and its mips
+	PreparedTattoo tattoo;
+
+	// Changes whenever the tattoo is replaced
+	unsigned long long tattooId = 0;
+
+	// Vector tattoos rasterized again at the scale they are shown
+	VectorRasterizer rasterizer;
+
+	// Smooths the limb radius and warps the tattoo, recent warps cached by quantized angle and scale
+	TattooRenderer tattooRenderer;
+
+	// Picks interpolation, mip bias, AA and overlays to hold the frame rate
+	QualityGovernor governor;
+
+	// Hardware counters per stage, off while null
+	std::unique_ptr<PerfProfiler> profiler;
 	cv::Point tattooLocation;
 
+	// Tattoo layers blended over the color frame
+	Compositor compositor;
+	std::vector<Layer> layers;
+
+	// How much the ink follows the skin shading, 0 for flat ink
+	double shading = .8;
+
+	// Tilt the tattoo with the arm out of the image plane ( key F )
+	bool foreshortening = false;
+
+	// Hide the ink where the limb under it is not bare skin, e.g. a sleeve ( key K )
+	SkinMask skin;
+	bool skinClipping = true;
+
+	// Skips the stages whose inputs did not visibly change, and counts them ( key C )
+	ChangeTracker changes;
 
-	cv::Point rightElbow;
-	cv::Point rightWrist;
+	// Inputs of the last warp, the pose is tattooPose
+	unsigned long long warpedTattoo = 0;
+	int warpedVariant = -1;
+	bool warpedForeshortening = false;
+	float warpedZoom = 0;
+
+	// Inputs of the overlays drawn last
+	JointBuffer drawnJoints;
+	BodyHands drawnHands;
+	unsigned long long drawnRevision = 0;
+
+	// Where the tattoo is placed on the skeleton, and where it was on the last frame
+	BoneAnchor tattooAnchor;
+	AnchorPose tattooPose;
+
+	// Joints of every body and their bone frames, decoded at acquisition
+	JointBuffer joints;
+
+	// Color frames and body samples paired by RelativeTime
+	FrameSync frameSync;
+	BodySnapshot bodySample;
+	SyncedFrame pairedFrame;
+	bool frameReady = false;
+	BoneFrames boneFrames;
+
+	// Body frames decoded at acquisition, no sensor object outlives it, and the newest one read
+	BodyExchange bodyExchange;
+	BodySnapshot bodies;
 
 	cv::Point rightHand;
 	cv::Point leftHand;
 
-	cv::Point3d target1;
-	cv::Point3d target2;
-
 	// For UI
-	cv::Point buttonBiggerLocation;
-	cv::Point buttonSmallerLocation;
-	cv::Point buttonImageLocation;
-	cv::Point buttonNextLocation;
-	float buttonRadius = 80;
+	float buttonRadius = 90;
 	float zoomFactor = 1;
+	double frameTime = 0;
+
+	// Catalog position, only touched by UI actions
+	size_t tattooIndex = 0;
+
+	// Results of UI actions, handed to the render thread
+	std::mutex pendingMutex;
+	PreparedTattoo pendingTattoo;
+	cv::Mat pendingPreview;
+	std::vector<PreparedTattoo> pendingGrid;
+
+	// Catalog tattoos side by side on the same frame ( key G ), toggled by UI actions
+	TryOnGrid grid;
+	std::atomic<bool> gridMode;
+	bool gridShown = false;
+	cv::Mat gridMat;
+
+	// Declared after the state its actions touch, so its thread is joined first
+	GestureUI ui;
+
+	// Composited frames for other processes, off while the name is empty
+	FramePublisher publisher;
+	std::string publishName;
 
-	// Body Buffer
-	std::array<IBody*, BODY_COUNT> bodies;
+	// Windows showing the composite, and the overlays drawn for them ( black is transparent )
+	OutputRenderer outputs;
+	cv::Mat skeletonOverlay, uiOverlay;
+	bool shownFullscreen = false;
+
+	// Tags over their memory budget at the last check, so going over is logged once
+	std::array<bool, MemoryTagCount> overBudget;
+
+	// Raw color frames and joints for offline renders, off while null
+	std::unique_ptr<SessionWriter> recorder;
+
+	// Body Colors
 	std::array<cv::Vec3b, BODY_COUNT> colors;
 
 public:
@@ -70,9 +179,30 @@ public:
 	// Load the tattoo file
 	void setTattoo(const char* filename);
 
+	// Read and project a tattoo file without touching the current one, downscaled to maxSide when it is not 0
+	PreparedTattoo loadTattoo(const char* filename, int maxSide = 0);
+
 	// Processing
 	void run();
 
+	// Warp cache hit rate and memory use
+	const WarpCache& getWarpCache() const { return tattooRenderer.cache(); }
+
+	// Stages run and skipped because nothing changed
+	const ChangeTracker& getChanges() const { return changes; }
+
+	// Publish every composited frame to the shared memory region name
+	void publishFrames(const std::string& name);
+
+	// Show the composite in another window, before run. Without any, a half size window with all overlays
+	void addOutput(const OutputSink& sink);
+
+	// Record the session to an existing directory
+	void recordSession(const std::string& directory);
+
+	// Count cycles, instructions, cache and branch misses per stage, reported with key P and on exit
+	void profileStages();
+
 private:
 	// Initialize
 	void initialize();
@@ -80,8 +210,8 @@ private:
 	// Initialize Sensor
 	inline void initializeSensor();
 
-	//// Initialize UI
-	//inline void initializeUI();
+	// Initialize UI
+	inline void initializeUI();
 
 	// Initialize Tattoo
 	inline void initializeTattoo();
@@ -105,39 +235,38 @@ private:
 	// Update Body
 	inline void updateBody();
 
+	// Update Skeleton
+	inline void updateSkeleton();
+
 	// Update Tattoo
 	inline void updateTattoo();
 
 	// Update UI
 	inline void updateUI();
 
+	// Update Skin
+	inline void updateSkin();
+
 	// Draw Data
 	void draw();
 
-	// Draw Color
-	inline void drawColor();
-	
 	// Draw Tattoo
 	inline void drawTattoo();
 
-	// Auxiliary for the tattoo
-	inline void overlayTattoo(cv::Mat& src, cv::Mat& overlay, const cv::Point& location, const double opacity);
-	
-	inline void rotateImage(const cv::Mat &input, cv::Mat &output, double alpha, double beta, double gamma, double dx, double dy, double dz, double fx, double fy);
-	inline void rotateImage(const cv::Mat &input, cv::Mat &output, cv::Point3f rotationVector, double gamma, double dx, double dy, double dz, double fx, double fy);
-
-	inline cv::Mat cylinderProjection(const cv::Mat &input, double focalLength, double radius);
-
-	inline cv::Point2f convertPointCylinder(const cv::Point2f point, int w, int h, double r_factor);
-
 	// Draw Body
 	inline void drawBody();
 
+	// Draw UI
+	inline void drawUI();
+
 	// Draw Circle
-	inline void drawEllipse(cv::Mat& image, const Joint& joint, const int radius, const cv::Vec3b& color, const int thickness = -1);
+	inline void drawEllipse(cv::Mat& image, const cv::Point2f& point, const int radius, const cv::Vec3b& color, const int thickness = -1);
 
 	// Draw Hand State
-	inline void drawHandState(cv::Mat& image, const Joint& joint, HandState handState, TrackingConfidence handConfidence);
+	inline void drawHandState(cv::Mat& image, const cv::Point2f& point, int handState, bool confident);
+
+	// Publish Data
+	inline void publish();
 
 	// Show Data
 	void show();
@@ -148,14 +277,23 @@ private:
 	// Show Body
 	inline void showBody();
 	
-	// Next Tattoo
-	inline void nextTattoo();
+	// Next Tattoo ( UI action )
+	void nextTattoo();
 	
-	// Change Tattoo
-	inline void changeTattoo();
+	// Change Tattoo ( UI action )
+	void changeTattoo();
 	
-	//updateNextImageFrame
+	// Load the preview of the next tattoo ( UI action )
 	void updateNextImageFrame();
+
+	// Show or hide the try-on grid, loading its tattoos ( UI action )
+	void toggleGrid();
+
+	// Draw Grid
+	inline void drawGrid();
+
+	// Free cached buffers of the tags over their memory budget
+	inline void enforceBudgets();
 };
 
 #endif // __APP__
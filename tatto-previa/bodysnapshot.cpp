@@ -0,0 +1,175 @@
+#include "bodysnapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+void BodyHands::clear()
+{
+	for (int i = 0; i < SkeletonBodyCount; i++){
+		left[i] = right[i] = BodyHand_Unknown;
+		leftConfident[i] = rightConfident[i] = false;
+	}
+}
+
+bool sameHands(const BodyHands& a, const BodyHands& b)
+{
+	for (int i = 0; i < SkeletonBodyCount; i++){
+		if (a.left[i] != b.left[i] || a.right[i] != b.right[i] || a.leftConfident[i] != b.leftConfident[i] || a.rightConfident[i] != b.rightConfident[i]){
+			return false;
+		}
+	}
+	return true;
+}
+
+void BodySnapshot::clear()
+{
+	version = 0;
+	time = 0;
+	joints.clear();
+	hands.clear();
+}
+
+// Constructor
+BodyExchange::BodyExchange()
+{
+	for (auto& slot : slots){
+		slot.sequence.store(0, std::memory_order_relaxed);
+		slot.snapshot.clear();
+	}
+	latest.store(0, std::memory_order_release);
+}
+
+uint64_t BodyExchange::publish(const BodySnapshot& snapshot)
+{
+	const uint64_t version = latest.load(std::memory_order_relaxed) + 1;
+	Slot& slot = slots[version % Slots];
+
+	// Odd sequence while writing
+	const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.snapshot = snapshot;
+	slot.snapshot.version = version;
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	latest.store(version, std::memory_order_release);
+	return version;
+}
+
+bool BodyExchange::read(BodySnapshot& snapshot, uint64_t since) const
+{
+	// Retry a few times if the writer laps us while copying
+	for (int attempt = 0; attempt < 4; attempt++){
+		const uint64_t version = latest.load(std::memory_order_acquire);
+		if (version == 0 || version <= since){
+			return false;
+		}
+
+		const Slot& slot = slots[version % Slots];
+		const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+		if (before & 1){
+			continue;
+		}
+
+		snapshot = slot.snapshot;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != before || snapshot.version != version){
+			continue;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+// Fixture of a version: every joint and hand derived from it, so a copy mixing two versions shows
+static void fixtureSnapshot(uint64_t version, BodySnapshot& snapshot)
+{
+	snapshot.clear();
+	snapshot.time = static_cast<int64_t>(version) * 333333;
+	const float value = static_cast<float>(version % 100000);
+	for (int slot = 0; slot < SkeletonSlots; slot++){
+		snapshot.joints.x[slot] = snapshot.joints.u[slot] = value;
+		snapshot.joints.y[slot] = snapshot.joints.v[slot] = -value;
+		snapshot.joints.z[slot] = value * .5f;
+		snapshot.joints.state[slot] = static_cast<unsigned char>(version % 3);
+	}
+	for (int body = 0; body < SkeletonBodyCount; body++){
+		snapshot.joints.tracked[body] = (version + body) % 2 == 0;
+		snapshot.hands.left[body] = static_cast<unsigned char>(version % 5);
+		snapshot.hands.right[body] = static_cast<unsigned char>((version + 1) % 5);
+		snapshot.hands.leftConfident[body] = version % 2 == 0;
+	}
+}
+
+// A copy is whole when every field matches the fixture of its version
+static bool wholeSnapshot(const BodySnapshot& snapshot)
+{
+	BodySnapshot expected;
+	fixtureSnapshot(snapshot.version, expected);
+	return snapshot.time == expected.time && sameHands(snapshot.hands, expected.hands)
+		&& std::memcmp(&snapshot.joints, &expected.joints, sizeof(JointBuffer)) == 0;
+}
+
+bool checkBodyExchange(std::ostream& log)
+{
+	BodyExchange exchange;
+	const uint64_t published = 20000;
+	const int readers = std::max(2u, std::min(4u, std::thread::hardware_concurrency()));
+
+	std::atomic<bool> writing(true);
+	std::atomic<int> started(0);
+	std::vector<long long> reads(readers, 0), torn(readers, 0), backwards(readers, 0);
+	std::vector<std::thread> threads;
+	for (int r = 0; r < readers; r++){
+		threads.push_back(std::thread([&, r](){
+			BodySnapshot snapshot;
+			uint64_t last = 0;
+			started++;
+			while (writing || last < exchange.version()){
+				if (!exchange.read(snapshot, last)){
+					continue;
+				}
+				reads[r]++;
+				torn[r] += wholeSnapshot(snapshot) ? 0 : 1;
+				backwards[r] += snapshot.version < last ? 1 : 0;
+				last = snapshot.version;
+			}
+		}));
+	}
+
+	// Far faster than the sensor, with a pause now and then so the readers get through
+	while (started < readers){
+		std::this_thread::yield();
+	}
+	BodySnapshot snapshot;
+	for (uint64_t version = 1; version <= published; version++){
+		fixtureSnapshot(version, snapshot);
+		exchange.publish(snapshot);
+		if (version % 8 == 0){
+			std::this_thread::yield();
+		}
+	}
+	writing = false;
+	for (auto& thread : threads){
+		thread.join();
+	}
+
+	long long totalReads = 0, totalTorn = 0, totalBackwards = 0;
+	for (int r = 0; r < readers; r++){
+		totalReads += reads[r];
+		totalTorn += torn[r];
+		totalBackwards += backwards[r];
+	}
+
+	// Every reader ends on the last snapshot
+	BodySnapshot last;
+	const bool ok = totalTorn == 0 && totalBackwards == 0 && exchange.read(last) && last.version == published && wholeSnapshot(last);
+	log << "body exchange: " << published << " snapshots to " << readers << " readers, " << totalReads << " copies, "
+		<< totalTorn << " torn, " << totalBackwards << " out of order" << (ok ? " ok" : " FAILED") << std::endl;
+	return ok;
+}
@@ -0,0 +1,88 @@
+#ifndef __BODYSNAPSHOT__
+#define __BODYSNAPSHOT__
+
+#include "skeleton.h"
+
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+
+// Hand state, same values as Kinect's HandState
+enum BodyHand
+{
+	BodyHand_Unknown = 0,
+	BodyHand_NotTracked = 1,
+	BodyHand_Open = 2,
+	BodyHand_Closed = 3,
+	BodyHand_Lasso = 4
+};
+
+// Hands of every body
+struct BodyHands
+{
+	// BodyHand of each hand, and whether the sensor is confident of it
+	unsigned char left[SkeletonBodyCount], right[SkeletonBodyCount];
+	bool leftConfident[SkeletonBodyCount], rightConfident[SkeletonBodyCount];
+
+	// Every hand unknown
+	void clear();
+};
+
+// Same states and confidences
+bool sameHands(const BodyHands& a, const BodyHands& b);
+
+// A body frame decoded once at acquisition: what drawing, placement and the UI read, without the sensor.
+// Plain data, copied whole, so it can also be built from fixtures.
+struct BodySnapshot
+{
+	// Set by BodyExchange::publish, increasing, 0 before the first
+	uint64_t version;
+
+	// Body frame time ( 100 ns, Kinect RelativeTime )
+	int64_t time;
+
+	JointBuffer joints;
+	BodyHands hands;
+
+	// No body tracked
+	void clear();
+};
+
+// Hands snapshots from the thread acquiring bodies to any number of readers without locks. Seqlock slots
+// like the shared frames: the single writer never waits, a reader lapped by it while copying copies again.
+class BodyExchange
+{
+private:
+	static const int Slots = 3;
+
+	struct Slot
+	{
+		// Odd while the writer is in the slot
+		std::atomic<uint32_t> sequence;
+		BodySnapshot snapshot;
+	};
+
+	Slot slots[Slots];
+	std::atomic<uint64_t> latest;
+
+public:
+	// Constructor
+	BodyExchange();
+
+	// Publish a copy of snapshot, from one thread only; returns its version
+	uint64_t publish(const BodySnapshot& snapshot);
+
+	// Copy the latest snapshot if its version is past since, false when there is none or the writer kept lapping
+	bool read(BodySnapshot& snapshot, uint64_t since = 0) const;
+
+	uint64_t version() const { return latest.load(std::memory_order_acquire); }
+
+private:
+	BodyExchange(const BodyExchange&);
+	BodyExchange& operator=(const BodyExchange&);
+};
+
+// Publish snapshots as fast as possible while readers check every copy is whole, false if one was torn
+bool checkBodyExchange(std::ostream& log);
+
+#endif // __BODYSNAPSHOT__
@@ -0,0 +1,109 @@
+#include "changes.h"
+
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <algorithm>
+
+// Constructor
+ChangeTracker::ChangeTracker(float pixels, float degrees, float relative)
+	: pixels(pixels), degrees(degrees), relative(relative)
+{
+}
+
+bool ChangeTracker::stage(const char* name, bool run)
+{
+	// A handful of stages, found by name
+	auto counter = std::find_if(counters.begin(), counters.end(), [name](const Counter& c){ return c.name == name; });
+	if (counter == counters.end()){
+		Counter added;
+		added.name = name;
+		added.ran = 0;
+		added.skipped = 0;
+		counters.push_back(added);
+		counter = counters.end() - 1;
+	}
+
+	if (run){
+		counter->ran++;
+	}
+	else {
+		counter->skipped++;
+	}
+	return run;
+}
+
+bool ChangeTracker::poseMoved(const AnchorPose& last, const AnchorPose& pose) const
+{
+	if (last.body != pose.body){
+		return true;
+	}
+
+	const cv::Point2f shift = pose.location - last.location;
+	if (shift.dot(shift) > pixels * pixels){
+		return true;
+	}
+
+	// Angles wrap at 360
+	const float turn = std::abs(std::remainder(pose.angle - last.angle, 360.f));
+	if (turn > degrees){
+		return true;
+	}
+
+	if (std::abs(pose.length - last.length) > relative * std::max(last.length, 1.f) ||
+		std::abs(pose.length3d - last.length3d) > relative * std::max(last.length3d, .01f) ||
+		std::abs(pose.position.z - last.position.z) > relative * std::max(last.position.z, .1f)){
+		return true;
+	}
+
+	// Tilt out of the image plane, for the foreshortened warp
+	const cv::Vec3f& a = last.direction;
+	const cv::Vec3f& b = pose.direction;
+	const float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	return cosine < std::cos(degrees * static_cast<float>(CV_PI) / 180.f);
+}
+
+bool ChangeTracker::jointsMoved(const JointBuffer& last, const JointBuffer& joints) const
+{
+	if (std::memcmp(last.tracked, joints.tracked, sizeof(joints.tracked)) != 0 ||
+		std::memcmp(last.state, joints.state, sizeof(joints.state)) != 0){
+		return true;
+	}
+
+	// Joints are drawn as dots a few pixels wide
+	const float limit = 4 * pixels * pixels;
+	for (int s = 0; s < SkeletonSlots; s++){
+		if (!joints.tracked[s / SkeletonJointCount] || joints.state[s] == JointState_NotTracked){
+			continue;
+		}
+		const float du = joints.u[s] - last.u[s];
+		const float dv = joints.v[s] - last.v[s];
+		if (du * du + dv * dv > limit){
+			return true;
+		}
+	}
+	return false;
+}
+
+void ChangeTracker::report(std::ostream& out) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+
+	out << std::left << std::setw(10) << "stage" << std::right << std::setw(10) << "ran" << std::setw(10) << "skipped" << std::setw(10) << "skip %" << std::endl;
+	for (const auto& counter : counters){
+		const unsigned long long total = counter.ran + counter.skipped;
+		const double percent = total > 0 ? 100. * counter.skipped / total : 0.;
+		out << std::left << std::setw(10) << counter.name << std::right << std::setw(10) << counter.ran << std::setw(10) << counter.skipped
+			<< std::setw(10) << percent << std::endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void ChangeTracker::reset()
+{
+	counters.clear();
+}
@@ -0,0 +1,46 @@
+#ifndef __CHANGES__
+#define __CHANGES__
+
+#include "skeleton.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Decides whether the inputs of a stage changed enough to run it again, and counts the stages skipped
+class ChangeTracker
+{
+private:
+	struct Counter
+	{
+		std::string name;
+		unsigned long long ran;
+		unsigned long long skipped;
+	};
+
+	std::vector<Counter> counters;
+
+	// Smallest changes that are redrawn: color space pixels, degrees and relative length or depth
+	float pixels;
+	float degrees;
+	float relative;
+
+public:
+	// Constructor ( thresholds )
+	explicit ChangeTracker(float pixels = .5f, float degrees = .25f, float relative = .005f);
+
+	// Count a stage as run or skipped, returns run
+	bool stage(const char* name, bool run);
+
+	// True when a tattoo placed at the last pose would visibly differ at the new one
+	bool poseMoved(const AnchorPose& last, const AnchorPose& pose) const;
+
+	// True when a tracked joint moved more than two thresholds in the color image, or started or stopped being tracked
+	bool jointsMoved(const JointBuffer& last, const JointBuffer& joints) const;
+
+	// Runs and skips per stage
+	void report(std::ostream& out) const;
+	void reset();
+};
+
+#endif // __CHANGES__
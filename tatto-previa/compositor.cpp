@@ -0,0 +1,545 @@
+#include "compositor.h"
+
+// Universal intrinsics, in their own module before OpenCV 3.2
+#if ( CV_MAJOR_VERSION > 3 || ( CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2 ) )
+#include <opencv2/core/hal/intrin.hpp>
+#else
+#include <opencv2/hal/intrin.hpp>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+// Constructor
+Compositor::Compositor(int bucketRows)
+	: bucketRows(std::max(1, bucketRows))
+{
+}
+
+void Compositor::composite(cv::Mat& dst, const std::vector<Layer>& layers)
+{
+	if (dst.empty() || layers.empty()){
+		return;
+	}
+
+	// Clip every layer to the destination
+	placements.clear();
+	const cv::Rect frame(0, 0, dst.cols, dst.rows);
+	for (int i = 0; i < static_cast<int>(layers.size()); i++){
+		const Layer& layer = layers[i];
+		if (layer.image == nullptr || layer.image->empty() || layer.image->channels() != 4 || layer.opacity <= 0){
+			continue;
+		}
+
+		const cv::Point topLeft(layer.location.x - layer.image->cols / 2, layer.location.y - layer.image->rows / 2);
+		const cv::Rect area = cv::Rect(topLeft, layer.image->size()) & frame;
+		if (area.area() == 0){
+			continue;
+		}
+
+		Placement placement;
+		placement.layer = i;
+		placement.area = area;
+		placement.offset = area.tl() - topLeft;
+		// opacity scaled so that alpha 255 at opacity 1 gives a weight of 256
+		placement.weight = static_cast<int>(std::min(1., layer.opacity) * 257 + 0.5);
+		placement.shading = static_cast<int>(std::max(0., std::min(1., layer.shading)) * 256 + 0.5);
+		placement.radius = 0;
+		placement.inverseMean = 0;
+		if (layer.mask != nullptr && !layer.mask->empty() && layer.mask->type() == CV_8U){
+			const cv::Rect masked = cv::Rect(layer.maskOrigin, layer.mask->size()) & area;
+			placement.masked = cv::Rect(masked.x - area.x, masked.y - area.y, masked.width, masked.height);
+		}
+		placements.push_back(placement);
+	}
+
+	if (placements.empty()){
+		return;
+	}
+
+	// Shading reads the frame as it was before any layer
+	if (integrals.size() < placements.size()){
+		integrals.resize(placements.size());
+	}
+	for (int p = 0; p < static_cast<int>(placements.size()); p++){
+		if (placements[p].shading > 0){
+			prepareShading(dst, placements[p], integrals[p]);
+		}
+	}
+
+	// Bucket layers by the destination rows they cover
+	const int bucketCount = (dst.rows + bucketRows - 1) / bucketRows;
+	if (static_cast<int>(buckets.size()) < bucketCount){
+		buckets.resize(bucketCount);
+	}
+	for (auto& bucket : buckets){
+		bucket.clear();
+	}
+	for (int p = 0; p < static_cast<int>(placements.size()); p++){
+		const cv::Rect& area = placements[p].area;
+		const int first = area.y / bucketRows;
+		const int last = (area.y + area.height - 1) / bucketRows;
+		for (int b = first; b <= last; b++){
+			buckets[b].push_back(p);
+		}
+	}
+
+	// Each row is visited once, all its layers are blended while it is in cache
+#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < bucketCount; b++){
+		const std::vector<int>& bucket = buckets[b];
+		if (bucket.empty()){
+			continue;
+		}
+
+		const int end = std::min(dst.rows, (b + 1) * bucketRows);
+		for (int y = b * bucketRows; y < end; y++){
+			blendRow(dst, layers, bucket, y);
+		}
+	}
+}
+
+// Luminance as the shading reads it, ( 29 B + 150 G + 77 R ) / 256 rounded: close to cv::COLOR_BGR2GRAY and exact in 16 bits
+static inline int luminance(const uchar* px)
+{
+	return (px[0] * 29 + px[1] * 150 + px[2] * 77 + 128) >> 8;
+}
+
+// Integral image of the luminance of a BGR or BGRA image in one pass, 16 pixels of luminance at a time and no gray image
+static void luminanceIntegral(const cv::Mat& image, cv::Mat& integral)
+{
+	const int channels = image.channels();
+	const int cols = image.cols;
+	integral.create(image.rows + 1, cols + 1, CV_32S);
+	std::fill(integral.ptr<int>(0), integral.ptr<int>(0) + cols + 1, 0);
+
+	for (int y = 0; y < image.rows; y++){
+		const uchar* px = image.ptr<uchar>(y);
+		const int* above = integral.ptr<int>(y) + 1;
+		int* row = integral.ptr<int>(y + 1);
+		*row++ = 0;
+
+		int run = 0;
+		int x = 0;
+#if CV_SIMD128
+		const cv::v_uint16x8 vBlue = cv::v_setall_u16(29), vGreen = cv::v_setall_u16(150), vRed = cv::v_setall_u16(77), vHalf = cv::v_setall_u16(128);
+		for (; x + 16 <= cols; x += 16){
+			cv::v_uint8x16 b, g, r, a;
+			if (channels == 3){
+				cv::v_load_deinterleave(px + x * 3, b, g, r);
+			}
+			else {
+				cv::v_load_deinterleave(px + x * 4, b, g, r, a);
+			}
+
+			cv::v_uint16x8 blue[2], green[2], red[2];
+			cv::v_expand(b, blue[0], blue[1]);
+			cv::v_expand(g, green[0], green[1]);
+			cv::v_expand(r, red[0], red[1]);
+			uchar luma[16];
+			cv::v_store(luma, cv::v_pack((blue[0] * vBlue + green[0] * vGreen + red[0] * vRed + vHalf) >> 8, (blue[1] * vBlue + green[1] * vGreen + red[1] * vRed + vHalf) >> 8));
+			for (int i = 0; i < 16; i++){
+				run += luma[i];
+				row[x + i] = above[x + i] + run;
+			}
+		}
+#endif
+
+		for (; x < cols; x++){
+			run += luminance(px + x * channels);
+			row[x] = above[x] + run;
+		}
+	}
+}
+
+void Compositor::prepareShading(const cv::Mat& dst, Placement& placement, cv::Mat& integral)
+{
+	// Box about a sixteenth of the tattoo, so skin shading shows but pores do not
+	const cv::Rect& area = placement.area;
+	placement.radius = std::max(2, std::min(area.width, area.height) / 16);
+
+	// Only the area and its border are read
+	const cv::Rect box = cv::Rect(area.x - placement.radius, area.y - placement.radius, area.width + placement.radius * 2, area.height + placement.radius * 2) & cv::Rect(0, 0, dst.cols, dst.rows);
+	luminanceIntegral(dst(box), integral);
+
+	const int total = integral.at<int>(box.height, box.width);
+	placement.inverseMean = total > 0 ? static_cast<float>(box.area()) / total : 0.f;
+	placement.lit = box;
+}
+
+inline void Compositor::blendRow(cv::Mat& dst, const std::vector<Layer>& layers, const std::vector<int>& bucket, int y) const
+{
+	const int dstChannels = dst.channels();
+	uchar* dstRow = dst.ptr<uchar>(y);
+
+	// Placements are in layer order, so later layers end on top
+	for (const int p : bucket){
+		const Placement& placement = placements[p];
+		const cv::Rect& area = placement.area;
+		if (y < area.y || y >= area.y + area.height){
+			continue;
+		}
+
+		const Layer& layer = layers[placement.layer];
+		const TattooSpans* spans = layer.spans;
+		if (spans == nullptr || spans->rows() != layer.image->rows || spans->cols() != layer.image->cols){
+			blendMaskedSegment(p, layer, dstRow, dstChannels, y, 0, area.width, false);
+			continue;
+		}
+
+		// Only the visible spans of the row, clipped to the area
+		int count;
+		const TattooSpan* span = spans->row(y - area.y + placement.offset.y, count);
+		for (int i = 0; i < count; i++, span++){
+			const int x0 = std::max(span->x - placement.offset.x, 0);
+			const int x1 = std::min(span->x + span->length - placement.offset.x, area.width);
+			if (x0 < x1){
+				blendMaskedSegment(p, layer, dstRow, dstChannels, y, x0, x1, span->opaque);
+			}
+		}
+	}
+}
+
+inline void Compositor::blendMaskedSegment(int p, const Layer& layer, uchar* dstRow, int dstChannels, int y, int x0, int x1, bool opaque) const
+{
+	const Placement& placement = placements[p];
+	const cv::Rect& masked = placement.masked;
+	const int row = y - placement.area.y;
+	const int m0 = std::max(x0, masked.x);
+	const int m1 = std::min(x1, masked.x + masked.width);
+	if (row < masked.y || row >= masked.y + masked.height || m0 >= m1){
+		blendSegment(p, *layer.image, dstRow, dstChannels, y, x0, x1, opaque, nullptr);
+		return;
+	}
+
+	// Columns before and after the mask keep the fast paths
+	const uchar* maskPx = layer.mask->ptr<uchar>(y - layer.maskOrigin.y) + (placement.area.x + m0 - layer.maskOrigin.x);
+	if (x0 < m0){
+		blendSegment(p, *layer.image, dstRow, dstChannels, y, x0, m0, opaque, nullptr);
+	}
+	blendSegment(p, *layer.image, dstRow, dstChannels, y, m0, m1, opaque, maskPx);
+	if (m1 < x1){
+		blendSegment(p, *layer.image, dstRow, dstChannels, y, m1, x1, opaque, nullptr);
+	}
+}
+
+#if CV_SIMD128
+template <int Channels>
+static inline void loadPixels(const uchar* px, cv::v_uint8x16* channels);
+
+template <>
+inline void loadPixels<3>(const uchar* px, cv::v_uint8x16* channels)
+{
+	cv::v_load_deinterleave(px, channels[0], channels[1], channels[2]);
+}
+
+template <>
+inline void loadPixels<4>(const uchar* px, cv::v_uint8x16* channels)
+{
+	cv::v_load_deinterleave(px, channels[0], channels[1], channels[2], channels[3]);
+}
+
+template <int Channels>
+static inline void storePixels(uchar* px, const cv::v_uint8x16* channels);
+
+template <>
+inline void storePixels<3>(uchar* px, const cv::v_uint8x16* channels)
+{
+	cv::v_store_interleave(px, channels[0], channels[1], channels[2]);
+}
+
+template <>
+inline void storePixels<4>(uchar* px, const cv::v_uint8x16* channels)
+{
+	cv::v_store_interleave(px, channels[0], channels[1], channels[2], channels[3]);
+}
+#endif
+
+// Blend count pixels, Channels in the destination: each channel moves toward the ink by w / 256, w the ink alpha
+// ( under the mask, 255 counting as 256 ) times weight, both rounded. With gains ( 1/256 ) the ink is shaded by them first.
+// 16 pixels at a time in 16 bit lanes, every product fits, rounded exactly as the scalar tail.
+template <int Channels>
+static inline void blendPixels(const uchar* srcPx, uchar* dstPx, const uchar* maskPx, int weight, const int* gains, int count)
+{
+	int i = 0;
+
+#if CV_SIMD128
+	const cv::v_uint16x8 vWeight = cv::v_setall_u16(static_cast<ushort>(weight)), vOne = cv::v_setall_u16(1);
+	const cv::v_uint16x8 vHalf = cv::v_setall_u16(128), vFull = cv::v_setall_u16(256);
+	const cv::v_int16x8 vMax = cv::v_setall_s16(255);
+	const cv::v_uint8x16 vZero = cv::v_setzero_u8();
+	for (; i + 16 <= count; i += 16){
+		cv::v_uint8x16 src[4], dst[4];
+		cv::v_load_deinterleave(srcPx + i * 4, src[0], src[1], src[2], src[3]);
+		if (!cv::v_check_any(src[3] > vZero)){
+			continue;
+		}
+		loadPixels<Channels>(dstPx + i * Channels, dst);
+
+		cv::v_uint16x8 w[2];
+		cv::v_expand(src[3], w[0], w[1]);
+		if (maskPx != nullptr){
+			cv::v_uint16x8 m[2];
+			cv::v_expand(cv::v_load(maskPx + i), m[0], m[1]);
+			for (int h = 0; h < 2; h++){
+				w[h] = (w[h] * (m[h] + (m[h] >> 7)) + vHalf) >> 8;
+			}
+		}
+		// Rounded without the carry out of 16 bits, 255 at weight 257 is 256
+		for (int h = 0; h < 2; h++){
+			const cv::v_uint16x8 product = w[h] * vWeight;
+			w[h] = (product >> 8) + ((product >> 7) & vOne);
+		}
+
+		cv::v_uint16x8 gain[2];
+		if (gains != nullptr){
+			for (int h = 0; h < 2; h++){
+				gain[h] = cv::v_reinterpret_as_u16(cv::v_pack(cv::v_load(gains + i + h * 8), cv::v_load(gains + i + h * 8 + 4)));
+			}
+		}
+
+		for (int c = 0; c < 3; c++){
+			cv::v_uint16x8 s[2], d[2];
+			cv::v_expand(src[c], s[0], s[1]);
+			cv::v_expand(dst[c], d[0], d[1]);
+			for (int h = 0; h < 2; h++){
+				// Shaded ink may pass 16 bits before the shift
+				if (gains != nullptr){
+					cv::v_uint32x4 low, high;
+					cv::v_mul_expand(s[h], gain[h], low, high);
+					const cv::v_int16x8 shaded = cv::v_pack(cv::v_reinterpret_as_s32(low >> 8), cv::v_reinterpret_as_s32(high >> 8));
+					s[h] = cv::v_reinterpret_as_u16(cv::v_min(shaded, vMax));
+				}
+				d[h] = (s[h] * w[h] + d[h] * (vFull - w[h]) + vHalf) >> 8;
+			}
+			dst[c] = cv::v_pack(d[0], d[1]);
+		}
+		storePixels<Channels>(dstPx + i * Channels, dst);
+	}
+#endif
+
+	srcPx += i * 4;
+	dstPx += i * Channels;
+	for (; i < count; i++, srcPx += 4, dstPx += Channels){
+		int a = srcPx[3];
+		if (maskPx != nullptr){
+			const int m = maskPx[i];
+			a = (a * (m + (m >> 7)) + 128) >> 8;
+		}
+		const int w = (a * weight + 128) >> 8;
+		if (w == 0){
+			continue;
+		}
+
+		for (int c = 0; c < 3; c++){
+			const int s = gains != nullptr ? std::min(255, (srcPx[c] * gains[i]) >> 8) : srcPx[c];
+			dstPx[c] = static_cast<uchar>((s * w + dstPx[c] * (256 - w) + 128) >> 8);
+		}
+	}
+}
+
+inline void Compositor::blendSegment(int p, const cv::Mat& image, uchar* dstRow, int dstChannels, int y, int x0, int x1, bool opaque, const uchar* maskPx) const
+{
+	const Placement& placement = placements[p];
+	const cv::Rect& area = placement.area;
+	const uchar* srcPx = image.ptr<uchar>(y - area.y + placement.offset.y) + (placement.offset.x + x0) * 4;
+	uchar* dstPx = dstRow + (area.x + x0) * dstChannels;
+	const int weight = placement.weight;
+
+	if (placement.shading > 0 && placement.inverseMean > 0){
+		blendShadedSegment(p, srcPx, dstPx, dstChannels, y, x0, x1, maskPx);
+		return;
+	}
+
+	// Opaque ink at full opacity replaces the frame
+	if (opaque && weight == 257 && maskPx == nullptr){
+		for (int x = x0; x < x1; x++, srcPx += 4, dstPx += dstChannels){
+			dstPx[0] = srcPx[0];
+			dstPx[1] = srcPx[1];
+			dstPx[2] = srcPx[2];
+		}
+		return;
+	}
+
+	// Every pixel has its own weight, ink alpha times opacity and the mask
+	if (dstChannels == 3){
+		blendPixels<3>(srcPx, dstPx, maskPx, weight, nullptr, x1 - x0);
+	}
+	else {
+		blendPixels<4>(srcPx, dstPx, maskPx, weight, nullptr, x1 - x0);
+	}
+}
+
+// Ink gain ( 1/256 ) of count columns whose boxes are whole, width columns from left on the integral rows.
+// Gain is 256 + shading * ( local / mean - 1 ), folded into sum * scale + base.
+static void interiorGains(const int* top, const int* bottom, int left, int width, int count, float scale, float base, int* gains)
+{
+	const int* topLeft = top + left;
+	const int* topRight = topLeft + width;
+	const int* bottomLeft = bottom + left;
+	const int* bottomRight = bottomLeft + width;
+	int i = 0;
+
+#if CV_SIMD128
+	const cv::v_float32x4 vScale = cv::v_setall_f32(scale), vBase = cv::v_setall_f32(base);
+	const cv::v_float32x4 vLow = cv::v_setall_f32(0.f), vHigh = cv::v_setall_f32(512.f);
+	for (; i + 4 <= count; i += 4){
+		const cv::v_int32x4 sum = cv::v_load(bottomRight + i) - cv::v_load(bottomLeft + i) - cv::v_load(topRight + i) + cv::v_load(topLeft + i);
+		const cv::v_float32x4 gain = cv::v_min(cv::v_max(cv::v_cvt_f32(sum) * vScale + vBase, vLow), vHigh);
+		cv::v_store(gains + i, cv::v_trunc(gain));
+	}
+#endif
+
+	for (; i < count; i++){
+		const int sum = bottomRight[i] - bottomLeft[i] - topRight[i] + topLeft[i];
+		gains[i] = static_cast<int>(std::max(0.f, std::min(512.f, sum * scale + base)));
+	}
+}
+
+inline void Compositor::blendShadedSegment(int p, const uchar* srcPx, uchar* dstPx, int dstChannels, int y, int x0, int x1, const uchar* maskPx) const
+{
+	const Placement& placement = placements[p];
+	const cv::Mat& integral = integrals[p];
+	const cv::Rect& area = placement.area;
+	const cv::Rect& lit = placement.lit;
+	const int r = placement.radius;
+
+	// Rows of the box around y, clamped to the integral image
+	const int y0 = std::max(y - r, lit.y) - lit.y;
+	const int y1 = std::min(y + r + 1, lit.y + lit.height) - lit.y;
+	const int* top = integral.ptr<int>(y0);
+	const int* bottom = integral.ptr<int>(y1);
+	const float rowScale = placement.inverseMean / (y1 - y0);
+	const float shading = static_cast<float>(placement.shading);
+	const int weight = placement.weight;
+
+	// Columns whose box is whole share one reciprocal of its width, only the few near the edges of lit divide
+	const int width = 2 * r + 1;
+	const int inner0 = std::min(x1, std::max(x0, lit.x + r - area.x));
+	const int inner1 = std::max(inner0, std::min(x1, lit.x + lit.width - r - area.x));
+	const float interiorScale = rowScale / width * shading;
+	const float base = 256.f - shading;
+
+	// Local brightness over the mean brightness, O(1) from the integral image
+	int gains[64];
+	auto edgeGains = [&](int from, int to, int* gain){
+		for (int x = from; x < to; x++, gain++){
+			const int left = std::max(area.x + x - r, lit.x) - lit.x;
+			const int right = std::min(area.x + x + r + 1, lit.x + lit.width) - lit.x;
+			const int sum = bottom[right] - bottom[left] - top[right] + top[left];
+			*gain = static_cast<int>(std::max(0.f, std::min(512.f, sum * (rowScale / (right - left) * shading) + base)));
+		}
+	};
+
+	// Gains of a chunk of columns first, then the blend of the chunk
+	for (int c0 = x0; c0 < x1; c0 += 64){
+		const int c1 = std::min(x1, c0 + 64);
+		const int i0 = std::min(c1, std::max(c0, inner0));
+		const int i1 = std::max(i0, std::min(c1, inner1));
+		edgeGains(c0, i0, gains);
+		interiorGains(top, bottom, area.x + i0 - r - lit.x, width, i1 - i0, interiorScale, base, gains + (i0 - c0));
+		edgeGains(i1, c1, gains + (i1 - c0));
+
+		// Ink darker in shadows and brighter in highlights
+		if (dstChannels == 3){
+			blendPixels<3>(srcPx, dstPx, maskPx == nullptr ? nullptr : maskPx + (c0 - x0), weight, gains, c1 - c0);
+		}
+		else {
+			blendPixels<4>(srcPx, dstPx, maskPx == nullptr ? nullptr : maskPx + (c0 - x0), weight, gains, c1 - c0);
+		}
+		srcPx += (c1 - c0) * 4;
+		dstPx += (c1 - c0) * dstChannels;
+	}
+}
+
+bool checkShading(std::ostream& log)
+{
+	// Full HD frame in gradients, a 480 px tattoo with a soft edge in the middle of it
+	cv::Mat frame(1080, 1920, CV_8UC3);
+	for (int y = 0; y < frame.rows; y++){
+		uchar* px = frame.ptr<uchar>(y);
+		for (int x = 0; x < frame.cols; x++, px += 3){
+			px[0] = static_cast<uchar>(20 + x / 8);
+			px[1] = static_cast<uchar>(20 + (x + y) / 12);
+			px[2] = static_cast<uchar>(20 + y / 6);
+		}
+	}
+	cv::Mat tattoo(480, 480, CV_8UC4);
+	for (int y = 0; y < tattoo.rows; y++){
+		uchar* px = tattoo.ptr<uchar>(y);
+		for (int x = 0; x < tattoo.cols; x++, px += 4){
+			const int distance = static_cast<int>(std::sqrt(static_cast<double>((x - 240) * (x - 240) + (y - 240) * (y - 240))));
+			px[0] = static_cast<uchar>(x / 2);
+			px[1] = static_cast<uchar>(60 + y / 4);
+			px[2] = static_cast<uchar>((x ^ y) & 255);
+			px[3] = static_cast<uchar>(std::max(0, std::min(255, (236 - distance) * 8)));
+		}
+	}
+
+	std::vector<Layer> layers(1);
+	layers[0].image = &tattoo;
+	layers[0].location = cv::Point(frame.cols / 2, frame.rows / 2);
+	layers[0].opacity = .85;
+	layers[0].shading = .8;
+
+	// Reference: the box mean and divide of every pixel, on the frame before the blend
+	const cv::Rect area(layers[0].location.x - tattoo.cols / 2, layers[0].location.y - tattoo.rows / 2, tattoo.cols, tattoo.rows);
+	const int r = std::max(2, std::min(area.width, area.height) / 16);
+	const cv::Rect lit = cv::Rect(area.x - r, area.y - r, area.width + r * 2, area.height + r * 2) & cv::Rect(0, 0, frame.cols, frame.rows);
+	cv::Mat gray(lit.height, lit.width, CV_8U), integral;
+	for (int y = 0; y < lit.height; y++){
+		const uchar* px = frame.ptr<uchar>(lit.y + y) + lit.x * 3;
+		uchar* luma = gray.ptr<uchar>(y);
+		for (int x = 0; x < lit.width; x++, px += 3){
+			luma[x] = static_cast<uchar>(luminance(px));
+		}
+	}
+	cv::integral(gray, integral, CV_32S);
+	const float inverseMean = static_cast<float>(lit.area()) / integral.at<int>(lit.height, lit.width);
+	const int weight = static_cast<int>(layers[0].opacity * 257 + .5);
+	const float shading = static_cast<float>(static_cast<int>(layers[0].shading * 256 + .5));
+
+	Compositor compositor;
+	cv::Mat blended = frame.clone();
+	compositor.composite(blended, layers);
+
+	int worst = 0;
+	for (int y = 0; y < area.height; y++){
+		const uchar* src = tattoo.ptr<uchar>(y);
+		const uchar* before = frame.ptr<uchar>(area.y + y) + area.x * 3;
+		const uchar* after = blended.ptr<uchar>(area.y + y) + area.x * 3;
+		const int y0 = std::max(area.y + y - r, lit.y) - lit.y;
+		const int y1 = std::min(area.y + y + r + 1, lit.y + lit.height) - lit.y;
+		for (int x = 0; x < area.width; x++){
+			const int left = std::max(area.x + x - r, lit.x) - lit.x;
+			const int right = std::min(area.x + x + r + 1, lit.x + lit.width) - lit.x;
+			const int sum = integral.at<int>(y1, right) - integral.at<int>(y1, left) - integral.at<int>(y0, right) + integral.at<int>(y0, left);
+			const float ratio = sum * inverseMean / ((y1 - y0) * (right - left));
+			const int gain = std::max(0, std::min(512, static_cast<int>(256.f + shading * (ratio - 1.f))));
+			const int w = (src[x * 4 + 3] * weight + 128) >> 8;
+			for (int c = 0; c < 3; c++){
+				const int s = std::min(255, (src[x * 4 + c] * gain) >> 8);
+				const int d = before[x * 3 + c];
+				const int expected = (s * w + d * (256 - w) + 128) >> 8;
+				worst = std::max(worst, std::abs(expected - after[x * 3 + c]));
+			}
+		}
+	}
+
+	// Best of several runs over the same frame, shading included
+	double ms = std::numeric_limits<double>::infinity();
+	for (int i = 0; i < 20; i++){
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		compositor.composite(blended, layers);
+		ms = std::min(ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	// Rounding of the hoisted reciprocal may move the gain by one step
+	const bool ok = worst <= 1 && ms < 1.;
+	log << "shading: " << tattoo.cols << " x " << tattoo.rows << " over " << frame.cols << " x " << frame.rows << " in " << ms << " ms ( budget 1 ms ), "
+		<< "largest difference " << worst << (ok ? " ok" : " FAILED") << std::endl;
+	return ok;
+}
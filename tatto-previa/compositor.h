@@ -0,0 +1,96 @@
+#ifndef __COMPOSITOR__
+#define __COMPOSITOR__
+
+#include "spans.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <ostream>
+#include <vector>
+
+// A transformed BGRA image to be blended over the frame
+struct Layer
+{
+	// BGRA image, alpha in the 4th channel
+	const cv::Mat* image;
+
+	// Destination of the image center
+	cv::Point location;
+
+	// Global opacity in [0, 1]
+	double opacity;
+
+	// How much the ink follows the local brightness of the frame under it, 0 for flat ink
+	double shading;
+
+	// Visible spans of image, null to scan every pixel
+	const TattooSpans* spans;
+
+	// CV_8U coverage in frame coordinates from maskOrigin ( e.g. skin ), multiplied into the alpha.
+	// Pixels outside it are not masked, null for none.
+	const cv::Mat* mask;
+	cv::Point maskOrigin;
+
+	Layer() : image(nullptr), opacity(1), shading(0), spans(nullptr), mask(nullptr) {}
+};
+
+// Blends any number of layers over a frame in one sweep over the covered rows
+class Compositor
+{
+private:
+	// A layer clipped to the destination
+	struct Placement
+	{
+		int layer;
+		cv::Rect area;
+		cv::Point offset;
+		int weight;
+
+		// Shading: strength ( 1/256 ), box radius, frame area of the integral image and 1 / its mean luminance
+		int shading;
+		int radius;
+		cv::Rect lit;
+		float inverseMean;
+
+		// Part of the area under the mask, relative to the area, empty without one
+		cv::Rect masked;
+	};
+
+	// Rows per bucket
+	int bucketRows;
+
+	// Scratch storage reused between frames
+	std::vector<Placement> placements;
+	std::vector<std::vector<int>> buckets;
+
+	// Integral image of the luminance around each shaded placement, indexed by placement
+	std::vector<cv::Mat> integrals;
+
+public:
+	// Constructor
+	explicit Compositor(int bucketRows = 16);
+
+	// Blend the layers over dst ( BGR or BGRA ), later layers on top
+	void composite(cv::Mat& dst, const std::vector<Layer>& layers);
+
+private:
+	// Integral image of the luminance under a placement, before any layer is blended
+	void prepareShading(const cv::Mat& dst, Placement& placement, cv::Mat& integral);
+
+	// Blend every layer of a bucket that covers row y
+	inline void blendRow(cv::Mat& dst, const std::vector<Layer>& layers, const std::vector<int>& bucket, int y) const;
+
+	// Blend columns [x0, x1) of the area of a placement on row y, split where the mask starts and ends
+	inline void blendMaskedSegment(int p, const Layer& layer, uchar* dstRow, int dstChannels, int y, int x0, int x1, bool opaque) const;
+
+	// Same, for columns entirely under the mask ( maskPx at x0 ) or entirely outside it ( null )
+	inline void blendSegment(int p, const cv::Mat& image, uchar* dstRow, int dstChannels, int y, int x0, int x1, bool opaque, const uchar* maskPx) const;
+
+	// Same, with the ink shaded by the local brightness
+	inline void blendShadedSegment(int p, const uchar* srcPx, uchar* dstPx, int dstChannels, int y, int x0, int x1, const uchar* maskPx) const;
+};
+
+// Shade and blend a tattoo over a Full HD frame, false if it strays from the per pixel box formula or takes over 1 ms
+bool checkShading(std::ostream& log);
+
+#endif // __COMPOSITOR__
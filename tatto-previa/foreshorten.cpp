@@ -0,0 +1,239 @@
+#include "foreshorten.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+cv::Matx33d rotationHomography(double w, double h, double alpha, double beta, double gamma, double dx, double dy, double dz, double fx, double fy)
+{
+	const double ca = std::cos(alpha), sa = std::sin(alpha);
+	const double cb = std::cos(beta), sb = std::sin(beta);
+	const double cg = std::cos(gamma), sg = std::sin(gamma);
+
+	// Projection 2D -> 3D, the image on the z = 0 plane centered at the origin
+	const cv::Matx43d A1(
+		1, 0, -w / 2,
+		0, 1, -h / 2,
+		0, 0, 0,
+		0, 0, 1);
+
+	// Rotation and translation
+	const cv::Matx33d RX(
+		1, 0, 0,
+		0, ca, -sa,
+		0, sa, ca);
+	const cv::Matx33d RY(
+		cb, 0, -sb,
+		0, 1, 0,
+		sb, 0, cb);
+	const cv::Matx33d RZ(
+		cg, -sg, 0,
+		sg, cg, 0,
+		0, 0, 1);
+	const cv::Matx33d R = RX * RY * RZ;
+
+	const cv::Matx44d TR(
+		R(0, 0), R(0, 1), R(0, 2), dx,
+		R(1, 0), R(1, 1), R(1, 2), dy,
+		R(2, 0), R(2, 1), R(2, 2), dz,
+		0, 0, 0, 1);
+
+	// 3D -> 2D
+	const cv::Matx34d A2(
+		fx, 0, w / 2, 0,
+		0, fy, h / 2, 0,
+		0, 0, 1, 0);
+
+	return A2 * (TR * A1);
+}
+
+cv::Mat rotationChain(double w, double h, double alpha, double beta, double gamma, double dx, double dy, double dz, double fx, double fy)
+{
+	cv::Mat A1 = (cv::Mat_<double>(4, 3) <<
+		1, 0, -w / 2,
+		0, 1, -h / 2,
+		0, 0, 0,
+		0, 0, 1);
+
+	cv::Mat RX = (cv::Mat_<double>(4, 4) <<
+		1, 0, 0, 0,
+		0, cos(alpha), -sin(alpha), 0,
+		0, sin(alpha), cos(alpha), 0,
+		0, 0, 0, 1);
+	cv::Mat RY = (cv::Mat_<double>(4, 4) <<
+		cos(beta), 0, -sin(beta), 0,
+		0, 1, 0, 0,
+		sin(beta), 0, cos(beta), 0,
+		0, 0, 0, 1);
+	cv::Mat RZ = (cv::Mat_<double>(4, 4) <<
+		cos(gamma), -sin(gamma), 0, 0,
+		sin(gamma), cos(gamma), 0, 0,
+		0, 0, 1, 0,
+		0, 0, 0, 1);
+	cv::Mat R = RX * RY * RZ;
+
+	cv::Mat T = (cv::Mat_<double>(4, 4) <<
+		1, 0, 0, dx,
+		0, 1, 0, dy,
+		0, 0, 1, dz,
+		0, 0, 0, 1);
+
+	cv::Mat A2 = (cv::Mat_<double>(3, 4) <<
+		fx, 0, w / 2, 0,
+		0, fy, h / 2, 0,
+		0, 0, 1, 0);
+
+	return A2 * (T * (R * A1));
+}
+
+double boneTilt(const cv::Vec3f& direction)
+{
+	return std::asin(std::max(-1.f, std::min(1.f, direction[2])));
+}
+
+cv::Matx33d foreshortenHomography(const cv::Size& size, double tilt, double focal, double angle, double scale)
+{
+	// Camera at focal from the tattoo, so the untilted tattoo keeps its size
+	const cv::Matx33d H = rotationHomography(size.width, size.height, tilt, 0, 0, 0, 0, focal, focal, focal);
+
+	// Rotation and scale about the center, as in warpTattoo
+	const cv::Point2f center = cv::Point2f(round(size.width / 2), round(size.height / 2));
+	const double a = angle * CV_PI / 180.;
+	const double c = std::cos(a) * scale, s = std::sin(a) * scale;
+	const cv::Matx33d M(
+		c, s, (1 - c) * center.x - s * center.y,
+		-s, c, s * center.x + (1 - c) * center.y,
+		0, 0, 1);
+
+	return M * H;
+}
+
+bool boundingBoxHomography(const cv::Size& size, const cv::Matx33d& homography, cv::Matx33d& shifted, cv::Size& box, cv::Point2f& center)
+{
+	const double w = size.width, h = size.height;
+	const cv::Vec3d corners[4] = { cv::Vec3d(0, 0, 1), cv::Vec3d(w, 0, 1), cv::Vec3d(w, h, 1), cv::Vec3d(0, h, 1) };
+
+	double minX = DBL_MAX, minY = DBL_MAX, maxX = -DBL_MAX, maxY = -DBL_MAX;
+	for (int i = 0; i < 4; i++){
+		const cv::Vec3d p = homography * corners[i];
+
+		// A corner behind the camera has no bounding box
+		if (p[2] <= 1e-9){
+			center = cv::Point2f(0, 0);
+			return false;
+		}
+
+		minX = std::min(minX, p[0] / p[2]);
+		minY = std::min(minY, p[1] / p[2]);
+		maxX = std::max(maxX, p[0] / p[2]);
+		maxY = std::max(maxY, p[1] / p[2]);
+	}
+
+	const int x0 = cvFloor(minX), y0 = cvFloor(minY);
+	box = cv::Size(std::max(1, cvCeil(maxX) - x0), std::max(1, cvCeil(maxY) - y0));
+
+	// Move the box to the origin, only its pixels are sampled
+	const cv::Matx33d shift(
+		1, 0, -x0,
+		0, 1, -y0,
+		0, 0, 1);
+	shifted = shift * homography;
+
+	const cv::Vec3d c = shifted * cv::Vec3d(round(w / 2), round(h / 2), 1);
+	center = cv::Point2f(static_cast<float>(c[0] / c[2]), static_cast<float>(c[1] / c[2]));
+	return true;
+}
+
+void warpBoundingBox(const cv::Mat& input, const cv::Matx33d& homography, int interpolation, cv::Mat& output, cv::Point2f& center)
+{
+	cv::Matx33d H;
+	cv::Size box;
+	if (!boundingBoxHomography(input.size(), homography, H, box, center)){
+		output.release();
+		return;
+	}
+
+	cv::warpPerspective(input, output, cv::Mat(H), box, interpolation);
+}
+
+bool checkForeshortening(std::ostream& log)
+{
+	// Textured BGRA test tattoo, opaque disc over a transparent background
+	cv::Mat input(256, 256, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+	for (int y = 0; y < input.rows; y++){
+		for (int x = 0; x < input.cols; x++){
+			const int dx = x - 128, dy = y - 128;
+			if (dx * dx + dy * dy < 100 * 100){
+				input.at<cv::Vec4b>(y, x) = cv::Vec4b(static_cast<uchar>(x), static_cast<uchar>(y), static_cast<uchar>((x ^ y) & 255), 255);
+			}
+		}
+	}
+
+	bool ok = true;
+	double worstMatrix = 0, worstPixel = 0;
+
+	for (int tiltDeg = -60; tiltDeg <= 60; tiltDeg += 15){
+		for (int angle = -150; angle <= 180; angle += 30){
+			const double tilt = tiltDeg * CV_PI / 180.;
+			const double scale = .75;
+			const double focal = 800;
+
+			// Matrices: the fixed-size chain against the cv::Mat chain
+			const cv::Matx33d fast = rotationHomography(input.cols, input.rows, tilt, .1, angle * CV_PI / 180., 3, -2, focal, focal, focal);
+			cv::Mat reference = rotationChain(input.cols, input.rows, tilt, .1, angle * CV_PI / 180., 3, -2, focal, focal, focal);
+			reference /= reference.at<double>(2, 2);
+			for (int r = 0; r < 3; r++){
+				for (int c = 0; c < 3; c++){
+					worstMatrix = std::max(worstMatrix, std::abs(fast(r, c) / fast(2, 2) - reference.at<double>(r, c)));
+				}
+			}
+
+			// Pixels: the bounding box warp against the full frame warp of the cv::Mat chain
+			const cv::Matx33d H = foreshortenHomography(input.size(), tilt, focal, angle, scale);
+
+			cv::Mat full;
+			cv::Mat chain = rotationChain(input.cols, input.rows, tilt, 0, 0, 0, 0, focal, focal, focal);
+			cv::Mat M = cv::getRotationMatrix2D(cv::Point2f(128, 128), angle, scale);
+			M.push_back(cv::Mat((cv::Mat_<double>(1, 3) << 0, 0, 1)));
+			const cv::Size frame(input.cols * 2, input.rows * 2);
+			cv::Mat offset = (cv::Mat_<double>(3, 3) << 1, 0, input.cols / 2, 0, 1, input.rows / 2, 0, 0, 1);
+			cv::warpPerspective(input, full, offset * M * chain, frame, cv::INTER_LINEAR);
+
+			cv::Mat box;
+			cv::Point2f center;
+			warpBoundingBox(input, H, cv::INTER_LINEAR, box, center);
+
+			// The input center lands at 128 + offset in the full frame
+			const cv::Point origin(cvRound(128 + input.cols / 2 - center.x), cvRound(128 + input.rows / 2 - center.y));
+			const cv::Rect area = cv::Rect(origin, box.size()) & cv::Rect(cv::Point(0, 0), frame);
+			if (area.area() == 0){
+				log << "tilt " << tiltDeg << " angle " << angle << ": box outside the frame" << std::endl;
+				ok = false;
+				continue;
+			}
+
+			cv::Mat diff;
+			cv::absdiff(full(area), box(area - origin), diff);
+			double maxDiff;
+			cv::minMaxLoc(diff.reshape(1), nullptr, &maxDiff);
+
+			// Covered pixels outside the box would be lost
+			cv::Mat alpha;
+			cv::extractChannel(full, alpha, 3);
+			const int coveredOutside = cv::countNonZero(alpha) - cv::countNonZero(alpha(area));
+
+			worstPixel = std::max(worstPixel, maxDiff);
+			if (maxDiff > 2 || coveredOutside > 0){
+				log << "tilt " << tiltDeg << " angle " << angle << ": max difference " << maxDiff << ", alpha outside the box " << coveredOutside << std::endl;
+				ok = false;
+			}
+		}
+	}
+
+	if (worstMatrix > 1e-9){
+		ok = false;
+	}
+
+	log << "foreshortening: matrix error " << worstMatrix << ", pixel error " << worstPixel << (ok ? " ok" : " FAILED") << std::endl;
+	return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef __FORESHORTEN__
+#define __FORESHORTEN__
+
+#include <opencv2/opencv.hpp>
+
+#include <ostream>
+
+// Homography of the image rotation chain A2 * T * ( RX * RY * RZ ) * A1 of a w x h image, angles in radians.
+// Fixed-size matrices only, nothing is allocated.
+cv::Matx33d rotationHomography(double w, double h, double alpha, double beta, double gamma, double dx, double dy, double dz, double fx, double fy);
+
+// The same chain built with cv::Mat, as the original cv::warpPerspective path did; the reference for checkForeshortening
+cv::Mat rotationChain(double w, double h, double alpha, double beta, double gamma, double dx, double dy, double dz, double fx, double fy);
+
+// Angle of a unit bone direction out of the image plane ( radians ), positive when the child joint is farther
+double boneTilt(const cv::Vec3f& direction);
+
+// Homography of a w x h tattoo tilted about its horizontal axis and seen from focal ( pixels of the tattoo ),
+// then rotated ( degrees, counter-clockwise ) and scaled about its center like warpTattoo
+cv::Matx33d foreshortenHomography(const cv::Size& size, double tilt, double focal, double angle, double scale);
+
+// Bounding box of the transformed corners of an input of size: the homography moved to the box origin, the box size
+// and where the input center lands. False when a corner is behind the camera.
+bool boundingBoxHomography(const cv::Size& size, const cv::Matx33d& homography, cv::Matx33d& shifted, cv::Size& box, cv::Point2f& center);
+
+// Warp input into an image covering only the bounding box of its transformed corners.
+// center receives where the input center landed in output.
+void warpBoundingBox(const cv::Mat& input, const cv::Matx33d& homography, int interpolation, cv::Mat& output, cv::Point2f& center);
+
+// Compare rotationHomography and warpBoundingBox with the cv::Mat chain over a range of poses, false if they disagree
+bool checkForeshortening(std::ostream& log);
+
+#endif // __FORESHORTEN__
@@ -0,0 +1,255 @@
+#include "framesync.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <limits>
+
+// Constructor
+FrameSync::FrameSync(size_t colorSlots, size_t bodySlots, int64_t maxWait)
+	: colorSlots(std::max<size_t>(1, colorSlots)), bodySlots(std::max<size_t>(2, bodySlots)), maxWait(maxWait)
+{
+}
+
+void FrameSync::pushColor(int64_t time, const cv::Mat& image)
+{
+	ColorSample sample;
+	sample.time = time;
+	sample.image = image;
+	colors.push_back(sample);
+
+	while (colors.size() > colorSlots){
+		colors.pop_front();
+		stats.dropped++;
+	}
+}
+
+void FrameSync::pushBody(int64_t time, const JointBuffer& joints)
+{
+	// Keep the ring sorted, a late sample is simply older
+	if (!bodies.empty() && time <= bodies.back().time){
+		return;
+	}
+
+	if (bodies.size() == bodySlots){
+		bodies.pop_front();
+	}
+	bodies.push_back(BodySample());
+	bodies.back().time = time;
+	bodies.back().joints = joints;
+}
+
+bool FrameSync::pop(SyncedFrame& frame)
+{
+	if (colors.empty()){
+		return false;
+	}
+
+	// Newest color frame with a body sample at or after it, or that waited long enough
+	const int64_t newestColor = colors.back().time;
+	const int64_t newestBody = bodies.empty() ? std::numeric_limits<int64_t>::min() : bodies.back().time;
+	int ready = -1;
+	for (int i = static_cast<int>(colors.size()) - 1; i >= 0 && ready < 0; i--){
+		if (colors[i].time <= newestBody || newestColor - colors[i].time >= maxWait){
+			ready = i;
+		}
+	}
+	if (ready < 0){
+		return false;
+	}
+
+	stats.dropped += ready;
+	const ColorSample color = colors[ready];
+	colors.erase(colors.begin(), colors.begin() + ready + 1);
+
+	frame.time = color.time;
+	frame.image = color.image;
+	frame.interpolated = false;
+	frame.bodyless = bodies.empty();
+	frame.offset = 0;
+
+	int64_t error = 0;
+	if (bodies.empty()){
+		frame.joints.clear();
+	}
+	else {
+		// First body sample at or after the color frame
+		size_t after = 0;
+		while (after < bodies.size() && bodies[after].time < color.time){
+			after++;
+		}
+
+		if (after < bodies.size() && bodies[after].time == color.time){
+			frame.joints = bodies[after].joints;
+		}
+		else if (after > 0 && after < bodies.size()){
+			const BodySample& a = bodies[after - 1];
+			const BodySample& b = bodies[after];
+			const float t = static_cast<float>(color.time - a.time) / static_cast<float>(b.time - a.time);
+			interpolateJoints(a.joints, b.joints, t, frame.joints);
+			frame.interpolated = true;
+		}
+		else {
+			// Only older or only newer samples, take the nearest
+			const BodySample& nearest = after == 0 ? bodies.front() : bodies.back();
+			frame.joints = nearest.joints;
+			error = std::abs(nearest.time - color.time);
+		}
+
+		// Offset of the nearest sample either way
+		int64_t nearestOffset = std::numeric_limits<int64_t>::max();
+		for (const auto& body : bodies){
+			if (std::abs(body.time - color.time) < std::abs(nearestOffset)){
+				nearestOffset = body.time - color.time;
+			}
+		}
+		frame.offset = nearestOffset;
+	}
+
+	if (!frame.bodyless){
+		stats.pairs++;
+		if (frame.interpolated){
+			stats.interpolated++;
+		}
+		stats.lastError = error;
+		stats.maxError = std::max(stats.maxError, error);
+		stats.meanError += (error - stats.meanError) / stats.pairs;
+		stats.meanOffset += (std::abs(frame.offset) - stats.meanOffset) / stats.pairs;
+	}
+	return true;
+}
+
+void FrameSync::clear()
+{
+	colors.clear();
+	bodies.clear();
+}
+
+void interpolateJoints(const JointBuffer& a, const JointBuffer& b, float t, JointBuffer& out)
+{
+	// Bodies tracked in only one sample come from the nearer one
+	out = t < .5f ? a : b;
+
+	for (int body = 0; body < SkeletonBodyCount; body++){
+		if (!a.tracked[body] || !b.tracked[body]){
+			continue;
+		}
+
+		const int first = body * SkeletonJointCount;
+		for (int s = first; s < first + SkeletonJointCount; s++){
+			out.x[s] = a.x[s] + (b.x[s] - a.x[s]) * t;
+			out.y[s] = a.y[s] + (b.y[s] - a.y[s]) * t;
+			out.z[s] = a.z[s] + (b.z[s] - a.z[s]) * t;
+			out.u[s] = a.u[s] + (b.u[s] - a.u[s]) * t;
+			out.v[s] = a.v[s] + (b.v[s] - a.v[s]) * t;
+
+			// Normalized lerp on the same hemisphere
+			const float sign = a.qx[s] * b.qx[s] + a.qy[s] * b.qy[s] + a.qz[s] * b.qz[s] + a.qw[s] * b.qw[s] < 0 ? -1.f : 1.f;
+			float qx = a.qx[s] + (sign * b.qx[s] - a.qx[s]) * t;
+			float qy = a.qy[s] + (sign * b.qy[s] - a.qy[s]) * t;
+			float qz = a.qz[s] + (sign * b.qz[s] - a.qz[s]) * t;
+			float qw = a.qw[s] + (sign * b.qw[s] - a.qw[s]) * t;
+			const float norm = std::sqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+			if (norm > 1e-6f){
+				qx /= norm; qy /= norm; qz /= norm; qw /= norm;
+			}
+			out.qx[s] = qx;
+			out.qy[s] = qy;
+			out.qz[s] = qz;
+			out.qw[s] = qw;
+
+			// A joint is only as good as its worse sample
+			out.state[s] = std::min(a.state[s], b.state[s]);
+		}
+	}
+}
+
+bool checkFrameSync(std::ostream& log)
+{
+	// 30 Hz streams in 100 ns ticks: jittered color, body sampled 13 ms off and delivered 60 ms late
+	const int64_t period = 333333;
+	const int64_t bodyShift = 130000;
+	const int64_t bodyLatency = 600000;
+	const int64_t colorLatency = 300000;
+	const int frames = 300;
+
+	// Wrist moving at 300 px/s and 0.5 m/s
+	auto wristU = [](int64_t time){ return 100. + 300. * time / 1e7; };
+	auto wristX = [](int64_t time){ return .5 * time / 1e7; };
+
+	// Arrival events ( arrival time, stream time, is body ) in arrival order
+	struct Event { int64_t arrival; int64_t time; bool body; };
+	std::vector<Event> events;
+	unsigned int seed = 12345;
+	for (int k = 0; k < frames; k++){
+		seed = seed * 1103515245u + 12345u;
+		const int64_t jitter = static_cast<int64_t>((seed >> 16) % 40001) - 20000;
+		const int64_t colorTime = k * period + jitter;
+		const int64_t bodyTime = k * period + bodyShift;
+		Event color = { colorTime + colorLatency, colorTime, false };
+		Event body = { bodyTime + bodyLatency, bodyTime, true };
+		events.push_back(color);
+		events.push_back(body);
+	}
+	std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b){ return a.arrival < b.arrival; });
+
+	FrameSync sync(4, 8, 1000000);
+	cv::Mat image(4, 4, CV_8UC4, cv::Scalar(0, 0, 0, 255));
+	JointBuffer joints;
+	joints.clear();
+	joints.tracked[0] = true;
+	const int wrist = Joint_WristRight;
+	joints.state[wrist] = JointState_Tracked;
+	joints.qw[wrist] = 1;
+
+	// Error of the joints against the truth, and of the latest sample as the old code took it
+	double worst = 0, latestWorst = 0;
+	int64_t latestBody = -1;
+	bool ok = true;
+	int paired = 0;
+
+	SyncedFrame frame;
+	for (const auto& event : events){
+		if (event.body){
+			joints.u[wrist] = static_cast<float>(wristU(event.time));
+			joints.x[wrist] = static_cast<float>(wristX(event.time));
+			sync.pushBody(event.time, joints);
+			latestBody = event.time;
+		}
+		else {
+			sync.pushColor(event.time, image);
+			if (latestBody >= 0){
+				latestWorst = std::max(latestWorst, std::abs(wristU(latestBody) - wristU(event.time)));
+			}
+		}
+
+		while (sync.pop(frame)){
+			if (frame.bodyless){
+				continue;
+			}
+			paired++;
+
+			const double error = std::abs(frame.joints.u[wrist] - wristU(frame.time));
+			const double errorX = std::abs(frame.joints.x[wrist] - wristX(frame.time));
+			if (frame.interpolated){
+				worst = std::max(worst, error);
+				if (error > .05 || errorX > 1e-4){
+					log << "frame at " << frame.time << ": interpolated wrist off by " << error << " px" << std::endl;
+					ok = false;
+				}
+			}
+		}
+	}
+
+	const SyncStats& stats = sync.statistics();
+	if (stats.interpolated < stats.pairs * 9 / 10 || paired < frames * 9 / 10){
+		log << "only " << stats.interpolated << " of " << stats.pairs << " pairs interpolated, " << paired << " of " << frames << " frames paired" << std::endl;
+		ok = false;
+	}
+
+	log << "frame sync: " << stats.pairs << " pairs, " << stats.interpolated << " interpolated, " << stats.dropped << " dropped, "
+		<< "mean error " << stats.meanError / 1e4 << " ms, nearest sample " << stats.meanOffset / 1e4 << " ms, "
+		<< "wrist error " << worst << " px ( latest sample " << latestWorst << " px )" << (ok ? " ok" : " FAILED") << std::endl;
+	return ok;
+}
@@ -0,0 +1,93 @@
+#ifndef __FRAMESYNC__
+#define __FRAMESYNC__
+
+#include "skeleton.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <deque>
+#include <ostream>
+#include <cstdint>
+
+// A color frame with the body sample of the same moment
+struct SyncedFrame
+{
+	int64_t time;
+	cv::Mat image;
+	JointBuffer joints;
+
+	// Body time minus color time of the nearest body sample, and whether the two around it were interpolated
+	int64_t offset;
+	bool interpolated;
+
+	// No body sample at all was available
+	bool bodyless;
+};
+
+// Pairing statistics, times in the units of the timestamps
+struct SyncStats
+{
+	unsigned long long pairs = 0;
+	unsigned long long interpolated = 0;
+	unsigned long long dropped = 0;
+
+	// Time between a color frame and the body sample it was given, 0 when interpolated
+	int64_t lastError = 0;
+	int64_t maxError = 0;
+	double meanError = 0;
+
+	// The same for the nearest body sample, what taking it alone would cost
+	double meanOffset = 0;
+};
+
+// Pairs color frames with body samples by timestamp ( e.g. Kinect RelativeTime, 100 ns ).
+// A color frame waits until a body sample at or after it arrives, so its joints can be interpolated,
+// or until it is maxWait older than the newest color frame, then it takes the nearest sample.
+class FrameSync
+{
+private:
+	struct ColorSample
+	{
+		int64_t time;
+		cv::Mat image;
+	};
+
+	struct BodySample
+	{
+		int64_t time;
+		JointBuffer joints;
+	};
+
+	size_t colorSlots;
+	size_t bodySlots;
+	int64_t maxWait;
+
+	std::deque<ColorSample> colors;
+	std::deque<BodySample> bodies;
+
+	SyncStats stats;
+
+public:
+	// Constructor ( frames kept per stream, wait in timestamp units )
+	FrameSync(size_t colorSlots = 4, size_t bodySlots = 8, int64_t maxWait = 400000);
+
+	// Add a frame, the image is kept by reference so it must not be written afterwards
+	void pushColor(int64_t time, const cv::Mat& image);
+	void pushBody(int64_t time, const JointBuffer& joints);
+
+	// Newest color frame that can be paired, older waiting frames are dropped. False while none is ready.
+	bool pop(SyncedFrame& frame);
+
+	const SyncStats& statistics() const { return stats; }
+
+	// Drop every buffered frame
+	void clear();
+};
+
+// Body sample between two others, t in [0, 1] from a to b
+void interpolateJoints(const JointBuffer& a, const JointBuffer& b, float t, JointBuffer& out);
+
+// Pair synthetic jittered streams with known motion and check the joints and statistics, false on failure
+bool checkFrameSync(std::ostream& log);
+
+#endif // __FRAMESYNC__
@@ -0,0 +1,103 @@
+#include "grid.h"
+#include "memorybudget.h"
+
+#include <algorithm>
+
+// Constructor
+TryOnGrid::TryOnGrid(int columns, int rows)
+	: columns(std::max(1, columns)), rows(std::max(1, rows))
+{
+}
+
+// Tiles are drawn from one placement per frame, so their limb radius is not smoothed
+static RendererSettings tileSettings()
+{
+	RendererSettings settings;
+	settings.radiusSmoothing = 1.;
+	settings.cacheBytes = 8 << 20;
+	return settings;
+}
+
+// Constructor
+TryOnGrid::Tile::Tile()
+	: id(0), renderer(tileSettings())
+{
+}
+
+void TryOnGrid::setTattoos(const std::vector<PreparedTattoo>& tattoos)
+{
+	tiles.clear();
+	for (size_t i = 0; i < tattoos.size() && static_cast<int>(i) < capacity(); i++){
+		if (tattoos[i].empty()){
+			continue;
+		}
+
+		std::unique_ptr<Tile> tile(new Tile);
+		tile->tattoo = tattoos[i];
+		tile->id = nextId++;
+		tiles.push_back(std::move(tile));
+	}
+}
+
+void TryOnGrid::clearCaches()
+{
+	for (auto& tile : tiles){
+		tile->renderer.cache().clear();
+	}
+}
+
+void TryOnGrid::render(const cv::Mat& frame, const TryOnPlacement* placement, cv::Mat& output)
+{
+	if (frame.empty()){
+		return;
+	}
+
+	// Tiles keep the frame aspect, the remainder of the division stays black
+	const cv::Size tileSize(frame.cols / columns, frame.rows / rows);
+	const double factor = static_cast<double>(tileSize.width) / frame.cols;
+	output.create(frame.size(), frame.type());
+	output.setTo(cv::Scalar::all(0));
+
+	// Downscaled once, every tile starts from a copy
+	cv::resize(frame, background, tileSize, 0, 0, cv::INTER_AREA);
+
+	const int count = columns * rows;
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < count; i++){
+		const cv::Rect area((i % columns) * tileSize.width, (i / columns) * tileSize.height, tileSize.width, tileSize.height);
+		cv::Mat target = output(area);
+		background.copyTo(target);
+		if (i < static_cast<int>(tiles.size())){
+			renderTile(*tiles[i], area, factor, placement, output);
+		}
+	}
+}
+
+void TryOnGrid::renderTile(Tile& tile, const cv::Rect& area, double factor, const TryOnPlacement* placement, cv::Mat& output)
+{
+	if (placement == nullptr){
+		return;
+	}
+
+	RendererSettings settings = tile.renderer.settings();
+	settings.zoom = placement->zoom;
+	settings.interpolation = placement->interpolation;
+	settings.mipBias = placement->mipBias;
+	settings.opacity = placement->opacity;
+	settings.shading = placement->shading;
+	tile.renderer.adjustSettings(settings);
+
+	// Warped straight to the tile scale, so small tiles sample small mips
+	{
+		// Tiles run on worker threads, which have no tag of their own
+		MemoryScope scope(Memory_Warp);
+		const int radiusStep = tile.renderer.smoothRadius(tile.tattoo, placement->pose, placement->limbRadius);
+		if (!tile.renderer.place(tile.tattoo, tile.id, placement->pose, radiusStep, placement->variant, factor, tile.placed)){
+			return;
+		}
+	}
+
+	MemoryScope scope(Memory_Composite);
+	cv::Mat target = output(area);
+	tile.renderer.composite(target, tile.placed);
+}
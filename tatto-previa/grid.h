@@ -0,0 +1,82 @@
+#ifndef __GRID__
+#define __GRID__
+
+#include "render.h"
+#include "renderer.h"
+#include "skeleton.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+#include <memory>
+
+// Where and how the tattoos of a grid are placed, in frame coordinates
+struct TryOnPlacement
+{
+	AnchorPose pose;
+
+	// Limb radius under the tattoo ( meters )
+	float limbRadius;
+
+	double zoom;
+	int interpolation;
+	float mipBias;
+
+	// Quality level of the warps ( below 16 ); zoom, interpolation and mip bias are already in the cache key
+	int variant;
+
+	double opacity;
+	double shading;
+};
+
+// The same frame with several tattoos side by side, each in a downscaled tile
+class TryOnGrid
+{
+private:
+	struct Tile
+	{
+		PreparedTattoo tattoo;
+		unsigned long long id;
+
+		// Every tile warps and blends on its own thread
+		TattooRenderer renderer;
+		PlacedTattoo placed;
+
+		// Constructor
+		Tile();
+	};
+
+	int columns;
+	int rows;
+	std::vector<std::unique_ptr<Tile>> tiles;
+
+	// The frame downscaled to a tile, shared by every tile
+	cv::Mat background;
+
+	unsigned long long nextId = 1;
+
+public:
+	// Constructor ( tiles across and down )
+	explicit TryOnGrid(int columns = 3, int rows = 3);
+
+	// Show these tattoos, up to one per tile
+	void setTattoos(const std::vector<PreparedTattoo>& tattoos);
+
+	int capacity() const { return columns * rows; }
+
+	// Drop the cached warps of every tile
+	void clearCaches();
+	bool empty() const { return tiles.empty(); }
+
+	// Render the frame into output ( same size ), tiles in parallel, each with its tattoo at the placement.
+	// Without a placement the tiles only show the frame.
+	void render(const cv::Mat& frame, const TryOnPlacement* placement, cv::Mat& output);
+
+private:
+	void renderTile(Tile& tile, const cv::Rect& area, double factor, const TryOnPlacement* placement, cv::Mat& output);
+
+	TryOnGrid(const TryOnGrid&);
+	TryOnGrid& operator=(const TryOnGrid&);
+};
+
+#endif // __GRID__
@@ -0,0 +1,187 @@
+#include "memorybudget.h"
+
+#include <iomanip>
+
+// VS2013 has no thread_local, __declspec(thread) is enough for an int
+#ifdef _MSC_VER
+#define MEMORY_THREAD_LOCAL __declspec(thread)
+#else
+#define MEMORY_THREAD_LOCAL thread_local
+#endif
+
+// Tag of the buffers the thread allocates, set by MemoryScope
+static MEMORY_THREAD_LOCAL int threadTag = Memory_Other;
+
+static const char* const tagNames[MemoryTagCount] = { "other", "ingest", "assets", "warp", "composite", "ui" };
+
+const char* memoryTagName(MemoryTag tag)
+{
+	return tag >= 0 && tag < MemoryTagCount ? tagNames[tag] : "?";
+}
+
+bool parseMemoryTag(const std::string& name, MemoryTag& tag)
+{
+	for (int i = 0; i < MemoryTagCount; i++){
+		if (name == tagNames[i]){
+			tag = static_cast<MemoryTag>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+cv::UMatData* MemoryAccounting::TaggedAllocator::allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
+{
+	if (tag < 0){
+		return accounting->allocators[threadTag].allocate(dims, sizes, type, data, step, flags, usageFlags);
+	}
+
+	// OpenCV's own allocator does the work, this one is only put in front of it to see the buffer freed
+	cv::UMatData* u = cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+	if (u == nullptr || data != nullptr){
+		return u;
+	}
+
+	u->currAllocator = this;
+	accounting->allocated(tag, u->size);
+	return u;
+}
+
+bool MemoryAccounting::TaggedAllocator::allocate(cv::UMatData* data, int accessFlags, cv::UMatUsageFlags usageFlags) const
+{
+	return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+}
+
+void MemoryAccounting::TaggedAllocator::deallocate(cv::UMatData* data) const
+{
+	if (data == nullptr){
+		return;
+	}
+
+	accounting->released(tag, data->size);
+	const cv::MatAllocator* standard = cv::Mat::getStdAllocator();
+	data->currAllocator = standard;
+	standard->deallocate(data);
+}
+
+// Constructor
+MemoryAccounting::MemoryAccounting()
+{
+	for (int i = 0; i < MemoryTagCount; i++){
+		allocators[i].accounting = this;
+		allocators[i].tag = i;
+
+		counters[i].live = 0;
+		counters[i].peak = 0;
+		counters[i].budget = 0;
+		counters[i].allocations = 0;
+		counters[i].overruns = 0;
+	}
+	current.accounting = this;
+	current.tag = -1;
+}
+
+MemoryAccounting& MemoryAccounting::instance()
+{
+	// Leaked on purpose: buffers of static objects are freed after any destructor here would run
+	static MemoryAccounting* accounting = new MemoryAccounting();
+	return *accounting;
+}
+
+void MemoryAccounting::install()
+{
+	cv::Mat::setDefaultAllocator(&current);
+}
+
+cv::MatAllocator* MemoryAccounting::allocator(MemoryTag tag)
+{
+	return &allocators[tag];
+}
+
+void MemoryAccounting::setBudget(MemoryTag tag, size_t bytes)
+{
+	counters[tag].budget = bytes;
+}
+
+size_t MemoryAccounting::total() const
+{
+	size_t bytes = 0;
+	for (int i = 0; i < MemoryTagCount; i++){
+		bytes += counters[i].live;
+	}
+	return bytes;
+}
+
+size_t MemoryAccounting::overBudget(MemoryTag tag) const
+{
+	const size_t budget = counters[tag].budget;
+	const size_t live = counters[tag].live;
+	return budget > 0 && live > budget ? live - budget : 0;
+}
+
+void MemoryAccounting::allocated(int tag, size_t bytes)
+{
+	Counter& counter = counters[tag];
+	const size_t live = counter.live.fetch_add(bytes) + bytes;
+	counter.allocations++;
+
+	size_t peak = counter.peak;
+	while (live > peak && !counter.peak.compare_exchange_weak(peak, live)){
+	}
+
+	const size_t budget = counter.budget;
+	if (budget > 0 && live > budget){
+		counter.overruns++;
+	}
+}
+
+void MemoryAccounting::released(int tag, size_t bytes)
+{
+	counters[tag].live -= bytes;
+}
+
+void MemoryAccounting::report(std::ostream& out) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+
+	const double mb = 1. / (1 << 20);
+	out << std::left << std::setw(10) << "memory" << std::right << std::setw(10) << "live MB" << std::setw(10) << "peak MB"
+		<< std::setw(10) << "budget" << std::setw(12) << "allocs" << std::setw(10) << "overruns" << std::endl;
+	for (int i = 0; i < MemoryTagCount; i++){
+		const Counter& counter = counters[i];
+		out << std::left << std::setw(10) << tagNames[i] << std::right << std::setw(10) << counter.live * mb << std::setw(10) << counter.peak * mb;
+		if (counter.budget > 0){
+			out << std::setw(10) << counter.budget * mb;
+		}
+		else {
+			out << std::setw(10) << "-";
+		}
+		out << std::setw(12) << counter.allocations << std::setw(10) << counter.overruns << std::endl;
+	}
+	out << std::left << std::setw(10) << "total" << std::right << std::setw(10) << total() * mb << std::endl;
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void MemoryAccounting::resetPeaks()
+{
+	for (int i = 0; i < MemoryTagCount; i++){
+		counters[i].peak = static_cast<size_t>(counters[i].live);
+	}
+}
+
+// Constructor
+MemoryScope::MemoryScope(MemoryTag tag)
+	: previous(threadTag)
+{
+	threadTag = tag;
+}
+
+// Destructor
+MemoryScope::~MemoryScope()
+{
+	threadTag = previous;
+}
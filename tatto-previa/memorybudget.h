@@ -0,0 +1,117 @@
+#ifndef __MEMORYBUDGET__
+#define __MEMORYBUDGET__
+
+#include <opencv2/opencv.hpp>
+
+#include <ostream>
+#include <string>
+#include <atomic>
+#include <cstddef>
+
+// Subsystems the image buffers are counted for
+enum MemoryTag
+{
+	Memory_Other,
+	Memory_Ingest,
+	Memory_Assets,
+	Memory_Warp,
+	Memory_Composite,
+	Memory_UI,
+	MemoryTagCount
+};
+
+// Name of a tag ( "ingest", "warp", ... ), and the tag of a name, false if unknown
+const char* memoryTagName(MemoryTag tag);
+bool parseMemoryTag(const std::string& name, MemoryTag& tag);
+
+// Counts the cv::Mat buffers of every tag. Once installed as OpenCV's default allocator, a buffer is
+// counted for the tag of the thread allocating it ( MemoryScope ), or for the tag of the allocator a
+// cv::Mat was given ( allocator(tag) ). Buffers wrapping user data are not counted.
+//
+// Budgets are not enforced inside allocations, where the caches that could free memory may be in use:
+// an allocation over budget is still served, counted as an overrun and flags the tag, and the thread
+// owning the caches evicts from them at a safe point ( overBudget, e.g. once per frame ).
+class MemoryAccounting
+{
+private:
+	class TaggedAllocator : public cv::MatAllocator
+	{
+	public:
+		MemoryAccounting* accounting;
+
+		// -1 for the tag of the allocating thread
+		int tag;
+
+		cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+		bool allocate(cv::UMatData* data, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+		void deallocate(cv::UMatData* data) const;
+	};
+
+	struct Counter
+	{
+		std::atomic<size_t> live;
+		std::atomic<size_t> peak;
+		std::atomic<size_t> budget;
+		std::atomic<unsigned long long> allocations;
+		std::atomic<unsigned long long> overruns;
+	};
+
+	TaggedAllocator allocators[MemoryTagCount];
+	TaggedAllocator current;
+	Counter counters[MemoryTagCount];
+
+	MemoryAccounting();
+
+public:
+	// The process wide accounting, never destroyed so buffers can be freed at any time
+	static MemoryAccounting& instance();
+
+	// Make OpenCV allocate through the accounting, buffers allocated before are not counted
+	void install();
+
+	// Allocator counting for tag whatever thread allocates, for a cv::Mat that outlives a scope
+	cv::MatAllocator* allocator(MemoryTag tag);
+
+	// Budget of a tag in bytes, 0 for none
+	void setBudget(MemoryTag tag, size_t bytes);
+	size_t budget(MemoryTag tag) const { return counters[tag].budget; }
+
+	// Bytes in use now and at most since the start or resetPeaks
+	size_t live(MemoryTag tag) const { return counters[tag].live; }
+	size_t peak(MemoryTag tag) const { return counters[tag].peak; }
+	size_t total() const;
+
+	// Allocations that left the tag over its budget
+	unsigned long long overruns(MemoryTag tag) const { return counters[tag].overruns; }
+
+	// Bytes over the budget of a tag, 0 when within or without one
+	size_t overBudget(MemoryTag tag) const;
+
+	// Live, peak and budget per tag
+	void report(std::ostream& out) const;
+	void resetPeaks();
+
+private:
+	void allocated(int tag, size_t bytes);
+	void released(int tag, size_t bytes);
+
+	MemoryAccounting(const MemoryAccounting&);
+	MemoryAccounting& operator=(const MemoryAccounting&);
+};
+
+// Tags the buffers the calling thread allocates while it lives, scopes nest
+class MemoryScope
+{
+private:
+	int previous;
+
+public:
+	explicit MemoryScope(MemoryTag tag);
+	~MemoryScope();
+
+private:
+	MemoryScope(const MemoryScope&);
+	MemoryScope& operator=(const MemoryScope&);
+};
+
+#endif // __MEMORYBUDGET__
@@ -0,0 +1,249 @@
+#include "offline.h"
+#include "renderer.h"
+#include "pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+// Decoded frames shared by the tasks of the same frame
+class FrameCache
+{
+private:
+	typedef std::pair<int, std::shared_ptr<const cv::Mat>> Entry;
+
+	size_t capacity;
+	std::mutex mutex;
+	std::list<Entry> entries;
+
+public:
+	explicit FrameCache(size_t capacity) : capacity(capacity) {}
+
+	std::shared_ptr<const cv::Mat> get(const std::vector<SessionFrame>& frames, int index)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (std::list<Entry>::iterator entry = entries.begin(); entry != entries.end(); ++entry){
+				if (entry->first == index){
+					entries.splice(entries.begin(), entries, entry);
+					return entry->second;
+				}
+			}
+		}
+
+		// Decode outside the lock, two threads may decode the same frame once
+		std::shared_ptr<const cv::Mat> image = std::make_shared<const cv::Mat>(cv::imread(frames[index].image, -1));
+		if (image->empty()){
+			throw std::runtime_error("Could not read " + frames[index].image);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.push_front(Entry(index, image));
+		if (entries.size() > capacity){
+			entries.pop_back();
+		}
+		return image;
+	}
+};
+
+// Writes encoded images on a background thread, write() blocks while the queue is full. The workers encode,
+// only the file I/O is left to this thread, so it does not cap the output rate at one core.
+class AsyncWriter
+{
+private:
+	size_t capacity;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::pair<std::string, std::vector<uchar>>> queue;
+	bool stopping = false;
+	std::atomic<int> failures;
+	std::thread worker;
+
+public:
+	explicit AsyncWriter(size_t capacity)
+		: capacity(std::max<size_t>(capacity, 1)), failures(0), worker(&AsyncWriter::run, this)
+	{
+	}
+
+	~AsyncWriter()
+	{
+		finish();
+	}
+
+	// Write what is queued and stop the thread
+	void finish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+		if (worker.joinable()){
+			worker.join();
+		}
+	}
+
+	void write(const std::string& path, std::vector<uchar>& encoded)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this]{ return queue.size() < capacity; });
+		queue.push_back(std::make_pair(path, std::vector<uchar>()));
+		queue.back().second.swap(encoded);
+		changed.notify_all();
+	}
+
+	// Images that could not be encoded or written, final after finish()
+	void fail() { failures++; }
+	int failed() const { return failures; }
+
+private:
+	void run()
+	{
+		while (true){
+			std::pair<std::string, std::vector<uchar>> item;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [this]{ return stopping || !queue.empty(); });
+				if (queue.empty()){
+					return;
+				}
+				item.first.swap(queue.front().first);
+				item.second.swap(queue.front().second);
+				queue.pop_front();
+			}
+			changed.notify_all();
+
+			std::ofstream file(item.first, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(item.second.data()), static_cast<std::streamsize>(item.second.size()));
+			file.close();
+			if (!file){
+				failures++;
+			}
+		}
+	}
+};
+
+// File name of a tattoo without directory and extension
+static std::string baseName(const std::string& path)
+{
+	const size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	const size_t dot = name.find_last_of('.');
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+OfflineStats renderSession(const std::vector<SessionFrame>& frames, const std::vector<PreparedTattoo>& tattoos, const std::string& output, const OfflineOptions& options)
+{
+	OfflineStats stats;
+	stats.frames = static_cast<int>(frames.size());
+	if (frames.empty() || tattoos.empty()){
+		return stats;
+	}
+
+	int threads = options.threads;
+	if (threads <= 0){
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Tasks of a frame are consecutive, so a frame is decoded once while its tattoos are rendered
+	const int tattooCount = static_cast<int>(tattoos.size());
+	const int taskCount = stats.frames * tattooCount;
+
+	std::vector<std::string> names(tattoos.size());
+	for (size_t i = 0; i < tattoos.size(); i++){
+		names[i] = baseName(tattoos[i].name.empty() ? "tattoo" + std::to_string(i) : tattoos[i].name);
+	}
+
+	// Handles share the projected tattoos between the renderers of every worker
+	std::vector<TattooHandle> handles;
+	for (const auto& tattoo : tattoos){
+		handles.push_back(std::make_shared<const PreparedTattoo>(tattoo));
+	}
+
+	// Tasks jump between poses, so nothing is smoothed or cached
+	RendererSettings settings;
+	settings.anchor = options.anchor;
+	settings.zoom = options.zoom;
+	settings.opacity = options.opacity;
+	settings.shading = options.shading;
+	settings.interpolation = options.interpolation;
+	settings.radiusSmoothing = 1.;
+	settings.cacheBytes = 0;
+
+	FrameCache cache(options.cachedFrames > 0 ? options.cachedFrames : threads + 2);
+	std::atomic<int> next(0);
+	std::atomic<int> placed(0);
+	std::mutex errorMutex;
+	std::string error;
+
+	int failed = 0;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		AsyncWriter writer(options.pendingWrites);
+
+		auto work = [&](){
+			serialPoolThread();
+			TattooRenderer renderer(settings);
+			std::vector<uchar> encoded;
+
+			for (int task = next++; task < taskCount; task = next++){
+				const int index = task / tattooCount;
+				const int t = task % tattooCount;
+
+				try {
+					cv::Mat image = cache.get(frames, index)->clone();
+					if (renderer.render(image, frames[index].joints, handles[t])){
+						placed++;
+					}
+
+					std::ostringstream path;
+					path << output << "/" << names[t] << "_" << std::setw(6) << std::setfill('0') << frames[index].index << options.extension;
+					if (cv::imencode(options.extension, image, encoded)){
+						writer.write(path.str(), encoded);
+					}
+					else {
+						writer.fail();
+					}
+				}
+				catch (std::exception& ex){
+					std::lock_guard<std::mutex> lock(errorMutex);
+					if (error.empty()){
+						error = ex.what();
+					}
+					next = taskCount;
+				}
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (int i = 0; i < threads; i++){
+			workers.push_back(std::thread(work));
+		}
+		for (auto& worker : workers){
+			worker.join();
+		}
+		writer.finish();
+		failed = writer.failed();
+	}
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (!error.empty()){
+		throw std::runtime_error(error);
+	}
+
+	stats.outputs = taskCount - failed;
+	stats.failed = failed;
+	stats.placed = placed;
+	stats.seconds = elapsed.count();
+	return stats;
+}
@@ -0,0 +1,64 @@
+#ifndef __OFFLINE__
+#define __OFFLINE__
+
+#include "recording.h"
+#include "render.h"
+#include "skeleton.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+
+// Settings of an offline render
+struct OfflineOptions
+{
+	// Worker threads, 0 for every core
+	int threads;
+
+	// Decoded frames kept in memory, 0 for threads + 2
+	size_t cachedFrames;
+
+	// Encoded images waiting to be written
+	size_t pendingWrites;
+
+	BoneAnchor anchor;
+	double opacity;
+	double shading;
+	int interpolation;
+	double zoom;
+	std::string extension;
+
+	// Same placement as the live view
+	OfflineOptions()
+		: threads(0), cachedFrames(0), pendingWrites(16), opacity(.85), shading(.8), interpolation(cv::INTER_CUBIC), zoom(1.), extension(".png")
+	{
+		anchor.bone = Joint_WristRight;
+		anchor.body = -1;
+		anchor.along = .5f;
+		anchor.across = 0;
+	}
+};
+
+// Totals of an offline render
+struct OfflineStats
+{
+	int frames = 0;
+	int outputs = 0;
+	int failed = 0;
+	int placed = 0;
+	double seconds = 0;
+
+	// Input frames per second, every tattoo included
+	double framesPerSecond() const { return seconds > 0 ? frames / seconds : 0; }
+	double outputsPerSecond() const { return seconds > 0 ? outputs / seconds : 0; }
+};
+
+// Render every frame of a session with every tattoo into <output>/<tattoo>_<frame>.<extension>.
+// Frames x tattoos are independent tasks spread over the cores; memory is bounded by the frame cache and the write queue.
+// Images that could not be encoded or written are counted in failed, not in outputs.
+// The workers keep their OpenMP loops serial; OpenCV's own threads are process wide and left to the caller,
+// whose cv::setNumThreads(1) keeps them from competing with the workers.
+OfflineStats renderSession(const std::vector<SessionFrame>& frames, const std::vector<PreparedTattoo>& tattoos, const std::string& output, const OfflineOptions& options = OfflineOptions());
+
+#endif // __OFFLINE__
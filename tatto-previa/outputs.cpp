@@ -0,0 +1,376 @@
+#include "outputs.h"
+
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Output rows per task
+static const int BandRows = 32;
+
+bool parseOutputSink(const std::string& spec, OutputSink& sink)
+{
+	std::vector<std::string> fields;
+	std::istringstream stream(spec);
+	std::string field;
+	while (std::getline(stream, field, ':')){
+		fields.push_back(field);
+	}
+	if (fields.size() < 2 || fields[0].empty()){
+		return false;
+	}
+
+	sink.name = fields[0];
+
+	int width = 0, height = 0;
+	char separator = 0;
+	std::istringstream size(fields[1]);
+	if (!(size >> width >> separator >> height) || separator != 'x' || width < 0 || height < 0){
+		return false;
+	}
+	sink.size = cv::Size(width, height);
+
+	for (size_t i = 2; i < fields.size(); i++){
+		if (fields[i] == "mirror"){
+			sink.mirror = true;
+		}
+		else if (fields[i] == "fullscreen"){
+			sink.fullscreen = true;
+		}
+		else if (fields[i] == "skeleton"){
+			sink.overlays |= Overlay_Skeleton;
+		}
+		else if (fields[i] == "ui"){
+			sink.overlays |= Overlay_UI;
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Taps of every output position along one axis
+static void buildAxis(int source, int output, bool mirror, ResampleAxis& axis)
+{
+	const double scale = static_cast<double>(source) / output;
+	const bool box = scale > 2.;
+	axis.taps = box ? static_cast<int>(std::ceil(scale)) + 1 : 2;
+	axis.first.resize(output);
+	axis.count.resize(output);
+	axis.weights.assign(output * axis.taps, 0);
+
+	for (int i = 0; i < output; i++){
+		const int o = mirror ? output - 1 - i : i;
+		int* weights = axis.weights.data() + i * axis.taps;
+
+		if (!box){
+			const double s = std::max(0., std::min((o + .5) * scale - .5, source - 1.));
+			const int s0 = static_cast<int>(s);
+			const int h = static_cast<int>((s - s0) * 128 + .5);
+			axis.first[i] = s0;
+			axis.count[i] = s0 + 1 < source ? 2 : 1;
+			weights[0] = 128 - h;
+			weights[1] = h;
+			continue;
+		}
+
+		// Every source pixel by how much of it the position covers, rounded to 128 in total
+		const double low = o * scale, high = std::min((o + 1) * scale, static_cast<double>(source));
+		const int begin = static_cast<int>(low);
+		const int end = std::min(source, static_cast<int>(std::ceil(high)));
+		axis.first[i] = begin;
+		axis.count[i] = end - begin;
+		int total = 0, largest = 0;
+		for (int k = 0; k < end - begin; k++){
+			const double covered = std::min(high, begin + k + 1.) - std::max(low, static_cast<double>(begin + k));
+			weights[k] = static_cast<int>(covered / (high - low) * 128 + .5);
+			total += weights[k];
+			largest = weights[k] > weights[largest] ? k : largest;
+		}
+		weights[largest] += 128 - total;
+	}
+}
+
+// Horizontal pass of a BGR or BGRA row into BGR, weights in 1/128
+template<int CN>
+static inline void resampleRow(const uchar* row, const ResampleAxis& axis, short* out, int width)
+{
+	const int* weights = axis.weights.data();
+	for (int x = 0; x < width; x++, out += 3, weights += axis.taps){
+		const uchar* px = row + axis.first[x] * CN;
+		int b = 0, g = 0, r = 0;
+		for (int k = 0; k < axis.count[x]; k++, px += CN){
+			b += px[0] * weights[k];
+			g += px[1] * weights[k];
+			r += px[2] * weights[k];
+		}
+		out[0] = static_cast<short>(b);
+		out[1] = static_cast<short>(g);
+		out[2] = static_cast<short>(r);
+	}
+}
+
+// Constructor
+OutputRenderer::OutputRenderer(int threads)
+	: nextBand(0)
+{
+	overlayImages[0] = overlayImages[1] = nullptr;
+
+	if (threads <= 0){
+		threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+	}
+	for (int i = 0; i < threads; i++){
+		workers.push_back(std::thread(&OutputRenderer::run, this));
+	}
+}
+
+// Destructor
+OutputRenderer::~OutputRenderer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	started.notify_all();
+	for (auto& worker : workers){
+		worker.join();
+	}
+}
+
+void OutputRenderer::addSink(const OutputSink& sink)
+{
+	outputs.push_back(sink);
+}
+
+int OutputRenderer::overlays() const
+{
+	int flags = 0;
+	for (const auto& sink : outputs){
+		flags |= sink.overlays;
+	}
+	return flags;
+}
+
+void OutputRenderer::render(const cv::Mat& image, const cv::Mat& skeleton, const cv::Mat& ui)
+{
+	if (image.empty() || outputs.empty()){
+		return;
+	}
+
+	// Tables and buffers only change with the sizes
+	bands.clear();
+	for (int s = 0; s < static_cast<int>(outputs.size()); s++){
+		OutputSink& sink = outputs[s];
+		const cv::Size size = sink.size.area() > 0 ? sink.size : cv::Size(image.cols / 2, image.rows / 2);
+		if (sink.source != image.size() || sink.image.size() != size){
+			buildAxis(image.cols, size.width, sink.mirror, sink.columns);
+			buildAxis(image.rows, size.height, false, sink.rows);
+			sink.source = image.size();
+			sink.image.create(size, CV_8UC3);
+		}
+
+		for (int y = 0; y < size.height; y += BandRows){
+			bands.push_back(std::make_pair(s, y));
+		}
+	}
+
+	// Most overlay rows are empty, find the drawn part once for every sink
+	const cv::Mat* drawn[2] = { skeleton.size() == image.size() ? &skeleton : nullptr, ui.size() == image.size() ? &ui : nullptr };
+	for (int o = 0; o < 2; o++){
+		if (drawn[o] != nullptr){
+			findDrawn(*drawn[o], firstDrawn[o], lastDrawn[o]);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		composite = &image;
+		overlayImages[0] = drawn[0];
+		overlayImages[1] = drawn[1];
+		bandCount = static_cast<int>(bands.size());
+		nextBand = 0;
+		pending = static_cast<int>(workers.size());
+		generation++;
+	}
+	started.notify_all();
+
+	// The caller takes bands too
+	work();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this]{ return pending == 0; });
+	composite = nullptr;
+}
+
+void OutputRenderer::run()
+{
+	unsigned long long seen = 0;
+	while (true){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			started.wait(lock, [this, seen]{ return stopping || generation != seen; });
+			if (stopping){
+				return;
+			}
+			seen = generation;
+		}
+
+		work();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending--;
+		}
+		finished.notify_one();
+	}
+}
+
+void OutputRenderer::work()
+{
+	for (int band = nextBand++; band < bandCount; band = nextBand++){
+		OutputSink& sink = outputs[bands[band].first];
+		const int first = bands[band].second;
+		renderBand(sink, first, std::min(first + BandRows, sink.image.rows));
+	}
+}
+
+void OutputRenderer::findDrawn(const cv::Mat& overlay, std::vector<int>& first, std::vector<int>& last) const
+{
+	first.assign(overlay.rows, overlay.cols);
+	last.assign(overlay.rows, -1);
+
+	for (int y = 0; y < overlay.rows; y++){
+		const uchar* row = overlay.ptr<uchar>(y);
+		const int bytes = overlay.cols * 3;
+
+		int x = 0;
+		while (x < bytes && row[x] == 0){
+			x++;
+		}
+		if (x == bytes){
+			continue;
+		}
+		int end = bytes - 1;
+		while (row[end] == 0){
+			end--;
+		}
+		first[y] = x / 3;
+		last[y] = end / 3;
+	}
+}
+
+void OutputRenderer::renderBand(OutputSink& sink, int first, int last) const
+{
+	const cv::Mat& src = *composite;
+	const int cn = src.channels();
+
+	// Overlays this sink shows
+	int shown[2];
+	int shownCount = 0;
+	if ((sink.overlays & Overlay_Skeleton) && overlayImages[0] != nullptr){
+		shown[shownCount++] = 0;
+	}
+	if ((sink.overlays & Overlay_UI) && overlayImages[1] != nullptr){
+		shown[shownCount++] = 1;
+	}
+
+	const int width = sink.image.cols;
+	const ResampleAxis& columns = sink.columns;
+	const ResampleAxis& rows = sink.rows;
+
+	// Horizontal passes of the last source rows, one slot per tap; consecutive output rows mostly share them
+	std::vector<std::vector<short>> passes(rows.taps, std::vector<short>(width * 3));
+	std::vector<int> cached(rows.taps, -1);
+	auto horizontal = [&](int sy) -> const short* {
+		const int slot = sy % rows.taps;
+		if (cached[slot] != sy){
+			if (cn == 4){
+				resampleRow<4>(src.ptr<uchar>(sy), columns, passes[slot].data(), width);
+			}
+			else {
+				resampleRow<3>(src.ptr<uchar>(sy), columns, passes[slot].data(), width);
+			}
+			cached[slot] = sy;
+		}
+		return passes[slot].data();
+	};
+
+	std::vector<int> sum(width * 3);
+	for (int y = first; y < last; y++){
+		const int sy0 = rows.first[y];
+		const int count = rows.count[y];
+		const int* wy = rows.weights.data() + y * rows.taps;
+		uchar* out = sink.image.ptr<uchar>(y);
+
+		// Vertical pass, weights in 1/128 per axis; bilinear rows in one go
+		const short* top = horizontal(sy0);
+		if (count == 2){
+			const short* bottom = horizontal(sy0 + 1);
+			const int wTop = wy[0], wBottom = wy[1];
+			for (int i = 0; i < width * 3; i++){
+				out[i] = static_cast<uchar>((top[i] * wTop + bottom[i] * wBottom + 8192) >> 14);
+			}
+		}
+		else {
+			for (int i = 0; i < width * 3; i++){
+				sum[i] = top[i] * wy[0];
+			}
+			for (int k = 1; k < count; k++){
+				const short* pass = horizontal(sy0 + k);
+				const int w = wy[k];
+				for (int i = 0; i < width * 3; i++){
+					sum[i] += pass[i] * w;
+				}
+			}
+			for (int i = 0; i < width * 3; i++){
+				out[i] = static_cast<uchar>((sum[i] + 8192) >> 14);
+			}
+		}
+
+		// Overlays: black taps are transparent, the others cover by their weight
+		for (int i = 0; i < shownCount; i++){
+			const int o = shown[i];
+			int drawnFirst = std::numeric_limits<int>::max(), drawnLast = -1;
+			for (int k = 0; k < count; k++){
+				drawnFirst = std::min(drawnFirst, firstDrawn[o][sy0 + k]);
+				drawnLast = std::max(drawnLast, lastDrawn[o][sy0 + k]);
+			}
+			if (drawnFirst > drawnLast){
+				continue;
+			}
+
+			out = sink.image.ptr<uchar>(y);
+			const int* wx = columns.weights.data();
+			for (int x = 0; x < width; x++, out += 3, wx += columns.taps){
+				const int sx0 = columns.first[x];
+				if (sx0 + columns.count[x] - 1 < drawnFirst || sx0 > drawnLast){
+					continue;
+				}
+
+				int coverage = 0;
+				int color[3] = { 0, 0, 0 };
+				for (int ky = 0; ky < count; ky++){
+					const uchar* tap = overlayImages[o]->ptr<uchar>(sy0 + ky) + sx0 * 3;
+					for (int kx = 0; kx < columns.count[x]; kx++, tap += 3){
+						if ((tap[0] | tap[1] | tap[2]) == 0){
+							continue;
+						}
+						const int weight = wx[kx] * wy[ky];
+						coverage += weight;
+						color[0] += tap[0] * weight;
+						color[1] += tap[1] * weight;
+						color[2] += tap[2] * weight;
+					}
+				}
+				if (coverage == 0){
+					continue;
+				}
+
+				for (int c = 0; c < 3; c++){
+					out[c] = static_cast<uchar>((out[c] * (16384 - coverage) + color[c] + 8192) >> 14);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#ifndef __OUTPUTS__
+#define __OUTPUTS__
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// Overlays a sink can show on top of the composite
+enum OutputOverlay
+{
+	Overlay_Skeleton = 1,
+	Overlay_UI = 2
+};
+
+// Source taps of every output column or row: the first source pixel, how many follow and their weights ( 1/128 ),
+// taps weights per position. Bilinear up to a downscale of 2; beyond it a box over every pixel the position covers,
+// so small sinks do not alias.
+struct ResampleAxis
+{
+	std::vector<int> first, count, weights;
+	int taps = 0;
+};
+
+// One display of the composite
+struct OutputSink
+{
+	// Window name
+	std::string name;
+
+	// Output size, 0 x 0 for half the composite
+	cv::Size size;
+
+	bool mirror = false;
+	bool fullscreen = false;
+
+	// OutputOverlay flags
+	int overlays = 0;
+
+	// Latest output, BGR
+	cv::Mat image;
+
+	// Taps of every output column and row, built for one composite size
+	cv::Size source;
+	ResampleAxis columns, rows;
+};
+
+// Parse "name:WIDTHxHEIGHT[:mirror][:fullscreen][:skeleton][:ui]", false if it is malformed
+bool parseOutputSink(const std::string& spec, OutputSink& sink);
+
+// Produces every sink from one composite, each in a single pass that resamples, mirrors and
+// blends its overlays, with the rows of all sinks spread over worker threads
+class OutputRenderer
+{
+private:
+	std::vector<OutputSink> outputs;
+
+	// Job of the current frame
+	const cv::Mat* composite = nullptr;
+	const cv::Mat* overlayImages[2];
+
+	// First and last drawn column of every overlay row, empty rows have first > last
+	std::vector<int> firstDrawn[2], lastDrawn[2];
+
+	int bandCount = 0;
+	std::vector<std::pair<int, int>> bands;
+	std::atomic<int> nextBand;
+	int pending = 0;
+	unsigned long long generation = 0;
+
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+public:
+	// Constructor ( worker threads, 0 for the cores minus one, the caller also works )
+	explicit OutputRenderer(int threads = 0);
+
+	// Destructor
+	~OutputRenderer();
+
+	void addSink(const OutputSink& sink);
+	std::vector<OutputSink>& sinks() { return outputs; }
+
+	// OutputOverlay flags used by any sink
+	int overlays() const;
+
+	// Render every sink. The composite is BGR or BGRA; overlays are BGR of the same size where black is transparent,
+	// empty when not drawn. Returns once every sink is done.
+	void render(const cv::Mat& composite, const cv::Mat& skeleton, const cv::Mat& ui);
+
+private:
+	void run();
+	void work();
+	void renderBand(OutputSink& sink, int first, int last) const;
+	void findDrawn(const cv::Mat& overlay, std::vector<int>& first, std::vector<int>& last) const;
+
+	OutputRenderer(const OutputRenderer&);
+	OutputRenderer& operator=(const OutputRenderer&);
+};
+
+#endif // __OUTPUTS__
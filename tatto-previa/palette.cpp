@@ -0,0 +1,337 @@
+#include "palette.h"
+
+// Universal intrinsics, in their own module before OpenCV 3.2
+#if ( CV_MAJOR_VERSION > 3 || ( CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2 ) )
+#include <opencv2/core/hal/intrin.hpp>
+#else
+#include <opencv2/hal/intrin.hpp>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstring>
+
+// Colors are binned by their top 5 bits per channel
+static inline int colorBin(int b, int g, int r)
+{
+	return ((b >> 3) << 10) | ((g >> 3) << 5) | (r >> 3);
+}
+
+bool findPalette(const cv::Mat& image, TattooPalette& palette, int maxColors, int tolerance, double uncovered)
+{
+	palette = TattooPalette();
+	if (image.empty() || image.type() != CV_8UC4 || maxColors < 1){
+		return false;
+	}
+	maxColors = std::min(maxColors, 256);
+
+	// Alpha weighted histogram, with the weighted sum of the colors of every bin
+	std::vector<double> weight(32768, 0.), sumB(32768, 0.), sumG(32768, 0.), sumR(32768, 0.);
+	double total = 0;
+	for (int y = 0; y < image.rows; y++){
+		const uchar* px = image.ptr<uchar>(y);
+		for (int x = 0; x < image.cols; x++, px += 4){
+			const int a = px[3];
+			if (a == 0){
+				continue;
+			}
+			const int bin = colorBin(px[0], px[1], px[2]);
+			weight[bin] += a;
+			sumB[bin] += px[0] * a;
+			sumG[bin] += px[1] * a;
+			sumR[bin] += px[2] * a;
+			total += a;
+		}
+	}
+	if (total == 0){
+		return false;
+	}
+
+	// Mean color of every used bin
+	std::vector<int> bins;
+	std::vector<cv::Vec3d> means(32768);
+	for (int bin = 0; bin < 32768; bin++){
+		if (weight[bin] > 0){
+			bins.push_back(bin);
+			means[bin] = cv::Vec3d(sumB[bin], sumG[bin], sumR[bin]) / weight[bin];
+		}
+	}
+
+	// The heaviest bin left is the next ink, it takes every bin within tolerance
+	std::vector<cv::Vec3b> inks;
+	double left = total;
+	while (!bins.empty() && static_cast<int>(inks.size()) < maxColors){
+		const int heaviest = *std::max_element(bins.begin(), bins.end(), [&weight](int a, int b){ return weight[a] < weight[b]; });
+		const cv::Vec3d ink = means[heaviest];
+		inks.push_back(cv::Vec3b(cv::saturate_cast<uchar>(ink[0]), cv::saturate_cast<uchar>(ink[1]), cv::saturate_cast<uchar>(ink[2])));
+
+		std::vector<int> remaining;
+		for (const int bin : bins){
+			const cv::Vec3d& mean = means[bin];
+			const double distance = std::max(std::abs(mean[0] - ink[0]), std::max(std::abs(mean[1] - ink[1]), std::abs(mean[2] - ink[2])));
+			if (distance <= tolerance){
+				left -= weight[bin];
+			}
+			else {
+				remaining.push_back(bin);
+			}
+		}
+		bins.swap(remaining);
+	}
+	if (left > uncovered * total){
+		return false;
+	}
+
+	// Every ink at as many alpha levels as fit in 8 bits
+	palette.colors = static_cast<int>(inks.size());
+	palette.levels = 256 / palette.colors;
+	for (const auto& ink : inks){
+		for (int level = 0; level < palette.levels; level++){
+			const int alpha = palette.levels > 1 ? (level * 255 + (palette.levels - 1) / 2) / (palette.levels - 1) : 255;
+			palette.entries.push_back(cv::Vec4b(ink[0], ink[1], ink[2], static_cast<uchar>(alpha)));
+		}
+	}
+	return true;
+}
+
+void encodePalette(const cv::Mat& image, const TattooPalette& palette, cv::Mat& indices)
+{
+	CV_Assert(image.type() == CV_8UC4 && !palette.empty());
+
+	const int colors = palette.colors;
+	const int levels = palette.levels;
+	std::vector<cv::Vec3i> inks(colors);
+	for (int i = 0; i < colors; i++){
+		const cv::Vec4b& entry = palette.entries[i * levels];
+		inks[i] = cv::Vec3i(entry[0], entry[1], entry[2]);
+	}
+
+	// Opaque pixels take the ink nearest to the center of their bin
+	std::vector<uchar> nearest(32768);
+	for (int bin = 0; bin < 32768; bin++){
+		const cv::Vec3i color(((bin >> 10) << 3) + 4, (((bin >> 5) & 31) << 3) + 4, ((bin & 31) << 3) + 4);
+		int best = 0, bestDistance = INT_MAX;
+		for (int i = 0; i < colors; i++){
+			const cv::Vec3i d = color - inks[i];
+			const int distance = d.dot(d);
+			if (distance < bestDistance){
+				best = i;
+				bestDistance = distance;
+			}
+		}
+		nearest[bin] = static_cast<uchar>(best);
+	}
+
+	indices.create(image.size(), CV_8U);
+#pragma omp parallel for if (image.rows >= 256)
+	for (int y = 0; y < image.rows; y++){
+		const uchar* px = image.ptr<uchar>(y);
+		uchar* out = indices.ptr<uchar>(y);
+		for (int x = 0; x < image.cols; x++, px += 4){
+			const int a = px[3];
+			if (a == 0){
+				out[x] = 0;
+				continue;
+			}
+
+			int ink = nearest[colorBin(px[0], px[1], px[2])];
+			if (a < 255){
+				// Edges are either the ink at a lower alpha, or the ink averaged with transparent black by the
+				// projection and the mips; the nearer of the ink and the ink darkened by the alpha wins
+				int bestDistance = INT_MAX;
+				for (int i = 0; i < colors; i++){
+					const cv::Vec3i& c = inks[i];
+					const cv::Vec3i straight(px[0] - c[0], px[1] - c[1], px[2] - c[2]);
+					const cv::Vec3i darkened(px[0] - c[0] * a / 255, px[1] - c[1] * a / 255, px[2] - c[2] * a / 255);
+					const int distance = std::min(straight.dot(straight), darkened.dot(darkened));
+					if (distance < bestDistance){
+						ink = i;
+						bestDistance = distance;
+					}
+				}
+			}
+			out[x] = static_cast<uchar>(ink * levels + (a * (levels - 1) + 127) / 255);
+		}
+	}
+}
+
+void decodePalette(const cv::Mat& indices, const TattooPalette& palette, cv::Mat& image)
+{
+	CV_Assert(indices.type() == CV_8U && !palette.empty());
+
+	// Entries as one 32 bit BGRA word, indices past the palette decode as transparent
+	unsigned lut[256];
+	for (int i = 0; i < 256; i++){
+		const cv::Vec4b e = i < static_cast<int>(palette.entries.size()) ? palette.entries[i] : cv::Vec4b(0, 0, 0, 0);
+		std::memcpy(&lut[i], &e[0], 4);
+	}
+
+	image.create(indices.size(), CV_8UC4);
+	#pragma omp parallel for
+	for (int y = 0; y < indices.rows; y++){
+		const uchar* in = indices.ptr<uchar>(y);
+		unsigned* out = image.ptr<unsigned>(y);
+		int x = 0;
+#if CV_SIMD128
+		// Four pixels per store, the lookups stay scalar as OpenCV 3.1 has no gather
+		for (; x + 4 <= indices.cols; x += 4){
+			cv::v_store(out + x, cv::v_uint32x4(lut[in[x]], lut[in[x + 1]], lut[in[x + 2]], lut[in[x + 3]]));
+		}
+#endif
+		for (; x < indices.cols; x++){
+			out[x] = lut[in[x]];
+		}
+	}
+}
+
+// Cubic convolution weights of the 4 taps around a fraction, as OpenCV ( A = -0.75 )
+static inline void cubicWeights(float f, float* w)
+{
+	const float A = -.75f;
+	w[0] = ((A * (f + 1) - 5 * A) * (f + 1) + 8 * A) * (f + 1) - 4 * A;
+	w[1] = ((A + 2) * f - (A + 3)) * f * f + 1;
+	w[2] = ((A + 2) * (1 - f) - (A + 3)) * (1 - f) * (1 - f) + 1;
+	w[3] = 1.f - w[0] - w[1] - w[2];
+}
+
+// Sum of the taps of a pixel, each a palette entry premultiplied by its alpha ( b * a, g * a, r * a, a ),
+// so a tap is one multiply-add of the entry by its weight
+struct TapSum
+{
+#if CV_SIMD128
+	cv::v_float32x4 sum;
+
+	TapSum() : sum(cv::v_setzero_f32()) {}
+	inline void add(const float* entry, float weight) { sum = cv::v_muladd(cv::v_load(entry), cv::v_setall_f32(weight), sum); }
+	inline void get(float* out) const { cv::v_store(out, sum); }
+#else
+	float sum[4];
+
+	TapSum() { sum[0] = sum[1] = sum[2] = sum[3] = 0; }
+	inline void add(const float* entry, float weight) { for (int c = 0; c < 4; c++) sum[c] += entry[c] * weight; }
+	inline void get(float* out) const { std::copy(sum, sum + 4, out); }
+#endif
+};
+
+// Add the taps of one image around ( sx, sy ), entries of premultiplied 4 floats per index
+static inline void samplePalette(const cv::Mat& indices, double sx, double sy, int kind, const float* premultiplied, float weight, TapSum& taps)
+{
+	if (kind == 0){
+		const int x = cvRound(sx), y = cvRound(sy);
+		if (x >= 0 && y >= 0 && x < indices.cols && y < indices.rows){
+			taps.add(premultiplied + indices.ptr<uchar>(y)[x] * 4, weight);
+		}
+		return;
+	}
+
+	const int x0 = cvFloor(sx), y0 = cvFloor(sy);
+	const float fx = static_cast<float>(sx - x0), fy = static_cast<float>(sy - y0);
+	float wx[4], wy[4];
+	int first, count;
+	if (kind == 1){
+		first = 0;
+		count = 2;
+		wx[0] = 1 - fx;
+		wx[1] = fx;
+		wy[0] = 1 - fy;
+		wy[1] = fy;
+	}
+	else {
+		first = -1;
+		count = 4;
+		cubicWeights(fx, wx);
+		cubicWeights(fy, wy);
+	}
+
+	for (int j = 0; j < count; j++){
+		const int y = y0 + first + j;
+		if (y < 0 || y >= indices.rows){
+			continue;
+		}
+		const uchar* row = indices.ptr<uchar>(y);
+		const float rowWeight = weight * wy[j];
+		for (int i = 0; i < count; i++){
+			const int x = x0 + first + i;
+			if (x < 0 || x >= indices.cols){
+				continue;
+			}
+			taps.add(premultiplied + row[x] * 4, rowWeight * wx[i]);
+		}
+	}
+}
+
+// Output pixel of the source position ( sx, sy ), transparent outside the source
+static inline cv::Vec4b palettePixel(const cv::Mat& indices, const cv::Mat& second, bool mix, float t, int kind, const float* premultiplied, double sx, double sy)
+{
+	if (sx < -2 || sy < -2 || sx > indices.cols + 1 || sy > indices.rows + 1){
+		return cv::Vec4b(0, 0, 0, 0);
+	}
+
+	TapSum taps;
+	samplePalette(indices, sx, sy, kind, premultiplied, mix ? 1 - t : 1, taps);
+	if (mix){
+		samplePalette(second, sx, sy, kind, premultiplied, t, taps);
+	}
+
+	// Back to straight alpha
+	float acc[4];
+	taps.get(acc);
+	const float alpha = acc[3];
+	if (alpha < .5f){
+		return cv::Vec4b(0, 0, 0, 0);
+	}
+	const float inverse = 1.f / alpha;
+	return cv::Vec4b(cv::saturate_cast<uchar>(acc[0] * inverse), cv::saturate_cast<uchar>(acc[1] * inverse),
+		cv::saturate_cast<uchar>(acc[2] * inverse), cv::saturate_cast<uchar>(alpha));
+}
+
+void warpPalette(const cv::Mat& indices, const cv::Mat& second, float t, const TattooPalette& palette, const cv::Matx33d& map, const cv::Size& size, int interpolation, cv::Mat& output)
+{
+	CV_Assert(indices.type() == CV_8U && !palette.empty());
+	output.create(size, CV_8UC4);
+
+	const bool mix = t > 0 && !second.empty() && second.size() == indices.size() && second.type() == CV_8U;
+	const int kind = interpolation == cv::INTER_NEAREST ? 0 : interpolation == cv::INTER_LINEAR ? 1 : 2;
+
+	// Entries premultiplied once, indices past the palette decode as transparent
+	float premultiplied[256 * 4];
+	for (int i = 0; i < 256; i++){
+		const cv::Vec4b e = i < static_cast<int>(palette.entries.size()) ? palette.entries[i] : cv::Vec4b(0, 0, 0, 0);
+		for (int c = 0; c < 3; c++){
+			premultiplied[i * 4 + c] = static_cast<float>(e[c] * e[3]);
+		}
+		premultiplied[i * 4 + 3] = e[3];
+	}
+
+	// Rotations and scales invert to an affine map ( up to rounding in the last row ): the source position
+	// steps by a constant along the row, without a divide per pixel
+	const bool affine = std::abs(map(2, 0)) < 1e-12 && std::abs(map(2, 1)) < 1e-12 && map(2, 2) > 0;
+	const cv::Matx33d step = affine ? map * (1. / map(2, 2)) : map;
+
+#pragma omp parallel for
+	for (int y = 0; y < size.height; y++){
+		cv::Vec4b* out = output.ptr<cv::Vec4b>(y);
+		if (affine){
+			double sx = step(0, 1) * y + step(0, 2);
+			double sy = step(1, 1) * y + step(1, 2);
+			for (int x = 0; x < size.width; x++){
+				out[x] = palettePixel(indices, second, mix, t, kind, premultiplied, sx, sy);
+				sx += step(0, 0);
+				sy += step(1, 0);
+			}
+			continue;
+		}
+
+		for (int x = 0; x < size.width; x++){
+			const double w = map(2, 0) * x + map(2, 1) * y + map(2, 2);
+			if (w <= 0){
+				out[x] = cv::Vec4b(0, 0, 0, 0);
+				continue;
+			}
+			const double sx = (map(0, 0) * x + map(0, 1) * y + map(0, 2)) / w;
+			const double sy = (map(1, 0) * x + map(1, 1) * y + map(1, 2)) / w;
+			out[x] = palettePixel(indices, second, mix, t, kind, premultiplied, sx, sy);
+		}
+	}
+}
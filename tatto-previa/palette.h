@@ -0,0 +1,34 @@
+#ifndef __PALETTE__
+#define __PALETTE__
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+// Line art has a handful of ink colors, its edges only vary the alpha. Such a tattoo is stored as 8-bit
+// indices into a palette of every ink color at levels = 256 / colors alpha levels, a quarter of BGRA.
+// Photos and gradients have no such palette and stay BGRA.
+struct TattooPalette
+{
+	// BGRA of index color * levels + level
+	std::vector<cv::Vec4b> entries;
+	int colors = 0;
+	int levels = 0;
+
+	bool empty() const { return entries.empty(); }
+};
+
+// Find the palette of a BGRA image: up to maxColors inks, each taking the pixels within tolerance of it
+// ( per channel ). False when the inks leave more than uncovered of the alpha weighted pixels out.
+bool findPalette(const cv::Mat& image, TattooPalette& palette, int maxColors = 16, int tolerance = 24, double uncovered = .005);
+
+// Index of the nearest entry of every pixel of a BGRA image, and back
+void encodePalette(const cv::Mat& image, const TattooPalette& palette, cv::Mat& indices);
+void decodePalette(const cv::Mat& indices, const TattooPalette& palette, cv::Mat& image);
+
+// Warp indexed images into a BGRA output of size, map takes output pixels to source pixels. Every tap decodes
+// its palette entry, so nothing is decoded that is not sampled. With a second image of the same size the two
+// are mixed, t of the second. Nearest and linear interpolation as asked, anything else is cubic.
+void warpPalette(const cv::Mat& indices, const cv::Mat& second, float t, const TattooPalette& palette, const cv::Matx33d& map, const cv::Size& size, int interpolation, cv::Mat& output);
+
+#endif // __PALETTE__
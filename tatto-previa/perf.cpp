@@ -0,0 +1,237 @@
+#include "perf.h"
+
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+PerfCounters::PerfCounters()
+{
+	for (auto& fd : fds){
+		fd = -1;
+	}
+}
+
+PerfCounters::~PerfCounters()
+{
+	close();
+}
+
+#ifdef __linux__
+
+static int openCounter(uint32_t type, uint64_t config, int group)
+{
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group < 0 ? 1 : 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+
+	// This thread, any CPU
+	return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+}
+
+bool PerfCounters::open()
+{
+	close();
+
+	const uint64_t configs[4] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+	for (int i = 0; i < 4; i++){
+		fds[i] = openCounter(PERF_TYPE_HARDWARE, configs[i], i == 0 ? -1 : fds[0]);
+		if (fds[i] < 0){
+			close();
+			return false;
+		}
+		opened++;
+	}
+
+	ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+}
+
+void PerfCounters::close()
+{
+	for (int i = 3; i >= 0; i--){
+		if (fds[i] >= 0){
+			::close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+	opened = 0;
+}
+
+bool PerfCounters::read(PerfSample& sample) const
+{
+	if (!available()){
+		return false;
+	}
+
+	// nr, then one value per counter in group order
+	uint64_t values[5];
+	if (::read(fds[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)) || values[0] != 4){
+		return false;
+	}
+
+	sample.cycles = values[1];
+	sample.instructions = values[2];
+	sample.cacheMisses = values[3];
+	sample.branchMisses = values[4];
+	return true;
+}
+
+#else
+
+bool PerfCounters::open()
+{
+	return false;
+}
+
+void PerfCounters::close()
+{
+	opened = 0;
+}
+
+bool PerfCounters::read(PerfSample&) const
+{
+	return false;
+}
+
+#endif
+
+// Constructor
+PerfProfiler::PerfProfiler(bool count)
+{
+	if (count){
+		counters.open();
+	}
+}
+
+void PerfProfiler::begin()
+{
+	PerfSample sample = {};
+	counters.read(sample);
+	open.push_back(sample);
+}
+
+void PerfProfiler::end(const char* name, double ms)
+{
+	if (open.empty()){
+		return;
+	}
+
+	PerfSample sample = {};
+	const bool counted = counters.read(sample);
+	const PerfSample start = open.back();
+	open.pop_back();
+
+	StageTotals& stage = totals(name);
+	stage.calls++;
+	stage.ms += ms;
+	if (counted){
+		stage.counters.cycles += sample.cycles - start.cycles;
+		stage.counters.instructions += sample.instructions - start.instructions;
+		stage.counters.cacheMisses += sample.cacheMisses - start.cacheMisses;
+		stage.counters.branchMisses += sample.branchMisses - start.branchMisses;
+	}
+}
+
+PerfProfiler::StageTotals& PerfProfiler::totals(const std::string& name)
+{
+	for (auto& stage : stages){
+		if (stage.name == name){
+			return stage;
+		}
+	}
+
+	StageTotals stage = {};
+	stage.name = name;
+	stages.push_back(stage);
+	return stages.back();
+}
+
+void PerfProfiler::merge(const PerfProfiler& other)
+{
+	for (const auto& from : other.stages){
+		StageTotals& stage = totals(from.name);
+		stage.calls += from.calls;
+		stage.ms += from.ms;
+		stage.counters.cycles += from.counters.cycles;
+		stage.counters.instructions += from.counters.instructions;
+		stage.counters.cacheMisses += from.counters.cacheMisses;
+		stage.counters.branchMisses += from.counters.branchMisses;
+	}
+	mergedHardware = mergedHardware || other.hardware();
+}
+
+void PerfProfiler::report(std::ostream& out) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(3);
+
+	if (!hardware()){
+		out << "perf: hardware counters unavailable, timers only" << std::endl;
+	}
+	else {
+		out << "perf: main thread only, the counters of a stage leave out the OpenMP and OpenCV threads it started" << std::endl;
+	}
+
+	out << std::left << std::setw(12) << "stage" << std::right << std::setw(8) << "calls" << std::setw(10) << "ms/call";
+	if (hardware()){
+		out << std::setw(14) << "cycles/call" << std::setw(8) << "IPC" << std::setw(14) << "LLC miss/call" << std::setw(8) << "MPKI" << std::setw(14) << "br miss/call";
+	}
+	out << std::endl;
+
+	for (const auto& stage : stages){
+		const double calls = static_cast<double>(stage.calls);
+		out << std::left << std::setw(12) << stage.name << std::right << std::setw(8) << stage.calls << std::setw(10) << stage.ms / calls;
+		if (hardware()){
+			const PerfSample& c = stage.counters;
+
+			// Low IPC with many misses per kilo instruction means the stage waits on memory
+			const double ipc = c.cycles > 0 ? static_cast<double>(c.instructions) / c.cycles : 0;
+			const double mpki = c.instructions > 0 ? 1000. * c.cacheMisses / c.instructions : 0;
+			out << std::setw(14) << std::setprecision(0) << c.cycles / calls
+				<< std::setw(8) << std::setprecision(2) << ipc
+				<< std::setw(14) << std::setprecision(0) << c.cacheMisses / calls
+				<< std::setw(8) << std::setprecision(2) << mpki
+				<< std::setw(14) << std::setprecision(0) << c.branchMisses / calls
+				<< std::setprecision(3);
+		}
+		out << std::endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void PerfProfiler::reset()
+{
+	stages.clear();
+	open.clear();
+}
+
+PerfStage::PerfStage(PerfProfiler* profiler, const char* name)
+	: profiler(profiler), name(name), start(std::chrono::steady_clock::now())
+{
+	if (profiler != nullptr){
+		profiler->begin();
+	}
+}
+
+PerfStage::~PerfStage()
+{
+	if (profiler != nullptr){
+		profiler->end(name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+}
@@ -0,0 +1,109 @@
+#ifndef __PERF__
+#define __PERF__
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Hardware counters of the calling thread
+struct PerfSample
+{
+	uint64_t cycles;
+	uint64_t instructions;
+	uint64_t cacheMisses;
+	uint64_t branchMisses;
+};
+
+// cycles, instructions, last level cache misses and branch misses through perf_event_open.
+// Only on Linux; elsewhere, or without permission, open() fails and nothing is counted.
+class PerfCounters
+{
+private:
+	// Group leader first
+	int fds[4];
+	int opened = 0;
+
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	// Open and start the counters for the calling thread
+	bool open();
+	void close();
+	bool available() const { return opened == 4; }
+
+	// Current totals, one read for the whole group
+	bool read(PerfSample& sample) const;
+
+private:
+	PerfCounters(const PerfCounters&);
+	PerfCounters& operator=(const PerfCounters&);
+};
+
+// Totals of the pipeline stages, with hardware counters when available. The counters are of the thread
+// running a stage: the OpenMP and OpenCV threads it starts are left out, so its time is wall clock and
+// its cycles undercount a parallel stage.
+class PerfProfiler
+{
+private:
+	struct StageTotals
+	{
+		std::string name;
+		unsigned long long calls;
+		double ms;
+		PerfSample counters;
+	};
+
+	PerfCounters counters;
+	std::vector<StageTotals> stages;
+
+	// Merged totals of another profiler that had the counters
+	bool mergedHardware = false;
+
+	// Samples at the start of the open stages, stages may nest
+	std::vector<PerfSample> open;
+
+public:
+	// Try the hardware counters, timers only when they are unavailable or not wanted ( totals merged from other threads )
+	explicit PerfProfiler(bool count = true);
+
+	bool hardware() const { return counters.available() || mergedHardware; }
+
+	// Mark the start and the end of a stage, on the thread that opened the profiler
+	void begin();
+	void end(const char* name, double ms);
+
+	// Add the totals of the profiler of another thread
+	void merge(const PerfProfiler& other);
+
+	// Per stage table: calls, ms, cycles, IPC, cache and branch misses per call.
+	// Counters are those of the thread that ran each stage, not of the OpenMP or OpenCV threads it started.
+	void report(std::ostream& out) const;
+
+	// Forget the totals
+	void reset();
+
+private:
+	StageTotals& totals(const std::string& name);
+};
+
+// Profiles a stage for as long as it lives, nothing without a profiler
+class PerfStage
+{
+private:
+	PerfProfiler* profiler;
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	PerfStage(PerfProfiler* profiler, const char* name);
+	~PerfStage();
+
+private:
+	PerfStage(const PerfStage&);
+	PerfStage& operator=(const PerfStage&);
+};
+
+#endif // __PERF__
@@ -0,0 +1,18 @@
+#ifndef __POOL__
+#define __POOL__
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// A thread of a pool that already fills the cores keeps its OpenMP loops serial, otherwise every job
+// would start a team of its own and about cores x cores threads would fight over the cores.
+// Only affects the calling thread; OpenCV's own threads are process wide ( cv::setNumThreads ).
+inline void serialPoolThread()
+{
+#ifdef _OPENMP
+	omp_set_num_threads(1);
+#endif
+}
+
+#endif // __POOL__
@@ -0,0 +1,111 @@
+#include "quality.h"
+
+#include <algorithm>
+#include <iterator>
+
+// Tiers from the highest quality down
+static const QualityTier defaultTiers[] =
+{
+	// name       warp               rotate              bilinear mip   line         skeleton
+	{ "high",    cv::INTER_CUBIC,   cv::INTER_LANCZOS4, true,    0.f,  cv::LINE_AA, true },
+	{ "medium",  cv::INTER_LINEAR,  cv::INTER_CUBIC,    true,    .5f,  cv::LINE_AA, true },
+	{ "low",     cv::INTER_LINEAR,  cv::INTER_LINEAR,   true,    1.f,  cv::LINE_8,  true },
+	{ "minimal", cv::INTER_NEAREST, cv::INTER_LINEAR,   false,   1.5f, cv::LINE_8,  false }
+};
+
+// Constructor
+QualityGovernor::QualityGovernor(double targetFps)
+	: tiers(std::begin(defaultTiers), std::end(defaultTiers)), current(0)
+{
+	setTargetFps(targetFps);
+}
+
+void QualityGovernor::setTargetFps(double fps)
+{
+	budgetMs = 1000. / std::max(1., fps);
+}
+
+void QualityGovernor::addStage(const char* name, double ms)
+{
+	frameMs += ms;
+
+	for (auto& stage : stages){
+		if (stage.first == name){
+			stage.second += (ms - stage.second) * .1;
+			return;
+		}
+	}
+	stages.push_back(std::make_pair(std::string(name), ms));
+}
+
+void QualityGovernor::endFrame()
+{
+	// Exponential moving average, so single slow frames do not switch tiers
+	averageMs = frame == 0 ? frameMs : averageMs + (frameMs - averageMs) * .2;
+	frameMs = 0;
+	frame++;
+
+	if (averageMs > budgetMs){
+		overCount++;
+		underCount = 0;
+	}
+	else if (averageMs < budgetMs * upHeadroom){
+		underCount++;
+		overCount = 0;
+	}
+	else {
+		overCount = 0;
+		underCount = 0;
+	}
+
+	if (overCount >= downFrames && current + 1 < levels()){
+		change(current + 1);
+	}
+	else if (underCount >= upFrames && current > 0){
+		change(current - 1);
+	}
+}
+
+void QualityGovernor::change(int to)
+{
+	QualityDecision decision;
+	decision.frame = frame;
+	decision.from = current;
+	decision.to = to;
+	decision.frameMs = averageMs;
+	decision.budgetMs = budgetMs;
+
+	history.push_back(decision);
+	if (history.size() > 64){
+		history.pop_front();
+	}
+	newDecisions = std::min(newDecisions + 1, history.size());
+
+	current = to;
+	overCount = 0;
+	underCount = 0;
+}
+
+std::vector<QualityDecision> QualityGovernor::takeDecisions()
+{
+	std::vector<QualityDecision> recent(history.end() - newDecisions, history.end());
+	newDecisions = 0;
+	return recent;
+}
+
+QualityGovernor::Stage::Stage(QualityGovernor& governor, const char* name)
+	: governor(governor), name(name), start(std::chrono::steady_clock::now())
+{
+	if (governor.profiler != nullptr){
+		governor.profiler->begin();
+	}
+}
+
+QualityGovernor::Stage::~Stage()
+{
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	governor.addStage(name, elapsed.count());
+	if (governor.profiler != nullptr){
+		governor.profiler->end(name, elapsed.count());
+	}
+}
@@ -0,0 +1,130 @@
+#ifndef __QUALITY__
+#define __QUALITY__
+
+#include "perf.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+// Settings of one quality level
+struct QualityTier
+{
+	const char* name;
+
+	// Interpolation of the per-frame tattoo warp
+	int warpInterpolation;
+
+	// Interpolation of the perspective rotation
+	int rotateInterpolation;
+
+	// Bilinear ( true ) or nearest ( false ) sampling in the cylinder projection
+	bool bilinearProjection;
+
+	// Added to the mip level picked from the tattoo scale
+	float mipBias;
+
+	// Line type of overlays
+	int lineType;
+
+	// Draw the skeleton overlay
+	bool drawSkeleton;
+};
+
+// A tier change, kept for logging
+struct QualityDecision
+{
+	long long frame;
+	int from;
+	int to;
+	double frameMs;
+	double budgetMs;
+};
+
+// Steps quality tiers up or down to hold a target frame rate
+class QualityGovernor
+{
+private:
+	std::vector<QualityTier> tiers;
+	std::atomic<int> current;
+
+	double budgetMs;
+
+	// Smoothed work time of a frame
+	double averageMs = 0;
+	double frameMs = 0;
+	long long frame = 0;
+
+	// Hysteresis: frames in a row over budget before stepping down,
+	// and under budget * upHeadroom before stepping up
+	int downFrames = 5;
+	int upFrames = 90;
+	double upHeadroom = .7;
+	int overCount = 0;
+	int underCount = 0;
+
+	// Per stage smoothed time
+	std::vector<std::pair<std::string, double>> stages;
+
+	std::deque<QualityDecision> history;
+	size_t newDecisions = 0;
+
+	// Also gets every stage when set
+	PerfProfiler* profiler = nullptr;
+
+public:
+	// Constructor
+	explicit QualityGovernor(double targetFps = 30.);
+
+	// Current tier, 0 is the highest quality
+	int level() const { return current; }
+	const QualityTier& tier() const { return tiers[current]; }
+	const QualityTier& tier(int i) const { return tiers[i]; }
+	int levels() const { return static_cast<int>(tiers.size()); }
+
+	// Change the frame rate to hold
+	void setTargetFps(double fps);
+
+	// Record the time of a stage of the current frame
+	void addStage(const char* name, double ms);
+
+	// Report every stage to a profiler too, null to stop
+	void setProfiler(PerfProfiler* stageProfiler) { profiler = stageProfiler; }
+
+	// Close the frame and step the tier if needed
+	void endFrame();
+
+	// Smoothed stage times ( ms )
+	const std::vector<std::pair<std::string, double>>& stageTimes() const { return stages; }
+
+	// Smoothed frame work time ( ms )
+	double averageFrameMs() const { return averageMs; }
+
+	// Recent decisions, oldest first
+	const std::deque<QualityDecision>& decisions() const { return history; }
+
+	// Decisions since the last call, for logging
+	std::vector<QualityDecision> takeDecisions();
+
+	// Times a stage for as long as it lives
+	class Stage
+	{
+	private:
+		QualityGovernor& governor;
+		const char* name;
+		std::chrono::steady_clock::time_point start;
+
+	public:
+		Stage(QualityGovernor& governor, const char* name);
+		~Stage();
+	};
+
+private:
+	void change(int to);
+};
+
+#endif // __QUALITY__
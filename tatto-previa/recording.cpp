@@ -0,0 +1,162 @@
+#include "recording.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+
+// Constructor
+SessionWriter::SessionWriter(const std::string& directory, const std::string& extension, size_t capacity)
+	: directory(directory), extension(extension), capacity(capacity < 1 ? 1 : capacity)
+{
+	// Start the index files empty
+	std::ofstream(directory + "/frames.txt", std::ios::trunc);
+	std::ofstream(directory + "/joints.txt", std::ios::trunc);
+
+	worker = std::thread(&SessionWriter::run, this);
+}
+
+// Destructor
+SessionWriter::~SessionWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	ready.notify_one();
+	worker.join();
+}
+
+bool SessionWriter::write(const cv::Mat& image, int64_t timestampUs, const JointBuffer& joints)
+{
+	// Format the joints here, the buffer is overwritten by the next frame
+	std::ostringstream lines;
+	lines << std::setprecision(7);
+	for (int body = 0; body < SkeletonBodyCount; body++){
+		if (!joints.tracked[body]){
+			continue;
+		}
+
+		lines << "{frame} " << body;
+		for (int joint = 0; joint < SkeletonJointCount; joint++){
+			const int slot = body * SkeletonJointCount + joint;
+			lines << ' ' << static_cast<int>(joints.state[slot])
+				<< ' ' << joints.x[slot] << ' ' << joints.y[slot] << ' ' << joints.z[slot]
+				<< ' ' << joints.u[slot] << ' ' << joints.v[slot]
+				<< ' ' << joints.qx[slot] << ' ' << joints.qy[slot] << ' ' << joints.qz[slot] << ' ' << joints.qw[slot];
+		}
+		lines << '\n';
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (queue.size() >= capacity){
+		dropped++;
+		return false;
+	}
+
+	Pending pending;
+	pending.index = frames++;
+	pending.timestampUs = timestampUs;
+	pending.image = image.clone();
+	pending.joints = lines.str();
+	queue.push_back(pending);
+	ready.notify_one();
+	return true;
+}
+
+void SessionWriter::run()
+{
+	std::ofstream framesFile(directory + "/frames.txt", std::ios::app);
+	std::ofstream jointsFile(directory + "/joints.txt", std::ios::app);
+
+	while (true){
+		Pending pending;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [this]{ return stopping || !queue.empty(); });
+			if (queue.empty()){
+				return;
+			}
+			pending = queue.front();
+			queue.pop_front();
+		}
+
+		std::ostringstream name;
+		name << "color_" << std::setw(6) << std::setfill('0') << pending.index << extension;
+		cv::imwrite(directory + "/" + name.str(), pending.image);
+
+		framesFile << pending.index << ' ' << pending.timestampUs << ' ' << name.str() << '\n';
+
+		// Fill in the frame number of every body line
+		std::string joints = pending.joints;
+		const std::string placeholder = "{frame}";
+		const std::string index = std::to_string(pending.index);
+		for (size_t at = joints.find(placeholder); at != std::string::npos; at = joints.find(placeholder, at)){
+			joints.replace(at, placeholder.size(), index);
+		}
+		jointsFile << joints;
+
+		framesFile.flush();
+		jointsFile.flush();
+	}
+}
+
+std::vector<SessionFrame> readSession(const std::string& directory)
+{
+	std::ifstream framesFile(directory + "/frames.txt");
+	if (!framesFile){
+		throw std::runtime_error("Could not read " + directory + "/frames.txt");
+	}
+
+	std::vector<SessionFrame> frames;
+	std::map<int, size_t> byIndex;
+
+	std::string line;
+	while (std::getline(framesFile, line)){
+		std::istringstream fields(line);
+		SessionFrame frame;
+		if (!(fields >> frame.index >> frame.timestampUs >> frame.image)){
+			continue;
+		}
+		frame.image = directory + "/" + frame.image;
+		frame.joints.clear();
+
+		byIndex[frame.index] = frames.size();
+		frames.push_back(frame);
+	}
+
+	// Joints are optional, frames without bodies render without a tattoo
+	std::ifstream jointsFile(directory + "/joints.txt");
+	while (std::getline(jointsFile, line)){
+		std::istringstream fields(line);
+		int index, body;
+		if (!(fields >> index >> body) || body < 0 || body >= SkeletonBodyCount){
+			continue;
+		}
+
+		const std::map<int, size_t>::const_iterator found = byIndex.find(index);
+		if (found == byIndex.end()){
+			continue;
+		}
+
+		JointBuffer& joints = frames[found->second].joints;
+		bool complete = true;
+		for (int joint = 0; joint < SkeletonJointCount && complete; joint++){
+			const int slot = body * SkeletonJointCount + joint;
+			int state;
+			complete = static_cast<bool>(fields >> state
+				>> joints.x[slot] >> joints.y[slot] >> joints.z[slot]
+				>> joints.u[slot] >> joints.v[slot]
+				>> joints.qx[slot] >> joints.qy[slot] >> joints.qz[slot] >> joints.qw[slot]);
+			joints.state[slot] = static_cast<unsigned char>(state);
+		}
+
+		if (!complete){
+			throw std::runtime_error("Truncated body in " + directory + "/joints.txt: " + line);
+		}
+		joints.tracked[body] = true;
+	}
+
+	return frames;
+}
@@ -0,0 +1,78 @@
+#ifndef __RECORDING__
+#define __RECORDING__
+
+#include "skeleton.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+
+// A recorded session is a directory with
+//   frames.txt  "<frame> <timestampUs> <image file>" per frame
+//   joints.txt  "<frame> <body> ( <state> <x> <y> <z> <u> <v> <qx> <qy> <qz> <qw> ) x 25" per tracked body
+// and the color images
+
+// A frame of a recorded session
+struct SessionFrame
+{
+	int index;
+	int64_t timestampUs;
+	std::string image;
+	JointBuffer joints;
+};
+
+// Records color frames and joints to a session directory on a background thread
+class SessionWriter
+{
+private:
+	struct Pending
+	{
+		int index;
+		int64_t timestampUs;
+		cv::Mat image;
+		std::string joints;
+	};
+
+	std::string directory;
+	std::string extension;
+	size_t capacity;
+
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::deque<Pending> queue;
+	bool stopping = false;
+	std::thread worker;
+
+	int frames = 0;
+	int dropped = 0;
+
+public:
+	// Constructor ( existing directory, image extension, frames waiting to be written )
+	explicit SessionWriter(const std::string& directory, const std::string& extension = ".jpg", size_t capacity = 8);
+
+	// Destructor, writes the frames still queued
+	~SessionWriter();
+
+	// Queue a frame, dropped when the writer is behind
+	bool write(const cv::Mat& image, int64_t timestampUs, const JointBuffer& joints);
+
+	int written() const { return frames; }
+	int droppedFrames() const { return dropped; }
+
+private:
+	void run();
+
+	SessionWriter(const SessionWriter&);
+	SessionWriter& operator=(const SessionWriter&);
+};
+
+// Read the frames of a recorded session, throws if the session can not be read
+std::vector<SessionFrame> readSession(const std::string& directory);
+
+#endif // __RECORDING__
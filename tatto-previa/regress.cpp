@@ -0,0 +1,371 @@
+#include "regress.h"
+#include "renderer.h"
+#include "compositor.h"
+#include "spans.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+// Frames of syntheticJoints every tattoo is rendered at
+static const int regressionPoses[] = { 0, 6, 12 };
+
+// Gradient frame the tattoos are rendered over
+static cv::Mat regressionFrame()
+{
+	cv::Mat frame(480, 640, CV_8UC3);
+	for (int y = 0; y < frame.rows; y++){
+		for (int x = 0; x < frame.cols; x++){
+			frame.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<uchar>(x / 3), static_cast<uchar>(y / 2), 120);
+		}
+	}
+	return frame;
+}
+
+// File name without directory and extension
+static std::string stem(const std::string& path)
+{
+	const size_t slash = path.find_last_of("/\\");
+	const std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+// PSNR of image against golden over the pixels either of them changed from the background, infinite when equal
+static double maskedPsnr(const cv::Mat& image, const cv::Mat& golden, const cv::Mat& background)
+{
+	double sum = 0;
+	long long count = 0;
+	for (int y = 0; y < image.rows; y++){
+		const cv::Vec3b* a = image.ptr<cv::Vec3b>(y);
+		const cv::Vec3b* g = golden.ptr<cv::Vec3b>(y);
+		const cv::Vec3b* b = background.ptr<cv::Vec3b>(y);
+		for (int x = 0; x < image.cols; x++){
+			if (a[x] != b[x] || g[x] != b[x]){
+				for (int c = 0; c < 3; c++){
+					const double d = a[x][c] - g[x][c];
+					sum += d * d;
+				}
+				count += 3;
+			}
+		}
+	}
+	if (sum == 0){
+		return std::numeric_limits<double>::infinity();
+	}
+	return 10. * std::log10(255. * 255. * count / sum);
+}
+
+// Best of a few runs ( milliseconds ), the one least disturbed by the rest of the machine
+template <typename Work>
+static double bestOf(int runs, Work work)
+{
+	double best = std::numeric_limits<double>::infinity();
+	for (int i = 0; i < runs; i++){
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		work();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+// Fixed workload the stages are measured in, so the committed ratios hold on a faster or slower machine
+static double calibrate()
+{
+	cv::Mat noise(512, 512, CV_8UC4);
+	cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(256));
+	cv::Mat blurred;
+	return bestOf(5, [&](){
+		for (int i = 0; i < 4; i++){
+			cv::GaussianBlur(noise, blurred, cv::Size(9, 9), 0);
+		}
+	});
+}
+
+// The compositor's blend in floating point: a tattoo centered at location, its ink following the brightness of the
+// frame around each pixel over the mean of the area the tattoo lights, box means clipped to that area
+static void referenceBlend(cv::Mat& frame, const cv::Mat& image, const cv::Point& location, double opacity, double shading)
+{
+	const cv::Rect area(location.x - image.cols / 2, location.y - image.rows / 2, image.cols, image.rows);
+	const int r = std::max(2, std::min(area.width, area.height) / 16);
+	const cv::Rect lit = cv::Rect(area.x - r, area.y - r, area.width + r * 2, area.height + r * 2) & cv::Rect(0, 0, frame.cols, frame.rows);
+	if (lit.area() == 0){
+		return;
+	}
+
+	cv::Mat gray, sums, counts;
+	cv::cvtColor(frame(lit), gray, cv::COLOR_BGR2GRAY);
+	gray.convertTo(gray, CV_32F);
+	const cv::Size box(r * 2 + 1, r * 2 + 1);
+	cv::boxFilter(gray, sums, CV_32F, box, cv::Point(-1, -1), false, cv::BORDER_CONSTANT);
+	cv::boxFilter(cv::Mat::ones(lit.size(), CV_32F), counts, CV_32F, box, cv::Point(-1, -1), false, cv::BORDER_CONSTANT);
+	const double mean = cv::mean(gray)[0];
+
+	for (int y = std::max(area.y, 0); y < std::min(area.y + area.height, frame.rows); y++){
+		const cv::Vec4b* src = image.ptr<cv::Vec4b>(y - area.y);
+		cv::Vec3b* dst = frame.ptr<cv::Vec3b>(y);
+		for (int x = std::max(area.x, 0); x < std::min(area.x + area.width, frame.cols); x++){
+			const cv::Vec4b& ink = src[x - area.x];
+			const double alpha = ink[3] / 255. * opacity;
+			const double ratio = mean > 0 ? sums.at<float>(y - lit.y, x - lit.x) / counts.at<float>(y - lit.y, x - lit.x) / mean : 1;
+			const double gain = std::max(0., std::min(2., 1 + shading * (ratio - 1)));
+			for (int c = 0; c < 3; c++){
+				dst[x][c] = cv::saturate_cast<uchar>(std::min(255., ink[c] * gain) * alpha + dst[x][c] * (1 - alpha));
+			}
+		}
+	}
+}
+
+// Render a golden frame with the reference path, placed by the renderer ( which keeps the radius smoothing ) but not blended by it
+static void renderReference(TattooRenderer& renderer, const PreparedTattoo& tattoo, const JointBuffer& joints, cv::Mat& frame)
+{
+	std::unique_ptr<BoneFrames> bones(new BoneFrames);
+	computeBoneFrames(joints, *bones);
+	const RendererSettings& settings = renderer.settings();
+	AnchorPose pose;
+	if (!resolveAnchor(*bones, settings.anchor, pose)){
+		return;
+	}
+
+	PlacedTattoo placed;
+	const int radiusStep = renderer.smoothRadius(tattoo, pose, limbRadius(settings.anchor, pose));
+	if (renderer.place(tattoo, 1, pose, radiusStep, 0, 1., placed)){
+		referenceBlend(frame, placed.image, placed.location, settings.opacity, settings.shading);
+	}
+}
+
+// Stage ratios of a timings file, "<stage> <ratio>" per line, # starts a comment
+static std::map<std::string, double> readTimings(const std::string& file)
+{
+	std::map<std::string, double> ratios;
+	std::ifstream in(file);
+	std::string line;
+	while (std::getline(in, line)){
+		std::istringstream fields(line.substr(0, line.find('#')));
+		std::string stage;
+		double ratio;
+		if (fields >> stage >> ratio){
+			ratios[stage] = ratio;
+		}
+	}
+	return ratios;
+}
+
+bool runRegression(const RegressionOptions& options, std::ostream& log)
+{
+	std::vector<std::string> files, vectors;
+	cv::glob(options.images + "/*.png", files);
+	cv::glob(options.images + "/*.svg", vectors);
+	files.insert(files.end(), vectors.begin(), vectors.end());
+	std::sort(files.begin(), files.end());
+
+	// Sources read once, the projection stage is timed from them; images without alpha are not tattoos
+	std::vector<std::string> names;
+	std::vector<cv::Mat> sources;
+	std::vector<TattooHandle> tattoos;
+	for (const auto& file : files){
+		const cv::Mat source = isVectorTattoo(file) ? rasterizeVector(*readVectorTattoo(file), 300) : cv::imread(file, -1);
+		if (source.empty()){
+			log << "regress: cannot read " << file << std::endl;
+			return false;
+		}
+		if (source.channels() != 4){
+			log << "regress: " << file << " is not BGRA, skipped" << std::endl;
+			continue;
+		}
+		names.push_back(stem(file));
+		sources.push_back(source);
+		tattoos.push_back(makeTattooHandle(source));
+	}
+	if (tattoos.empty()){
+		log << "regress: no tattoos in " << options.images << std::endl;
+		return false;
+	}
+
+	const cv::Mat background = regressionFrame();
+	bool ok = true;
+	int compared = 0, failed = 0;
+	double worst = std::numeric_limits<double>::infinity();
+
+	// Golden images: every tattoo flat and foreshortened at every pose, the poses in order on one renderer
+	for (size_t t = 0; t < tattoos.size(); t++){
+		const PreparedTattoo reference = options.reference ? prepareTattoo(sources[t], tattooRadii, true, false) : PreparedTattoo();
+		for (int tilted = 0; tilted < 2; tilted++){
+			RendererSettings settings;
+			settings.foreshortening = tilted != 0;
+			if (options.reference){
+				settings.cacheBytes = 0;
+			}
+			TattooRenderer renderer(settings);
+
+			for (const int pose : regressionPoses){
+				JointBuffer joints;
+				syntheticJoints(pose, joints);
+				cv::Mat frame = background.clone();
+
+				std::ostringstream name;
+				name << options.golden << "/" << names[t] << (tilted ? "-tilted-" : "-flat-") << pose << ".png";
+				if (options.reference){
+					renderReference(renderer, reference, joints, frame);
+					if (!cv::imwrite(name.str(), frame)){
+						log << "regress: cannot write " << name.str() << std::endl;
+						return false;
+					}
+					continue;
+				}
+
+				renderer.render(frame, joints, tattoos[t]);
+				const cv::Mat golden = cv::imread(name.str());
+				if (golden.size() != frame.size()){
+					log << "regress: no golden " << name.str() << std::endl;
+					ok = false;
+					failed++;
+					continue;
+				}
+
+				const double psnr = maskedPsnr(frame, golden, background);
+				worst = std::min(worst, psnr);
+				compared++;
+				if (psnr < options.minPsnr){
+					log << "regress: " << name.str() << " at " << psnr << " dB" << std::endl;
+					ok = false;
+					failed++;
+				}
+			}
+		}
+	}
+
+	if (options.reference){
+		log << "regress: rendered " << tattoos.size() * 2 * (sizeof(regressionPoses) / sizeof(regressionPoses[0])) << " golden images into " << options.golden << std::endl;
+		return true;
+	}
+	log << "regress: " << compared << " images compared, " << failed << " failed, worst " << worst << " dB ( minimum " << options.minPsnr << " dB )"
+		<< (ok ? " ok" : " FAILED") << std::endl;
+	if (options.timings.empty()){
+		return ok;
+	}
+
+	// Stages over every tattoo at a fixed pose: projection and mips, the two warps and the blend
+	std::unique_ptr<BoneFrames> bones(new BoneFrames);
+	JointBuffer joints;
+	syntheticJoints(6, joints);
+	computeBoneFrames(joints, *bones);
+	const RendererSettings settings;
+	AnchorPose pose;
+	if (!resolveAnchor(*bones, settings.anchor, pose)){
+		log << "regress: the synthetic arm was not tracked" << std::endl;
+		return false;
+	}
+
+	std::vector<cv::Mat> warped(tattoos.size());
+	std::vector<TattooSpans> spans(tattoos.size());
+	std::vector<std::pair<std::string, double>> stages;
+	stages.push_back(std::make_pair("project", bestOf(3, [&](){
+		PerfStage stage(options.profiler, "project");
+		for (const auto& source : sources){
+			prepareTattoo(source, tattooRadii);
+		}
+	})));
+	stages.push_back(std::make_pair("warp", bestOf(3, [&](){
+		PerfStage stage(options.profiler, "warp");
+		for (size_t t = 0; t < tattoos.size(); t++){
+			warpTattoo(*tattoos[t], pose.angle, tattooScale(*tattoos[t], pose.length), settings.interpolation, settings.mipBias, warped[t], .8);
+		}
+	})));
+	stages.push_back(std::make_pair("foreshorten", bestOf(3, [&](){
+		PerfStage stage(options.profiler, "foreshorten");
+		for (const auto& tattoo : tattoos){
+			cv::Mat image;
+			cv::Point2f center;
+			warpTattooForeshortened(*tattoo, pose, settings.zoom, settings.interpolation, settings.mipBias, image, center, .8);
+		}
+	})));
+
+	// Blends over a color frame of the sensor, repeated so a run is long enough to time steadily
+	Compositor compositor;
+	std::vector<Layer> layers(1);
+	cv::Mat frame;
+	cv::resize(background, frame, cv::Size(1920, 1080));
+	const cv::Point location(cvRound(pose.location.x * frame.cols / background.cols), cvRound(pose.location.y * frame.rows / background.rows));
+	{
+		PerfStage stage(options.profiler, "spans");
+		for (size_t t = 0; t < tattoos.size(); t++){
+			spans[t].encode(warped[t]);
+		}
+	}
+	stages.push_back(std::make_pair("composite", bestOf(10, [&](){
+		PerfStage stage(options.profiler, "composite");
+		for (int repeat = 0; repeat < 10; repeat++){
+			for (size_t t = 0; t < tattoos.size(); t++){
+				layers[0].image = &warped[t];
+				layers[0].location = location;
+				layers[0].opacity = settings.opacity;
+				layers[0].shading = settings.shading;
+				layers[0].spans = &spans[t];
+				compositor.composite(frame, layers);
+			}
+		}
+	})));
+
+	// Ratios to the calibration loop, against the committed ones
+	const double unit = calibrate();
+	std::map<std::string, double> ratios;
+	if (!options.recordTimings){
+		ratios = readTimings(options.timings);
+		if (ratios.empty()){
+			log << "regress: no stage ratios in " << options.timings << std::endl;
+			ok = false;
+		}
+	}
+
+	const std::ios::fmtflags flags = log.flags();
+	const std::streamsize precision = log.precision();
+	log << std::fixed << std::setprecision(2);
+
+	log << std::left << std::setw(12) << "stage" << std::right << std::setw(10) << "ms" << std::setw(10) << "ratio" << std::setw(10) << "committed" << std::endl;
+	for (const auto& stage : stages){
+		const double ratio = unit > 0 ? stage.second / unit : 0;
+		log << std::left << std::setw(12) << stage.first << std::right << std::setw(10) << stage.second << std::setw(10) << ratio;
+		const auto found = ratios.find(stage.first);
+		if (found != ratios.end()){
+			log << std::setw(10) << found->second;
+		}
+		else {
+			log << std::setw(10) << "-";
+		}
+
+		if (!options.recordTimings && (found == ratios.end() || ratio > found->second * (1. + options.slack))){
+			log << (found == ratios.end() ? "  MISSING" : "  SLOW");
+			ok = false;
+		}
+		log << std::endl;
+	}
+	log << "calibration " << unit << " ms" << std::endl;
+
+	if (options.recordTimings){
+		std::ofstream out(options.timings);
+		out << "# Stage times over the calibration loop, recorded by tattoo-render --regress --record-timings" << std::endl;
+		for (const auto& stage : stages){
+			out << stage.first << " " << (unit > 0 ? stage.second / unit : 0) << std::endl;
+		}
+		if (!out){
+			log << "regress: cannot write " << options.timings << std::endl;
+			ok = false;
+		}
+		else {
+			log << "regress: recorded " << stages.size() << " stage ratios in " << options.timings << std::endl;
+		}
+	}
+
+	log.flags(flags);
+	log.precision(precision);
+	return ok;
+}
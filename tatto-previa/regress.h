@@ -0,0 +1,45 @@
+#ifndef __REGRESS__
+#define __REGRESS__
+
+#include "perf.h"
+
+#include <ostream>
+#include <string>
+
+// Golden image and timing regression of the render path. Fixed synthetic frames and poses are rendered
+// with every bundled BGRA tattoo, flat and foreshortened, and compared with golden images; the projection,
+// warp and composite stages are timed as multiples of a calibration loop and compared with committed ratios.
+// The golden images come from the reference path, rendered deterministically by the build: the tattoo kept
+// BGRA and warped by OpenCV, without the warp cache, and blended in floating point. So they share the
+// projection and placement with the renderer, but not the indexed warp, the spans or the compositor.
+struct RegressionOptions
+{
+	// Tattoos ( PNG and SVG ) and the golden images
+	std::string images;
+	std::string golden;
+
+	// Stage ratios, empty to not time the stages ( e.g. in a debug build )
+	std::string timings;
+
+	// Render the golden images with the reference path instead of comparing with them
+	bool reference;
+
+	// Write this machine's stage ratios to timings instead of comparing with them
+	bool recordTimings;
+
+	// Lowest PSNR ( dB ) over the pixels the tattoo covers
+	double minPsnr;
+
+	// Slowdown of a stage allowed over its committed ratio, .5 is 50 % slower
+	double slack;
+
+	// Gets every timed run of the stages when set, on the calling thread
+	PerfProfiler* profiler;
+
+	RegressionOptions() : images("images"), golden("golden"), reference(false), recordTimings(false), minPsnr(40.), slack(.5), profiler(nullptr) {}
+};
+
+// Run the regression, false when an image or a stage regressed, or a golden image or a stage ratio is missing
+bool runRegression(const RegressionOptions& options, std::ostream& log);
+
+#endif // __REGRESS__
@@ -0,0 +1,334 @@
+#include "render.h"
+#include "warp.h"
+#include "foreshorten.h"
+
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+// Below .5 the cylinder is narrower than the tattoo
+const std::vector<double> tattooRadii = { .55, .65, .8, 1., 1.3 };
+
+void buildMips(const cv::Mat& image, std::vector<cv::Mat>& mips)
+{
+	mips.clear();
+	mips.push_back(image);
+
+	while (mips.size() < 5 && std::min(mips.back().cols, mips.back().rows) >= 64){
+		cv::Mat level;
+		cv::pyrDown(mips.back(), level);
+		mips.push_back(level);
+	}
+}
+
+PreparedTattoo prepareTattoo(const cv::Mat& image, double r_factor, bool bilinear)
+{
+	return prepareTattoo(image, std::vector<double>(1, r_factor), bilinear);
+}
+
+PreparedTattoo prepareTattoo(const cv::Mat& image, const std::vector<double>& radii, bool bilinear, bool indexed)
+{
+	PreparedTattoo tattoo;
+	tattoo.radii = radii;
+	tattoo.bins.resize(radii.size());
+
+	// Line art only keeps indices, projected and downsampled in BGRA first so its edges stay smooth
+	if (indexed){
+		findPalette(image, tattoo.palette);
+	}
+
+	// Bins are independent
+#pragma omp parallel for
+	for (int i = 0; i < static_cast<int>(radii.size()); i++){
+		buildMips(projectCylinder(image, radii[i], bilinear), tattoo.bins[i]);
+		if (tattoo.indexed()){
+			for (auto& level : tattoo.bins[i]){
+				cv::Mat indices;
+				encodePalette(level, tattoo.palette, indices);
+				level = indices;
+			}
+		}
+	}
+	return tattoo;
+}
+
+size_t PreparedTattoo::bytes() const
+{
+	size_t total = 0;
+	for (const auto& bin : bins){
+		for (const auto& level : bin){
+			total += level.total() * level.elemSize();
+		}
+	}
+	return total;
+}
+
+cv::Mat tattooLevel(const PreparedTattoo& tattoo, int bin, int level)
+{
+	const cv::Mat& image = tattoo.bins[bin][level];
+	if (!tattoo.indexed()){
+		return image;
+	}
+
+	cv::Mat decoded;
+	decodePalette(image, tattoo.palette, decoded);
+	return decoded;
+}
+
+double tattooRadius(const PreparedTattoo& tattoo, double limbRadius, double boneLength, double zoom)
+{
+	// The projected tattoo spans half the bone and the source is half of it
+	const cv::Mat& projected = tattoo.projected();
+	const double width = boneLength / 4 * zoom * projected.cols / projected.rows;
+	return width > 0 ? limbRadius / width : 0;
+}
+
+double tattooScale(const PreparedTattoo& tattoo, double boneLength, double zoom)
+{
+	return boneLength / (tattoo.projected().rows * 2) * zoom;
+}
+
+// Mip level closest to the output scale, shifted by the bias
+static int mipLevel(const PreparedTattoo& tattoo, double scale, float mipBias)
+{
+	int level = 0;
+	if (scale > 0){
+		level = cvFloor(std::log(1. / scale) / std::log(2.) + mipBias);
+		level = std::max(0, std::min(level, tattoo.levels() - 1));
+	}
+	return level;
+}
+
+// The two bins around a cylinder radius and the weight t of the upper one, a single bin ( t = 0 ) when one is close enough
+static void radiusBins(const PreparedTattoo& tattoo, double radius, int& lower, int& upper, double& t)
+{
+	const std::vector<double>& radii = tattoo.radii;
+	lower = upper = 0;
+	t = 0;
+	if (radii.size() < 2 || radius <= radii.front()){
+		return;
+	}
+	if (radius >= radii.back()){
+		lower = upper = static_cast<int>(radii.size()) - 1;
+		return;
+	}
+
+	upper = static_cast<int>(std::upper_bound(radii.begin(), radii.end(), radius) - radii.begin());
+	lower = upper - 1;
+	t = (radius - radii[lower]) / (radii[upper] - radii[lower]);
+
+	// Close enough to a bin
+	if (t < 1. / 32){
+		upper = lower;
+		t = 0;
+	}
+	else if (t > 31. / 32){
+		lower = upper;
+		t = 0;
+	}
+}
+
+// Mix two straight alpha BGRA images, weight t ( 1/256 ) of the second: colors are weighted by their alpha,
+// so transparent pixels ( whose color is whatever was left there ) leave no fringe along the edges
+static void mixStraightAlpha(const cv::Mat& first, const cv::Mat& second, int t, cv::Mat& output)
+{
+	output.create(first.size(), CV_8UC4);
+
+#pragma omp parallel for
+	for (int y = 0; y < first.rows; y++){
+		const uchar* a = first.ptr<uchar>(y);
+		const uchar* b = second.ptr<uchar>(y);
+		uchar* out = output.ptr<uchar>(y);
+		for (int x = 0; x < first.cols; x++, a += 4, b += 4, out += 4){
+			const int wa = (256 - t) * a[3];
+			const int wb = t * b[3];
+			const int sum = wa + wb;
+			if (sum == 0){
+				out[0] = out[1] = out[2] = out[3] = 0;
+				continue;
+			}
+
+			for (int c = 0; c < 3; c++){
+				out[c] = static_cast<uchar>((wa * a[c] + wb * b[c] + sum / 2) / sum);
+			}
+			out[3] = static_cast<uchar>((sum + 128) >> 8);
+		}
+	}
+}
+
+// A BGRA mip level at a cylinder radius, the two nearest bins are blended into scratch
+static const cv::Mat& radiusLevel(const PreparedTattoo& tattoo, int level, double radius, cv::Mat& scratch)
+{
+	int lower, upper;
+	double t;
+	radiusBins(tattoo, radius, lower, upper, t);
+	if (t == 0){
+		return tattoo.bins[lower][level];
+	}
+
+	mixStraightAlpha(tattoo.bins[lower][level], tattoo.bins[upper][level], static_cast<int>(t * 256 + .5), scratch);
+	return scratch;
+}
+
+// Warp an indexed mip level at a cylinder radius, the two nearest bins are mixed as they are sampled
+static void warpIndexed(const PreparedTattoo& tattoo, int level, double radius, const cv::Matx33d& homography, const cv::Size& size, int interpolation, cv::Mat& output)
+{
+	int lower, upper;
+	double t;
+	radiusBins(tattoo, radius, lower, upper, t);
+	warpPalette(tattoo.bins[lower][level], tattoo.bins[upper][level], static_cast<float>(t), tattoo.palette, homography.inv(), size, interpolation, output);
+}
+
+// Rotate and scale a tattoo about its center into an image of the level 0 size, or only as large as the warped tattoo
+static void warpAboutCenter(const PreparedTattoo& tattoo, double angle, double scale, int interpolation, float mipBias, cv::Mat& output, double radius, bool fitted)
+{
+	const cv::Mat& projected = tattoo.projected();
+
+	// centro da imagem
+	const cv::Point2f center = cv::Point2f(round(projected.cols / 2), round(projected.rows / 2));
+
+	const int level = mipLevel(tattoo, scale, mipBias);
+	const cv::Mat& levelSize = tattoo.bins[0][level];
+	const cv::Point2f sourceCenter = cv::Point2f(round(levelSize.cols / 2), round(levelSize.rows / 2));
+
+	// transform tattoo, moving the level center to the output center
+	cv::Mat R = cv::getRotationMatrix2D(sourceCenter, angle, scale * projected.cols / levelSize.cols);
+	R.at<double>(0, 2) += center.x - sourceCenter.x;
+	R.at<double>(1, 2) += center.y - sourceCenter.y;
+
+	cv::Matx33d H(
+		R.at<double>(0, 0), R.at<double>(0, 1), R.at<double>(0, 2),
+		R.at<double>(1, 0), R.at<double>(1, 1), R.at<double>(1, 2),
+		0, 0, 1);
+	cv::Size size = projected.size();
+
+	if (fitted){
+		// Box of the warped corners grown to be symmetric about the tattoo center,
+		// so the center stays in the middle where the compositor puts the layer location
+		cv::Matx33d shifted;
+		cv::Size box;
+		cv::Point2f landed;
+		boundingBoxHomography(levelSize.size(), H, shifted, box, landed);
+		const int x = cvRound(landed.x), y = cvRound(landed.y);
+		const int halfWidth = std::max(x, box.width - x), halfHeight = std::max(y, box.height - y);
+		const cv::Matx33d recenter(
+			1, 0, halfWidth - x,
+			0, 1, halfHeight - y,
+			0, 0, 1);
+		H = recenter * shifted;
+		size = cv::Size(std::max(1, halfWidth * 2), std::max(1, halfHeight * 2));
+	}
+
+	if (tattoo.indexed()){
+		warpIndexed(tattoo, level, radius, H, size, interpolation, output);
+		return;
+	}
+
+	cv::Mat scratch;
+	const cv::Mat& source = radiusLevel(tattoo, level, radius, scratch);
+	const cv::Matx23d affine(H(0, 0), H(0, 1), H(0, 2), H(1, 0), H(1, 1), H(1, 2));
+	cv::warpAffine(source, output, cv::Mat(affine), size, interpolation);
+}
+
+void warpTattoo(const PreparedTattoo& tattoo, double angle, double scale, int interpolation, float mipBias, cv::Mat& output, double radius)
+{
+	warpAboutCenter(tattoo, angle, scale, interpolation, mipBias, output, radius, false);
+}
+
+void warpTattooFitted(const PreparedTattoo& tattoo, double angle, double scale, int interpolation, float mipBias, cv::Mat& output, double radius)
+{
+	warpAboutCenter(tattoo, angle, scale, interpolation, mipBias, output, radius, true);
+}
+
+void warpTattooForeshortened(const PreparedTattoo& tattoo, const AnchorPose& pose, double zoom, int interpolation, float mipBias, cv::Mat& output, cv::Point2f& center, double radius)
+{
+	const cv::Mat& projected = tattoo.projected();
+
+	// The 2D bone length is already foreshortened, the tilt shortens the tattoo along the bone instead
+	const double tilt = boneTilt(pose.direction);
+	const double scale = tattooScale(tattoo, pose.length / std::max(std::cos(tilt), .25), zoom);
+
+	// The projected tattoo spans half the bone, so the bone depth in tattoo pixels sets the perspective
+	const double focal = std::max(2. * projected.rows * pose.position.z / std::max(pose.length3d, .01f), static_cast<double>(projected.rows));
+
+	const int level = mipLevel(tattoo, scale, mipBias);
+	const cv::Size levelSize = tattoo.bins[0][level].size();
+	const double factor = static_cast<double>(projected.cols) / levelSize.width;
+
+	// Homography of level 0, sampled from the mip level
+	const cv::Matx33d toLevel0(
+		factor, 0, 0,
+		0, factor, 0,
+		0, 0, 1);
+	const cv::Matx33d H = foreshortenHomography(projected.size(), tilt, focal, pose.angle, scale) * toLevel0;
+
+	if (tattoo.indexed()){
+		cv::Matx33d shifted;
+		cv::Size box;
+		if (!boundingBoxHomography(levelSize, H, shifted, box, center)){
+			output.release();
+			return;
+		}
+		warpIndexed(tattoo, level, radius, shifted, box, interpolation, output);
+		return;
+	}
+
+	cv::Mat scratch;
+	const cv::Mat& source = radiusLevel(tattoo, level, radius, scratch);
+	warpBoundingBox(source, H, interpolation, output, center);
+}
+
+bool checkPalette(std::ostream& log)
+{
+	// Line art of two inks over transparency, antialiased so the edges carry partial alpha
+	cv::Mat art(512, 512, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+	cv::circle(art, cv::Point(256, 256), 180, cv::Scalar(20, 20, 20, 255), 14, cv::LINE_AA);
+	cv::line(art, cv::Point(100, 400), cv::Point(400, 100), cv::Scalar(40, 40, 200, 255), 10, cv::LINE_AA);
+
+	const PreparedTattoo indexed = prepareTattoo(art, tattooRadii);
+	const PreparedTattoo full = prepareTattoo(art, tattooRadii, true, false);
+	if (!indexed.indexed()){
+		log << "palette: line art not indexed" << std::endl;
+		return false;
+	}
+
+	// Alpha everywhere, color where both are opaque
+	int worstAlpha = 0, worstColor = 0;
+	double indexedMs = 0, fullMs = 0;
+	const int interpolations[] = { cv::INTER_LINEAR, cv::INTER_CUBIC };
+	for (const int interpolation : interpolations){
+		for (int angle = -150; angle <= 180; angle += 30){
+			for (double scale = .3; scale < 1.2; scale += .2){
+				const double radius = .6 + angle / 500.;
+
+				cv::Mat a, b;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				warpTattoo(indexed, angle, scale, interpolation, 0, a, radius);
+				indexedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				start = std::chrono::steady_clock::now();
+				warpTattoo(full, angle, scale, interpolation, 0, b, radius);
+				fullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				for (int y = 0; y < a.rows; y++){
+					const cv::Vec4b* pa = a.ptr<cv::Vec4b>(y);
+					const cv::Vec4b* pb = b.ptr<cv::Vec4b>(y);
+					for (int x = 0; x < a.cols; x++){
+						worstAlpha = std::max(worstAlpha, std::abs(pa[x][3] - pb[x][3]));
+						if (pa[x][3] == 255 && pb[x][3] == 255){
+							for (int c = 0; c < 3; c++){
+								worstColor = std::max(worstColor, std::abs(pa[x][c] - pb[x][c]));
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// The indexed warp decodes every tap, it may cost a little more than the BGRA one but not much
+	const bool ok = worstAlpha <= 8 && worstColor <= 24 && indexedMs <= fullMs * 1.25;
+	log << "palette: " << indexed.palette.colors << " inks, " << indexed.bytes() / 1024 << " KB indexed against "
+		<< full.bytes() / 1024 << " KB BGRA, warps " << indexedMs << " ms against " << fullMs << " ms ( at most 25 % slower ), "
+		<< "worst alpha " << worstAlpha << ", worst color " << worstColor << (ok ? " ok" : " FAILED") << std::endl;
+	return ok;
+}
@@ -0,0 +1,80 @@
+#ifndef __RENDER__
+#define __RENDER__
+
+#include "skeleton.h"
+#include "vectortattoo.h"
+#include "palette.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+// A tattoo projected on cylinders of a few radii, with their mip chains
+struct PreparedTattoo
+{
+	std::string name;
+
+	// Cylinder radius of every bin in tattoo widths, ascending
+	std::vector<double> radii;
+
+	// Mip chain of every bin, downsampled by powers of two, level 0 is the projected tattoo.
+	// Every bin has the same size and number of levels. BGRA, or CV_8U indices into palette.
+	std::vector<std::vector<cv::Mat>> bins;
+
+	// Inks of an indexed tattoo, empty when the bins are BGRA
+	TattooPalette palette;
+
+	// Paths the bins were rasterized from, null for raster tattoos
+	std::shared_ptr<const VectorTattoo> source;
+
+	const cv::Mat& projected() const { return bins[0][0]; }
+	int levels() const { return static_cast<int>(bins[0].size()); }
+	bool empty() const { return bins.empty() || bins[0].empty() || bins[0][0].empty(); }
+	bool indexed() const { return !palette.empty(); }
+
+	// Bytes of every bin and level
+	size_t bytes() const;
+};
+
+// Default radius bins, from thin wrists to nearly flat
+extern const std::vector<double> tattooRadii;
+
+// Mip chain of an image, level 0 is the image itself
+void buildMips(const cv::Mat& image, std::vector<cv::Mat>& mips);
+
+// Project a BGRA tattoo on a cylinder of radius r_factor * width and build its mips
+PreparedTattoo prepareTattoo(const cv::Mat& image, double r_factor = .8, bool bilinear = true);
+
+// Project a BGRA tattoo on a cylinder of every radius ( in widths, ascending ) and build their mips.
+// A tattoo of a few inks is stored as palette indices unless indexed is false ( see findPalette ).
+PreparedTattoo prepareTattoo(const cv::Mat& image, const std::vector<double>& radii, bool bilinear = true, bool indexed = true);
+
+// BGRA of a bin level, decoded when the tattoo is indexed
+cv::Mat tattooLevel(const PreparedTattoo& tattoo, int bin, int level);
+
+// Cylinder radius in tattoo widths that wraps the tattoo around a limb of radius limbRadius ( meters ),
+// for a tattoo placed on a bone of boneLength ( meters ) like tattooScale does
+double tattooRadius(const PreparedTattoo& tattoo, double limbRadius, double boneLength, double zoom = 1.);
+
+// Scale that makes a projected tattoo fit a bone of the given length ( pixels )
+double tattooScale(const PreparedTattoo& tattoo, double boneLength, double zoom = 1.);
+
+// Rotate ( degrees, counter-clockwise ) and scale a tattoo about its center, into an image
+// of the level 0 size, sampling the mip level that fits the scale shifted by mipBias.
+// The two bins around radius are interpolated, 0 takes the first bin.
+void warpTattoo(const PreparedTattoo& tattoo, double angle, double scale, int interpolation, float mipBias, cv::Mat& output, double radius = 0);
+
+// Like warpTattoo, into an image only as large as the warped tattoo with its center in the middle,
+// for scales well under 1 where most of the level 0 size would be empty
+void warpTattooFitted(const PreparedTattoo& tattoo, double angle, double scale, int interpolation, float mipBias, cv::Mat& output, double radius = 0);
+
+// Like warpTattoo, also tilting the tattoo with the bone out of the image plane, in perspective from the bone depth.
+// The output only covers the warped tattoo; center receives where the tattoo center landed in it.
+void warpTattooForeshortened(const PreparedTattoo& tattoo, const AnchorPose& pose, double zoom, int interpolation, float mipBias, cv::Mat& output, cv::Point2f& center, double radius = 0);
+
+// Warp synthetic line art indexed and in BGRA, compare and time them, false on failure
+bool checkPalette(std::ostream& log);
+
+#endif // __RENDER__
@@ -0,0 +1,285 @@
+#include "renderer.h"
+#include "foreshorten.h"
+
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+// Handles a renderer remembers, older ones get a new id when they come back
+static const size_t KnownTattoos = 16;
+
+TattooHandle loadTattooHandle(const std::string& filename, bool bilinear)
+{
+	PreparedTattoo prepared;
+	if (isVectorTattoo(filename)){
+		std::shared_ptr<VectorTattoo> vector = readVectorTattoo(filename);
+		prepared = prepareTattoo(rasterizeVector(*vector, 300), tattooRadii, bilinear);
+		prepared.source = vector;
+	}
+	else {
+		const cv::Mat image = cv::imread(filename, -1);
+		if (image.empty()){
+			throw std::runtime_error("Cannot read " + filename);
+		}
+		prepared = prepareTattoo(image, tattooRadii, bilinear);
+	}
+
+	prepared.name = filename;
+	return std::make_shared<const PreparedTattoo>(prepared);
+}
+
+TattooHandle makeTattooHandle(const cv::Mat& image, bool bilinear)
+{
+	if (image.empty() || image.channels() != 4){
+		throw std::runtime_error("A tattoo must be a BGRA image");
+	}
+	return std::make_shared<const PreparedTattoo>(prepareTattoo(image, tattooRadii, bilinear));
+}
+
+// Constructor
+TattooRenderer::TattooRenderer(const RendererSettings& settings)
+	: options(settings), warpCache(settings.cacheBytes), layers(1), bones(new BoneFrames)
+{
+}
+
+void TattooRenderer::setSettings(const RendererSettings& settings)
+{
+	options = settings;
+	warpCache.clear();
+	warpCache.setCapacity(settings.cacheBytes);
+	cylinderRadius = 0;
+}
+
+void TattooRenderer::adjustSettings(const RendererSettings& settings)
+{
+	options = settings;
+	warpCache.setCapacity(settings.cacheBytes);
+}
+
+unsigned long long TattooRenderer::tattooId(const TattooHandle& tattoo)
+{
+	// Released handles can not be drawn again, their ids go with them
+	for (size_t i = known.size(); i-- > 0;){
+		if (known[i].first.expired()){
+			known.erase(known.begin() + i);
+		}
+	}
+
+	// Every entry left is alive, so an owner match is this very tattoo
+	for (size_t i = 0; i < known.size(); i++){
+		if (!known[i].first.owner_before(tattoo) && !tattoo.owner_before(known[i].first)){
+			std::rotate(known.begin(), known.begin() + i, known.begin() + i + 1);
+			return known.front().second;
+		}
+	}
+
+	if (known.size() >= KnownTattoos){
+		known.pop_back();
+	}
+	known.insert(known.begin(), std::make_pair(tattoo, nextId++));
+	cylinderRadius = 0;
+	return known.front().second;
+}
+
+bool TattooRenderer::render(cv::Mat& frame, const JointBuffer& joints, const TattooHandle& tattoo)
+{
+	AnchorPose pose;
+	{
+		PerfStage stage(profiler, "anchor");
+		computeBoneFrames(joints, *bones);
+		if (!resolveAnchor(*bones, options.anchor, pose)){
+			return false;
+		}
+	}
+	return render(frame, pose, limbRadius(options.anchor, pose), tattoo);
+}
+
+bool TattooRenderer::render(unsigned char* pixels, int width, int height, size_t stride, int channels, const JointBuffer& joints, const TattooHandle& tattoo)
+{
+	if (pixels == nullptr || (channels != 3 && channels != 4) || width <= 0 || height <= 0 || stride < static_cast<size_t>(width) * channels){
+		return false;
+	}
+
+	// A header over the caller's buffer, blended in place
+	cv::Mat frame(height, width, CV_MAKETYPE(CV_8U, channels), pixels, stride);
+	return render(frame, joints, tattoo);
+}
+
+bool TattooRenderer::render(cv::Mat& frame, const AnchorPose& pose, float limb, const TattooHandle& tattoo)
+{
+	if (frame.empty() || frame.depth() != CV_8U || (frame.channels() != 3 && frame.channels() != 4) || !tattoo || tattoo->empty()){
+		return false;
+	}
+
+	const unsigned long long id = tattooId(tattoo);
+	const int radiusStep = smoothRadius(*tattoo, pose, limb);
+	if (!place(*tattoo, id, pose, radiusStep, 0, 1., placed)){
+		return false;
+	}
+	composite(frame, placed);
+	return true;
+}
+
+int TattooRenderer::smoothRadius(const PreparedTattoo& tattoo, const AnchorPose& pose, float limb)
+{
+	// Smoothed and quantized so the warp cache still hits
+	const double radius = tattooRadius(tattoo, limb, pose.length3d, options.zoom);
+	cylinderRadius = cylinderRadius > 0 ? cylinderRadius + (radius - cylinderRadius) * options.radiusSmoothing : radius;
+	return cvRound(cylinderRadius / .05);
+}
+
+bool TattooRenderer::place(const PreparedTattoo& tattoo, unsigned long long id, const AnchorPose& pose, int radiusStep, int variant, double factor, PlacedTattoo& result)
+{
+	if (options.foreshortening){
+		// Follows the arm depth, so it is not cached
+		cv::Point2f center;
+		cv::Mat image;
+		{
+			PerfStage stage(profiler, "warp");
+			warpTattooForeshortened(tattoo, pose, options.zoom * factor, options.interpolation, options.mipBias, image, center, radiusStep * .05);
+		}
+		if (image.empty()){
+			return false;
+		}
+
+		std::shared_ptr<TattooSpans> encoded = std::make_shared<TattooSpans>();
+		{
+			PerfStage stage(profiler, "spans");
+			encoded->encode(image);
+		}
+		result.image = image;
+		result.spans = encoded;
+
+		// The compositor centers the layer, shift it so the tattoo center lands on the anchor
+		const cv::Point2f shifted = pose.location * static_cast<float>(factor) + cv::Point2f(image.cols / 2.f, image.rows / 2.f) - center;
+		result.location = cv::Point(cvRound(shifted.x), cvRound(shifted.y));
+		return true;
+	}
+
+	// Quantized pose, a customer holding still reuses the last warp; the key holds every setting the raster depends on
+	// ( zoom through the scale, interpolation, mip bias in 1/8 steps and the cylinder ), the caller's variant the rest
+	const int bias = cvRound(options.mipBias * 8) & 255;
+	const int shaping = ((radiusStep * 8 + (options.interpolation & 7)) * 256 + bias) * 16;
+	const WarpKey key = warpCache.key(id, pose.angle, tattooScale(tattoo, pose.length, options.zoom) * factor, shaping + variant);
+	if (!warpCache.find(key, result.image, result.spans)){
+		// Into a new buffer, the previous one may be held by the cache
+		cv::Mat image;
+		{
+			PerfStage stage(profiler, "warp");
+			warpTattooFitted(tattoo, warpCache.angle(key), warpCache.scale(key), options.interpolation, options.mipBias, image, radiusStep * .05);
+		}
+
+		// Encoded once per warp, cache hits reuse the spans
+		std::shared_ptr<TattooSpans> encoded = std::make_shared<TattooSpans>();
+		{
+			PerfStage stage(profiler, "spans");
+			encoded->encode(image);
+		}
+		result.image = image;
+		result.spans = encoded;
+		warpCache.insert(key, result.image, result.spans);
+	}
+	result.location = cv::Point(cvRound(pose.location.x * factor), cvRound(pose.location.y * factor));
+	return true;
+}
+
+void TattooRenderer::composite(cv::Mat& frame, const PlacedTattoo& tattoo)
+{
+	Layer& layer = layers[0];
+	layer.image = &tattoo.image;
+	layer.location = tattoo.location;
+	layer.opacity = options.opacity;
+	layer.shading = options.shading;
+	layer.spans = tattoo.spans.get();
+
+	PerfStage stage(profiler, "composite");
+	compositor.composite(frame, layers);
+}
+
+void syntheticJoints(int frame, JointBuffer& joints)
+{
+	joints.clear();
+	joints.tracked[0] = true;
+
+	const int elbow = Joint_ElbowRight, wrist = Joint_WristRight, shoulder = Joint_ShoulderRight;
+	const float swing = .02f * frame;
+	const float x[3] = { .2f, .45f, .7f + swing };
+	const float y[3] = { .3f, .25f, .2f + swing };
+	const int slots[3] = { shoulder, elbow, wrist };
+	for (int i = 0; i < 3; i++){
+		const int s = slots[i];
+		joints.state[s] = JointState_Tracked;
+		joints.x[s] = x[i];
+		joints.y[s] = y[i];
+		joints.z[s] = 2.f;
+		joints.u[s] = 320 + x[i] * 400;
+		joints.v[s] = 240 - y[i] * 400;
+	}
+}
+
+bool checkRenderer(std::ostream& out)
+{
+	// Ring tattoo and a gradient background
+	cv::Mat ink(120, 120, CV_8UC4, cv::Scalar::all(0));
+	cv::circle(ink, cv::Point(60, 60), 45, cv::Scalar(40, 30, 160, 255), 12);
+	const TattooHandle tattoo = makeTattooHandle(ink);
+
+	cv::Mat background(480, 640, CV_8UC3);
+	for (int y = 0; y < background.rows; y++){
+		for (int x = 0; x < background.cols; x++){
+			background.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<uchar>(x / 3), static_cast<uchar>(y / 2), 120);
+		}
+	}
+
+	const int frames = 12;
+	const int threads = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+
+	// One renderer, the reference
+	std::vector<cv::Mat> reference(frames);
+	{
+		TattooRenderer renderer;
+		for (int f = 0; f < frames; f++){
+			JointBuffer joints;
+			syntheticJoints(f, joints);
+			reference[f] = background.clone();
+			if (!renderer.render(reference[f], joints, tattoo)){
+				out << "renderer: frame " << f << " was not placed" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	const double changed = cv::norm(reference[0], background, cv::NORM_L1);
+	if (changed == 0){
+		out << "renderer: the tattoo left the frame unchanged" << std::endl;
+		return false;
+	}
+
+	// The same frames on renderers of their own, all at once, sharing the tattoo
+	std::vector<int> mismatches(threads, 0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++){
+		workers.push_back(std::thread([&, t](){
+			TattooRenderer renderer;
+			for (int f = 0; f < frames; f++){
+				JointBuffer joints;
+				syntheticJoints(f, joints);
+				cv::Mat frame = background.clone();
+				renderer.render(frame.data, frame.cols, frame.rows, frame.step, frame.channels(), joints, tattoo);
+				if (cv::norm(frame, reference[f], cv::NORM_INF) != 0){
+					mismatches[t]++;
+				}
+			}
+		}));
+	}
+	for (auto& worker : workers){
+		worker.join();
+	}
+
+	int total = 0;
+	for (const int m : mismatches){
+		total += m;
+	}
+	out << "renderer: " << threads << " threads x " << frames << " frames, " << total << " differ from one renderer" << std::endl;
+	return total == 0;
+}
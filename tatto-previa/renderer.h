@@ -0,0 +1,150 @@
+#ifndef __RENDERER__
+#define __RENDERER__
+
+#include "render.h"
+#include "compositor.h"
+#include "warpcache.h"
+#include "skeleton.h"
+#include "perf.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+
+// Embeddable tattoo renderer, without the sensor, windows or any global state.
+// Every TattooRenderer owns its caches, so instances run concurrently on different threads;
+// tattoo handles are read only and may be shared by all of them.
+
+// A projected tattoo, immutable once made
+typedef std::shared_ptr<const PreparedTattoo> TattooHandle;
+
+// Read and project a PNG ( BGRA ) or SVG tattoo, throws if it can not be read
+TattooHandle loadTattooHandle(const std::string& filename, bool bilinear = true);
+
+// Project a BGRA tattoo already in memory
+TattooHandle makeTattooHandle(const cv::Mat& image, bool bilinear = true);
+
+// How a renderer places and blends the tattoo
+struct RendererSettings
+{
+	BoneAnchor anchor;
+	double zoom;
+	double opacity;
+	double shading;
+	int interpolation;
+	float mipBias;
+
+	// Tilt the tattoo with the bone out of the image plane
+	bool foreshortening;
+
+	// Weight of a new limb radius in its running mean, 1 for frames that are not consecutive
+	double radiusSmoothing;
+
+	// Warp cache size in bytes
+	size_t cacheBytes;
+
+	// Same placement as the live view
+	RendererSettings()
+		: zoom(1.), opacity(.85), shading(.8), interpolation(cv::INTER_CUBIC), mipBias(0.f), foreshortening(false), radiusSmoothing(.2), cacheBytes(32 << 20)
+	{
+		anchor.bone = Joint_WristRight;
+		anchor.body = -1;
+		anchor.along = .5f;
+		anchor.across = 0;
+	}
+};
+
+// A tattoo warped for a pose, ready for a compositor layer
+struct PlacedTattoo
+{
+	cv::Mat image;
+	std::shared_ptr<const TattooSpans> spans;
+
+	// Where the center of image lands in the frame
+	cv::Point location;
+};
+
+// Composites a tattoo over frames in place
+class TattooRenderer
+{
+private:
+	RendererSettings options;
+
+	WarpCache warpCache;
+	Compositor compositor;
+	std::vector<Layer> layers;
+	std::unique_ptr<BoneFrames> bones;
+
+	// Latest warp and where it goes
+	PlacedTattoo placed;
+
+	// Recently drawn handles and their warp cache ids, ids are never reused. Weak, so a renderer does not keep
+	// a tattoo its caller released.
+	std::vector<std::pair<std::weak_ptr<const PreparedTattoo>, unsigned long long>> known;
+	unsigned long long nextId = 1;
+
+	// Smoothed cylinder radius of the limb, in tattoo widths
+	double cylinderRadius = 0;
+
+	// Gets the anchor, warp, spans and composite stages when set
+	PerfProfiler* profiler = nullptr;
+
+public:
+	// Constructor
+	explicit TattooRenderer(const RendererSettings& settings = RendererSettings());
+
+	const RendererSettings& settings() const { return options; }
+
+	// Change the settings, drops the cached warps
+	void setSettings(const RendererSettings& settings);
+
+	// Change the settings, keeping the cached warps: place keys them by the settings they were made with
+	void adjustSettings(const RendererSettings& settings);
+
+	// Composite the tattoo over frame ( BGR or BGRA ) at the anchor of the settings, false if its bone is not tracked
+	bool render(cv::Mat& frame, const JointBuffer& joints, const TattooHandle& tattoo);
+
+	// Same, over a frame buffer of 3 or 4 channels with rows stride bytes apart
+	bool render(unsigned char* pixels, int width, int height, size_t stride, int channels, const JointBuffer& joints, const TattooHandle& tattoo);
+
+	// Composite the tattoo at a resolved pose on a limb of limbRadius ( meters )
+	bool render(cv::Mat& frame, const AnchorPose& pose, float limbRadius, const TattooHandle& tattoo);
+
+	// Smoothed cylinder radius of a limb of limbRadius ( meters ) under the tattoo, in steps of .05 tattoo widths
+	int smoothRadius(const PreparedTattoo& tattoo, const AnchorPose& pose, float limbRadius);
+
+	// Warp the tattoo for a pose on the cylinder of radiusStep, from the warp cache or warped, span encoded and cached.
+	// id names the tattoo in the cache; the key already holds the zoom, interpolation and mip bias of the settings, variant
+	// ( below 16 ) anything else the caller's warps differ by, 0 for nothing. factor scales the frame,
+	// e.g. down to a tile. The image is only as large as the warped tattoo. False when nothing of it shows.
+	// The ids are the caller's, so a renderer given handles to render should not also be given ids.
+	bool place(const PreparedTattoo& tattoo, unsigned long long id, const AnchorPose& pose, int radiusStep, int variant, double factor, PlacedTattoo& placed);
+
+	// Blend a placed tattoo over frame with the opacity and shading of the settings
+	void composite(cv::Mat& frame, const PlacedTattoo& placed);
+
+	const WarpCache& cache() const { return warpCache; }
+	WarpCache& cache() { return warpCache; }
+
+	// Profile the stages into a profiler of the thread rendering, null to stop
+	void setProfiler(PerfProfiler* stageProfiler) { profiler = stageProfiler; }
+
+private:
+	unsigned long long tattooId(const TattooHandle& tattoo);
+
+	TattooRenderer(const TattooRenderer&);
+	TattooRenderer& operator=(const TattooRenderer&);
+};
+
+// Right arm of one body held out, moving a little every frame, for the checks
+void syntheticJoints(int frame, JointBuffer& joints);
+
+// Render the same synthetic frames on one renderer and on several renderers on their own threads,
+// true if every thread produced the same pixels
+bool checkRenderer(std::ostream& out);
+
+#endif // __RENDERER__
@@ -0,0 +1,427 @@
+#include "server.h"
+#include "pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <stdexcept>
+
+// Frames a session keeps for its rates, and how far back ( seconds )
+static const size_t StatsFrames = 120;
+static const double StatsSeconds = 2.;
+
+// Constructor
+TattooLibrary::TattooLibrary(const Loader& loader)
+	: loader(loader)
+{
+}
+
+TattooHandle TattooLibrary::acquire(const std::string& filename)
+{
+	std::promise<TattooHandle> promise;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		Entry& entry = entries[filename];
+		const TattooHandle handle = entry.handle.lock();
+		if (handle){
+			hits++;
+			return handle;
+		}
+
+		// Someone else is loading it
+		if (entry.loading.valid()){
+			std::shared_future<TattooHandle> loading = entry.loading;
+			hits++;
+			lock.unlock();
+			return loading.get();
+		}
+		entry.loading = promise.get_future().share();
+	}
+
+	// Loaded outside the lock, other tattoos are not held up
+	try {
+		const TattooHandle handle = loader ? loader(filename) : loadTattooHandle(filename);
+		if (!handle || handle->empty()){
+			throw std::runtime_error("Cannot load " + filename);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry& entry = entries[filename];
+		entry.handle = handle;
+		entry.loading = std::shared_future<TattooHandle>();
+		loads++;
+		promise.set_value(handle);
+		return handle;
+	}
+	catch (...){
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.erase(filename);
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+}
+
+int TattooLibrary::resident() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	int count = 0;
+	for (const auto& entry : entries){
+		if (!entry.second.handle.expired()){
+			count++;
+		}
+	}
+	return count;
+}
+
+// Constructor
+RenderServer::RenderServer(unsigned int threads, size_t queueFrames)
+	: queueFrames(std::max<size_t>(1, queueFrames)), stageTotals(false)
+{
+	if (threads == 0){
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned int i = 0; i < threads; i++){
+		workers.push_back(std::thread(&RenderServer::run, this));
+	}
+}
+
+// Destructor
+RenderServer::~RenderServer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work.notify_all();
+	for (auto& worker : workers){
+		worker.join();
+	}
+}
+
+int RenderServer::openSession(const RendererSettings& settings, const FrameSink& sink)
+{
+	std::shared_ptr<Session> session = std::make_shared<Session>(settings);
+	session->sink = sink;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	session->id = nextSession++;
+	sessions[session->id] = session;
+	return session->id;
+}
+
+void RenderServer::closeSession(int id)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto found = sessions.find(id);
+	if (found == sessions.end()){
+		return;
+	}
+
+	// Out of the map no worker picks it again, the one rendering it finishes first
+	std::shared_ptr<Session> session = found->second;
+	sessions.erase(found);
+	session->jobs.clear();
+	done.wait(lock, [&session](){ return !session->busy; });
+}
+
+void RenderServer::setTattoo(int id, const TattooHandle& tattoo)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = sessions.find(id);
+	if (found == sessions.end()){
+		throw std::runtime_error("Unknown session");
+	}
+	found->second->tattoo = tattoo;
+}
+
+bool RenderServer::submit(int id, const cv::Mat& frame, int64_t timestampUs, const JointBuffer& joints)
+{
+	bool kept = true;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = sessions.find(id);
+		if (found == sessions.end()){
+			throw std::runtime_error("Unknown session");
+		}
+
+		Session& session = *found->second;
+		while (session.jobs.size() >= queueFrames){
+			session.jobs.pop_front();
+			session.dropped++;
+			kept = false;
+		}
+
+		Job job;
+		job.frame = frame;
+		job.timestampUs = timestampUs;
+		job.joints = joints;
+		job.submitted = Clock::now();
+		session.jobs.push_back(job);
+	}
+	work.notify_one();
+	return kept;
+}
+
+void RenderServer::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this](){
+		for (const auto& session : sessions){
+			if (session.second->busy || !session.second->jobs.empty()){
+				return false;
+			}
+		}
+		return true;
+	});
+}
+
+RenderServer::Session* RenderServer::next()
+{
+	Session* oldest = nullptr;
+	for (const auto& entry : sessions){
+		Session* session = entry.second.get();
+		if (!session->busy && !session->jobs.empty() && (oldest == nullptr || session->jobs.front().submitted < oldest->jobs.front().submitted)){
+			oldest = session;
+		}
+	}
+	return oldest;
+}
+
+void RenderServer::run()
+{
+	serialPoolThread();
+
+	// Counters of this thread, opened the first time profiling is on
+	std::unique_ptr<PerfProfiler> profiler;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true){
+		Session* session = nullptr;
+		work.wait(lock, [this, &session](){ return stopping || (session = next()) != nullptr; });
+		if (stopping){
+			return;
+		}
+
+		Job job = session->jobs.front();
+		session->jobs.pop_front();
+		session->busy = true;
+		const TattooHandle tattoo = session->tattoo;
+		const bool profile = profiling;
+		lock.unlock();
+
+		if (profile && !profiler){
+			profiler.reset(new PerfProfiler);
+		}
+		session->renderer.setProfiler(profile ? profiler.get() : nullptr);
+
+		// Only this thread touches the renderer while the session is busy.
+		// A frame that throws is counted as dropped, the session goes on.
+		bool placed = false, rendered = true;
+		try {
+			placed = tattoo && session->renderer.render(job.frame, job.joints, tattoo);
+			if (session->sink){
+				session->sink(session->id, job.frame, job.timestampUs, placed);
+			}
+		}
+		catch (std::exception&){
+			rendered = false;
+		}
+		const Clock::time_point now = Clock::now();
+
+		lock.lock();
+		session->busy = false;
+		if (profile){
+			stageTotals.merge(*profiler);
+			profiler->reset();
+		}
+		if (rendered){
+			session->frames++;
+			session->placed += placed ? 1 : 0;
+			session->completed.push_back(now);
+			session->latencies.push_back(std::chrono::duration<double, std::milli>(now - job.submitted).count());
+			while (session->completed.size() > StatsFrames || std::chrono::duration<double>(now - session->completed.front()).count() > StatsSeconds){
+				session->completed.pop_front();
+			}
+			while (session->latencies.size() > StatsFrames){
+				session->latencies.pop_front();
+			}
+		}
+		else {
+			session->dropped++;
+		}
+
+		// Its next frame may be waiting for this one
+		if (!session->jobs.empty()){
+			work.notify_one();
+		}
+		done.notify_all();
+	}
+}
+
+std::vector<int> RenderServer::sessionIds() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<int> ids;
+	for (const auto& session : sessions){
+		ids.push_back(session.first);
+	}
+	return ids;
+}
+
+SessionStats RenderServer::stats(int id) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = sessions.find(id);
+	if (found == sessions.end()){
+		throw std::runtime_error("Unknown session");
+	}
+	const Session& session = *found->second;
+
+	SessionStats stats;
+	stats.frames = session.frames;
+	stats.placed = session.placed;
+	stats.dropped = session.dropped;
+	stats.queued = static_cast<int>(session.jobs.size());
+
+	stats.fps = 0;
+	if (session.completed.size() > 1){
+		const double seconds = std::chrono::duration<double>(session.completed.back() - session.completed.front()).count();
+		stats.fps = seconds > 0 ? (session.completed.size() - 1) / seconds : 0;
+	}
+
+	stats.latency = stats.worstLatency = 0;
+	for (const double latency : session.latencies){
+		stats.latency += latency;
+		stats.worstLatency = std::max(stats.worstLatency, latency);
+	}
+	if (!session.latencies.empty()){
+		stats.latency /= session.latencies.size();
+	}
+	return stats;
+}
+
+void RenderServer::report(std::ostream& out) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+
+	out << std::left << std::setw(10) << "session" << std::right << std::setw(10) << "frames" << std::setw(10) << "placed" << std::setw(10) << "dropped"
+		<< std::setw(10) << "queued" << std::setw(10) << "fps" << std::setw(10) << "ms" << std::setw(10) << "worst ms" << std::endl;
+	for (const int id : sessionIds()){
+		const SessionStats s = stats(id);
+		out << std::left << std::setw(10) << id << std::right << std::setw(10) << s.frames << std::setw(10) << s.placed << std::setw(10) << s.dropped
+			<< std::setw(10) << s.queued << std::setw(10) << s.fps << std::setw(10) << s.latency << std::setw(10) << s.worstLatency << std::endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void RenderServer::setProfiling(bool on)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	profiling = on;
+}
+
+void RenderServer::reportProfile(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stageTotals.report(out);
+}
+
+bool checkRenderServer(std::ostream& out)
+{
+	// Ring tattoo, every session asks for it at once
+	std::atomic<int> loads(0);
+	TattooLibrary library([&loads](const std::string&){
+		loads++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		cv::Mat ink(120, 120, CV_8UC4, cv::Scalar::all(0));
+		cv::circle(ink, cv::Point(60, 60), 45, cv::Scalar(40, 30, 160, 255), 12);
+		return makeTattooHandle(ink);
+	});
+
+	const int sessions = 6;
+	const int frames = 24;
+	std::vector<TattooHandle> handles(sessions);
+	{
+		std::vector<std::thread> loaders;
+		for (int s = 0; s < sessions; s++){
+			loaders.push_back(std::thread([&, s](){ handles[s] = library.acquire("ring"); }));
+		}
+		for (auto& loader : loaders){
+			loader.join();
+		}
+	}
+	for (const auto& handle : handles){
+		if (handle != handles[0]){
+			out << "server: sessions got different copies of the tattoo" << std::endl;
+			return false;
+		}
+	}
+
+	cv::Mat background(480, 640, CV_8UC3);
+	for (int y = 0; y < background.rows; y++){
+		for (int x = 0; x < background.cols; x++){
+			background.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<uchar>(x / 3), static_cast<uchar>(y / 2), 120);
+		}
+	}
+
+	// A lone renderer, the reference
+	std::vector<cv::Mat> reference(frames);
+	{
+		TattooRenderer renderer;
+		for (int f = 0; f < frames; f++){
+			JointBuffer joints;
+			syntheticJoints(f, joints);
+			reference[f] = background.clone();
+			renderer.render(reference[f], joints, handles[0]);
+		}
+	}
+
+	// Every session fed from its own thread, with room for all its frames so none is dropped
+	std::atomic<int> mismatches(0);
+	bool ok = true;
+	{
+		RenderServer server(0, frames);
+		std::vector<int> ids;
+		for (int s = 0; s < sessions; s++){
+			ids.push_back(server.openSession(RendererSettings(), [&](int, cv::Mat& frame, int64_t timestampUs, bool){
+				if (cv::norm(frame, reference[static_cast<int>(timestampUs)], cv::NORM_INF) != 0){
+					mismatches++;
+				}
+			}));
+			server.setTattoo(ids.back(), handles[s]);
+		}
+		handles.clear();
+
+		std::vector<std::thread> feeders;
+		for (int s = 0; s < sessions; s++){
+			feeders.push_back(std::thread([&, s](){
+				for (int f = 0; f < frames; f++){
+					JointBuffer joints;
+					syntheticJoints(f, joints);
+					server.submit(ids[s], background.clone(), f, joints);
+				}
+			}));
+		}
+		for (auto& feeder : feeders){
+			feeder.join();
+		}
+		server.wait();
+		server.report(out);
+
+		for (const int id : ids){
+			const SessionStats stats = server.stats(id);
+			ok = ok && stats.frames == frames && stats.dropped == 0;
+			server.closeSession(id);
+		}
+	}
+
+	// Closed sessions let go of the tattoo
+	ok = ok && mismatches == 0 && loads == 1 && library.loaded() == 1 && library.resident() == 0;
+	out << "server: " << sessions << " sessions x " << frames << " frames, " << mismatches << " differ from one renderer, tattoo loaded "
+		<< loads << " time(s) and shared " << library.shared() << ", " << library.resident() << " resident after closing" << (ok ? " ok" : " FAILED") << std::endl;
+	return ok;
+}
@@ -0,0 +1,186 @@
+#ifndef __SERVER__
+#define __SERVER__
+
+#include "renderer.h"
+#include "perf.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+// Renders many kiosk sessions on one machine: the prepared tattoos are shared by every session and
+// the frames of all of them run on a common pool of threads.
+
+// Prepared tattoos by file name, each loaded once however many sessions ask for it at the same time
+// and freed when the last session lets go of its handle
+class TattooLibrary
+{
+public:
+	typedef std::function<TattooHandle(const std::string&)> Loader;
+
+private:
+	struct Entry
+	{
+		std::weak_ptr<const PreparedTattoo> handle;
+
+		// Valid while the tattoo is being loaded, other sessions wait on it
+		std::shared_future<TattooHandle> loading;
+	};
+
+	Loader loader;
+
+	mutable std::mutex mutex;
+	std::map<std::string, Entry> entries;
+	int loads = 0;
+	int hits = 0;
+
+public:
+	// Constructor ( loads with loadTattooHandle when loader is empty )
+	explicit TattooLibrary(const Loader& loader = Loader());
+
+	// Handle of a tattoo, loaded on first use, throws if it can not be loaded
+	TattooHandle acquire(const std::string& filename);
+
+	// Tattoos held by some session, and how many acquires loaded or found one
+	int resident() const;
+	int loaded() const { std::lock_guard<std::mutex> lock(mutex); return loads; }
+	int shared() const { std::lock_guard<std::mutex> lock(mutex); return hits; }
+
+private:
+	TattooLibrary(const TattooLibrary&);
+	TattooLibrary& operator=(const TattooLibrary&);
+};
+
+// Counters of a session, over its recent frames
+struct SessionStats
+{
+	int frames;
+	int placed;
+	int dropped;
+	int queued;
+
+	// Rendered frames per second, and latency from submit to the sink ( milliseconds )
+	double fps;
+	double latency;
+	double worstLatency;
+};
+
+// Sessions share a pool of threads. A session renders one frame at a time in order, so its renderer
+// keeps its smoothing; among the sessions with frames waiting, the one whose oldest frame has waited
+// the longest goes next, so a busy kiosk can not starve a quiet one. A session holds a few frames,
+// submitting past that drops its oldest, as a kiosk would rather skip than fall behind.
+// The pool threads keep their OpenMP loops serial; OpenCV's own threads are process wide and left to the
+// caller, which may want cv::setNumThreads(1) while the pool fills the cores.
+class RenderServer
+{
+public:
+	// Receives every rendered frame on a pool thread, the frame was composited in place
+	typedef std::function<void(int session, cv::Mat& frame, int64_t timestampUs, bool placed)> FrameSink;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Job
+	{
+		cv::Mat frame;
+		int64_t timestampUs;
+		JointBuffer joints;
+		Clock::time_point submitted;
+	};
+
+	struct Session
+	{
+		int id;
+		TattooRenderer renderer;
+		TattooHandle tattoo;
+		FrameSink sink;
+
+		std::deque<Job> jobs;
+		bool busy = false;
+
+		int frames = 0;
+		int placed = 0;
+		int dropped = 0;
+
+		// Completion times and latencies of the recent frames
+		std::deque<Clock::time_point> completed;
+		std::deque<double> latencies;
+
+		explicit Session(const RendererSettings& settings) : renderer(settings) {}
+	};
+
+	size_t queueFrames;
+
+	mutable std::mutex mutex;
+	std::condition_variable work;
+	std::condition_variable done;
+	std::map<int, std::shared_ptr<Session>> sessions;
+	int nextSession = 1;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+	// Stage totals of every pool thread while profiling
+	bool profiling = false;
+	PerfProfiler stageTotals;
+
+public:
+	// Constructor ( pool threads, 0 for one per core, and frames a session holds )
+	explicit RenderServer(unsigned int threads = 0, size_t queueFrames = 2);
+
+	// Destructor, drops the frames still queued
+	~RenderServer();
+
+	// Open a session rendering with its own settings into sink, returns its id
+	int openSession(const RendererSettings& settings, const FrameSink& sink);
+
+	// Close a session, after its frame in flight; its queued frames are dropped
+	void closeSession(int session);
+
+	// Tattoo of the next frames of a session, none leaves the frames as they are
+	void setTattoo(int session, const TattooHandle& tattoo);
+
+	// Queue a frame ( BGR or BGRA, composited in place ), false if the session dropped a frame for it
+	bool submit(int session, const cv::Mat& frame, int64_t timestampUs, const JointBuffer& joints);
+
+	// Wait until every queued frame was rendered
+	void wait();
+
+	int threads() const { return static_cast<int>(workers.size()); }
+	std::vector<int> sessionIds() const;
+	SessionStats stats(int session) const;
+
+	// Table of every session
+	void report(std::ostream& out) const;
+
+	// Profile the stages of the frames on every pool thread ( see perf.h ), from the next frame on
+	void setProfiling(bool on);
+
+	// Stage table of the pool threads together
+	void reportProfile(std::ostream& out) const;
+
+private:
+	void run();
+
+	// Session with the oldest waiting frame among the idle ones, null if none
+	Session* next();
+
+	RenderServer(const RenderServer&);
+	RenderServer& operator=(const RenderServer&);
+};
+
+// Serve synthetic sessions sharing one tattoo against a lone renderer, false if a pixel or the tattoo sharing differs
+bool checkRenderServer(std::ostream& out);
+
+#endif // __SERVER__
@@ -0,0 +1,312 @@
+#include "sharedframe.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t SharedFrameMagic = 0x54545046; // "TTPF"
+static const uint32_t SharedFrameVersion = 2;
+
+// Header and slot metadata are padded to a cache line
+static const size_t SharedAlignment = 64;
+
+static size_t alignUp(size_t bytes)
+{
+	return (bytes + SharedAlignment - 1) / SharedAlignment * SharedAlignment;
+}
+
+static uchar* slotAt(const SharedFrameHeader* header, uint64_t frame)
+{
+	uchar* base = reinterpret_cast<uchar*>(const_cast<SharedFrameHeader*>(header)) + alignUp(sizeof(SharedFrameHeader));
+	return base + (frame % header->slots) * header->slotBytes;
+}
+
+SharedRegion::~SharedRegion()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool SharedRegion::create(const std::string& regionName, size_t size)
+{
+	close();
+
+	const std::string path = "Local\\" + regionName;
+	const unsigned long long size64 = size;
+	handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64 & 0xffffffff), path.c_str());
+	if (handle == NULL){
+		return false;
+	}
+
+	memory = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (memory == NULL){
+		close();
+		return false;
+	}
+
+	name = regionName;
+	bytes = size;
+	owner = true;
+	return true;
+}
+
+bool SharedRegion::open(const std::string& regionName)
+{
+	close();
+
+	const std::string path = "Local\\" + regionName;
+	handle = OpenFileMappingA(FILE_MAP_READ, FALSE, path.c_str());
+	if (handle == NULL){
+		return false;
+	}
+
+	memory = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+	if (memory == NULL){
+		close();
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(memory, &info, sizeof(info));
+
+	name = regionName;
+	bytes = info.RegionSize;
+	owner = false;
+	return true;
+}
+
+void SharedRegion::close()
+{
+	if (memory != nullptr){
+		UnmapViewOfFile(memory);
+	}
+	if (handle != nullptr){
+		CloseHandle(handle);
+	}
+	memory = nullptr;
+	handle = nullptr;
+	bytes = 0;
+}
+
+#else
+
+bool SharedRegion::create(const std::string& regionName, size_t size)
+{
+	close();
+
+	const std::string path = "/" + regionName;
+	const int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0){
+		return false;
+	}
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0){
+		::close(fd);
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED){
+		return false;
+	}
+
+	name = regionName;
+	memory = mapped;
+	bytes = size;
+	owner = true;
+	return true;
+}
+
+bool SharedRegion::open(const std::string& regionName)
+{
+	close();
+
+	const std::string path = "/" + regionName;
+	const int fd = shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0){
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0){
+		::close(fd);
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED){
+		return false;
+	}
+
+	name = regionName;
+	memory = mapped;
+	bytes = static_cast<size_t>(info.st_size);
+	owner = false;
+	return true;
+}
+
+void SharedRegion::close()
+{
+	if (memory != nullptr){
+		munmap(memory, bytes);
+		if (owner){
+			shm_unlink(("/" + name).c_str());
+		}
+	}
+	memory = nullptr;
+	bytes = 0;
+}
+
+#endif
+
+// Constructor
+FramePublisher::FramePublisher(uint32_t slots)
+	: slots(slots < 2 ? 2 : slots)
+{
+}
+
+// Destructor
+FramePublisher::~FramePublisher()
+{
+	close();
+}
+
+void FramePublisher::close()
+{
+	// Readers keep their mapping of an unlinked region, they only learn to reopen from this flag
+	if (header != nullptr){
+		header->closed.store(1, std::memory_order_release);
+	}
+	header = nullptr;
+	region.close();
+}
+
+bool FramePublisher::publish(const cv::Mat& image, int64_t timestampUs, const SharedPose& pose, const std::string& name)
+{
+	if (image.empty()){
+		return false;
+	}
+
+	const uint64_t stride = image.cols * image.elemSize();
+
+	// (Re)create the region for this format
+	if (header == nullptr || header->width != static_cast<uint32_t>(image.cols) || header->height != static_cast<uint32_t>(image.rows) || header->type != static_cast<uint32_t>(image.type())){
+		close();
+
+		const size_t slotBytes = alignUp(sizeof(SharedFrameSlot)) + alignUp(static_cast<size_t>(stride * image.rows));
+		if (!region.create(name, alignUp(sizeof(SharedFrameHeader)) + slots * slotBytes)){
+			return false;
+		}
+
+		std::memset(region.data(), 0, region.size());
+		header = static_cast<SharedFrameHeader*>(region.data());
+		header->slots = slots;
+		header->width = image.cols;
+		header->height = image.rows;
+		header->type = image.type();
+		header->stride = stride;
+		header->slotBytes = slotBytes;
+		header->latest.store(0);
+		header->closed.store(0);
+		header->version = SharedFrameVersion;
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = SharedFrameMagic;
+	}
+
+	frame++;
+	uchar* base = slotAt(header, frame);
+	SharedFrameSlot* slot = reinterpret_cast<SharedFrameSlot*>(base);
+	uchar* pixels = base + alignUp(sizeof(SharedFrameSlot));
+
+	// Odd sequence while writing
+	const uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->frame = frame;
+	slot->timestampUs = timestampUs;
+	slot->pose = pose;
+	for (int y = 0; y < image.rows; y++){
+		std::memcpy(pixels + y * stride, image.ptr(y), static_cast<size_t>(stride));
+	}
+
+	slot->sequence.store(sequence + 2, std::memory_order_release);
+	header->latest.store(frame, std::memory_order_release);
+	return true;
+}
+
+bool FrameReader::open(const std::string& name)
+{
+	header = nullptr;
+	if (!region.open(name) || region.size() < sizeof(SharedFrameHeader)){
+		return false;
+	}
+
+	const SharedFrameHeader* mapped = static_cast<const SharedFrameHeader*>(region.data());
+	if (mapped->magic != SharedFrameMagic || mapped->version != SharedFrameVersion || mapped->closed.load(std::memory_order_acquire) != 0){
+		region.close();
+		return false;
+	}
+
+	header = mapped;
+	return true;
+}
+
+bool FrameReader::closed() const
+{
+	return header == nullptr || header->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool FrameReader::latest(FrameView& view, uint64_t lastFrame) const
+{
+	if (closed()){
+		return false;
+	}
+
+	// Retry a few times if the writer laps us while reading the metadata
+	for (int attempt = 0; attempt < 4; attempt++){
+		const uint64_t frame = header->latest.load(std::memory_order_acquire);
+		if (frame == 0 || frame <= lastFrame){
+			return false;
+		}
+
+		uchar* base = slotAt(header, frame);
+		const SharedFrameSlot* slot = reinterpret_cast<const SharedFrameSlot*>(base);
+
+		const uint32_t before = slot->sequence.load(std::memory_order_acquire);
+		if (before & 1){
+			continue;
+		}
+
+		view.frame = slot->frame;
+		view.timestampUs = slot->timestampUs;
+		view.pose = slot->pose;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->sequence.load(std::memory_order_relaxed) != before || view.frame != frame){
+			continue;
+		}
+
+		view.image = cv::Mat(header->height, header->width, header->type, base + alignUp(sizeof(SharedFrameSlot)), static_cast<size_t>(header->stride));
+		view.slot = slot;
+		view.sequence = before;
+		return true;
+	}
+
+	return false;
+}
+
+bool FrameReader::valid(const FrameView& view) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return view.slot != nullptr && view.slot->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
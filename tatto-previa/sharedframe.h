@@ -0,0 +1,143 @@
+#ifndef __SHAREDFRAME__
+#define __SHAREDFRAME__
+
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+// Tattoo pose published with each frame
+struct SharedPose
+{
+	// Color space location, angle ( degrees ) and bone length ( pixels )
+	float x, y, angle, length;
+
+	// Camera space position ( meters )
+	float px, py, pz;
+
+	// 0 when no tattoo was placed on this frame
+	int32_t placed;
+};
+
+// Start of the shared memory
+struct SharedFrameHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t width;
+	uint32_t height;
+	uint32_t type;
+	uint64_t stride;
+	uint64_t slotBytes;
+
+	// Frame number of the last complete frame, 0 before the first
+	std::atomic<uint64_t> latest;
+
+	// Set when the publisher leaves the region ( format change or exit ), readers then open it again
+	std::atomic<uint32_t> closed;
+};
+
+// Start of every slot, pixels follow at SharedFrameSlotSize
+struct SharedFrameSlot
+{
+	// Seqlock: odd while the writer is in the slot
+	std::atomic<uint32_t> sequence;
+
+	uint64_t frame;
+	int64_t timestampUs;
+	SharedPose pose;
+};
+
+// A mapped shared memory region
+class SharedRegion
+{
+private:
+	std::string name;
+	void* memory = nullptr;
+	size_t bytes = 0;
+	bool owner = false;
+#ifdef _WIN32
+	void* handle = nullptr;
+#endif
+
+public:
+	SharedRegion() {}
+	~SharedRegion();
+
+	// Create ( writer ) or open ( reader ) a region
+	bool create(const std::string& name, size_t bytes);
+	bool open(const std::string& name);
+	void close();
+
+	void* data() const { return memory; }
+	size_t size() const { return bytes; }
+
+private:
+	SharedRegion(const SharedRegion&);
+	SharedRegion& operator=(const SharedRegion&);
+};
+
+// Writes composited frames into a ring of shared memory slots
+class FramePublisher
+{
+private:
+	SharedRegion region;
+	SharedFrameHeader* header = nullptr;
+	uint32_t slots;
+	uint64_t frame = 0;
+
+public:
+	// Constructor ( slots in the ring, at least 2 )
+	explicit FramePublisher(uint32_t slots = 3);
+
+	// Destructor, marks the region closed
+	~FramePublisher();
+
+	// Publish a frame, the region is created on the first call and recreated if the format changes
+	bool publish(const cv::Mat& image, int64_t timestampUs, const SharedPose& pose, const std::string& name = "tattoo-previa");
+
+	// Number of frames published
+	uint64_t published() const { return frame; }
+
+	// Mark the region closed for the readers and release it
+	void close();
+};
+
+// A frame in shared memory, valid until the writer comes back to its slot
+struct FrameView
+{
+	// Pixels in shared memory, not a copy
+	cv::Mat image;
+
+	uint64_t frame;
+	int64_t timestampUs;
+	SharedPose pose;
+
+	const SharedFrameSlot* slot;
+	uint32_t sequence;
+};
+
+// Reads frames published by another process without copying them
+class FrameReader
+{
+private:
+	SharedRegion region;
+	const SharedFrameHeader* header = nullptr;
+
+public:
+	// Open the region of a publisher
+	bool open(const std::string& name = "tattoo-previa");
+
+	// Latest complete frame, false if there is none newer than lastFrame or the region was closed
+	bool latest(FrameView& view, uint64_t lastFrame = 0) const;
+
+	// True when not open or the publisher left the region, open it again to follow a new one
+	bool closed() const;
+
+	// True while the writer has not touched the slot of a view, check after using the pixels
+	bool valid(const FrameView& view) const;
+};
+
+#endif // __SHAREDFRAME__
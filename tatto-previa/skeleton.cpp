@@ -0,0 +1,251 @@
+#include "skeleton.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+const int skeletonParent[SkeletonJointCount] =
+{
+	-1,                  // SpineBase
+	Joint_SpineBase,     // SpineMid
+	Joint_SpineShoulder, // Neck
+	Joint_Neck,          // Head
+	Joint_SpineShoulder, // ShoulderLeft
+	Joint_ShoulderLeft,  // ElbowLeft
+	Joint_ElbowLeft,     // WristLeft
+	Joint_WristLeft,     // HandLeft
+	Joint_SpineShoulder, // ShoulderRight
+	Joint_ShoulderRight, // ElbowRight
+	Joint_ElbowRight,    // WristRight
+	Joint_WristRight,    // HandRight
+	Joint_SpineBase,     // HipLeft
+	Joint_HipLeft,       // KneeLeft
+	Joint_KneeLeft,      // AnkleLeft
+	Joint_AnkleLeft,     // FootLeft
+	Joint_SpineBase,     // HipRight
+	Joint_HipRight,      // KneeRight
+	Joint_KneeRight,     // AnkleRight
+	Joint_AnkleRight,    // FootRight
+	Joint_SpineMid,      // SpineShoulder
+	Joint_HandLeft,      // HandTipLeft
+	Joint_WristLeft,     // ThumbLeft
+	Joint_HandRight,     // HandTipRight
+	Joint_WristRight     // ThumbRight
+};
+
+const float skeletonJointRadius[SkeletonJointCount] =
+{
+	.15f,  // SpineBase
+	.14f,  // SpineMid
+	.06f,  // Neck
+	.09f,  // Head
+	.05f,  // ShoulderLeft
+	.04f,  // ElbowLeft
+	.028f, // WristLeft
+	.03f,  // HandLeft
+	.05f,  // ShoulderRight
+	.04f,  // ElbowRight
+	.028f, // WristRight
+	.03f,  // HandRight
+	.08f,  // HipLeft
+	.055f, // KneeLeft
+	.035f, // AnkleLeft
+	.04f,  // FootLeft
+	.08f,  // HipRight
+	.055f, // KneeRight
+	.035f, // AnkleRight
+	.04f,  // FootRight
+	.14f,  // SpineShoulder
+	.01f,  // HandTipLeft
+	.012f, // ThumbLeft
+	.01f,  // HandTipRight
+	.012f  // ThumbRight
+};
+
+const float skeletonBoneLength[SkeletonJointCount] =
+{
+	0.f,   // SpineBase
+	.25f,  // SpineMid
+	.08f,  // Neck
+	.12f,  // Head
+	.17f,  // ShoulderLeft
+	.28f,  // ElbowLeft
+	.25f,  // WristLeft
+	.08f,  // HandLeft
+	.17f,  // ShoulderRight
+	.28f,  // ElbowRight
+	.25f,  // WristRight
+	.08f,  // HandRight
+	.09f,  // HipLeft
+	.42f,  // KneeLeft
+	.4f,   // AnkleLeft
+	.1f,   // FootLeft
+	.09f,  // HipRight
+	.42f,  // KneeRight
+	.4f,   // AnkleRight
+	.1f,   // FootRight
+	.2f,   // SpineShoulder
+	.08f,  // HandTipLeft
+	.06f,  // ThumbLeft
+	.08f,  // HandTipRight
+	.06f   // ThumbRight
+};
+
+void JointBuffer::clear()
+{
+	std::memset(x, 0, sizeof(x));
+	std::memset(y, 0, sizeof(y));
+	std::memset(z, 0, sizeof(z));
+	std::memset(u, 0, sizeof(u));
+	std::memset(v, 0, sizeof(v));
+	std::memset(state, JointState_NotTracked, sizeof(state));
+	std::memset(qx, 0, sizeof(qx));
+	std::memset(qy, 0, sizeof(qy));
+	std::memset(qz, 0, sizeof(qz));
+	std::memset(qw, 0, sizeof(qw));
+	for (auto& body : tracked){
+		body = false;
+	}
+}
+
+void computeBoneFrames(const JointBuffer& joints, BoneFrames& bones)
+{
+	// Bone axes and lengths, every slot is independent
+	for (int s = 0; s < SkeletonSlots; s++){
+		const int joint = s % SkeletonJointCount;
+		const int parent = skeletonParent[joint];
+		const int p = parent < 0 ? s : s - joint + parent;
+
+		const float ex = joints.x[s] - joints.x[p];
+		const float ey = joints.y[s] - joints.y[p];
+		const float ez = joints.z[s] - joints.z[p];
+		const float length = std::sqrt(ex * ex + ey * ey + ez * ez);
+		const float inverse = length > 0 ? 1.f / length : 0.f;
+
+		bones.ox[s] = joints.x[p];
+		bones.oy[s] = joints.y[p];
+		bones.oz[s] = joints.z[p];
+		bones.dx[s] = ex * inverse;
+		bones.dy[s] = ey * inverse;
+		bones.dz[s] = ez * inverse;
+		bones.length[s] = length;
+
+		const float eu = joints.u[s] - joints.u[p];
+		const float ev = joints.v[s] - joints.v[p];
+		const float length2d = std::sqrt(eu * eu + ev * ev);
+		const float inverse2d = length2d > 0 ? 1.f / length2d : 0.f;
+
+		bones.u[s] = joints.u[p];
+		bones.v[s] = joints.v[p];
+		bones.du[s] = eu * inverse2d;
+		bones.dv[s] = ev * inverse2d;
+		bones.length2d[s] = length2d;
+
+		bones.valid[s] = parent >= 0 && joints.tracked[s / SkeletonJointCount] &&
+			joints.state[s] != JointState_NotTracked && joints.state[p] != JointState_NotTracked &&
+			length > 0 && length2d > 0;
+	}
+
+	// Normals: the x axis of the child joint orientation when the sensor provides it,
+	// otherwise the direction across the bone that faces the camera
+	for (int s = 0; s < SkeletonSlots; s++){
+		const float qx = joints.qx[s], qy = joints.qy[s], qz = joints.qz[s], qw = joints.qw[s];
+		const float dx = bones.dx[s], dy = bones.dy[s], dz = bones.dz[s];
+
+		float nx, ny, nz;
+		if (qx * qx + qy * qy + qz * qz + qw * qw > 0.5f){
+			nx = 1 - 2 * (qy * qy + qz * qz);
+			ny = 2 * (qx * qy + qw * qz);
+			nz = 2 * (qx * qz - qw * qy);
+		}
+		else {
+			nx = -dy;
+			ny = dx;
+			nz = 0;
+		}
+
+		// Keep the normal orthogonal to the bone
+		const float along = nx * dx + ny * dy + nz * dz;
+		nx -= along * dx;
+		ny -= along * dy;
+		nz -= along * dz;
+
+		float norm = std::sqrt(nx * nx + ny * ny + nz * nz);
+		if (norm < 1e-6f){
+			// Bone points at the camera
+			nx = 1; ny = 0; nz = 0;
+			norm = 1;
+		}
+		nx /= norm;
+		ny /= norm;
+		nz /= norm;
+
+		bones.nx[s] = nx;
+		bones.ny[s] = ny;
+		bones.nz[s] = nz;
+		bones.bx[s] = dy * nz - dz * ny;
+		bones.by[s] = dz * nx - dx * nz;
+		bones.bz[s] = dx * ny - dy * nx;
+	}
+}
+
+bool resolveAnchor(const BoneFrames& bones, const BoneAnchor& anchor, AnchorPose& pose)
+{
+	if (anchor.bone <= 0 || anchor.bone >= SkeletonJointCount){
+		return false;
+	}
+
+	int body = anchor.body;
+	if (body < 0){
+		for (int b = 0; b < SkeletonBodyCount && body < 0; b++){
+			if (bones.valid[b * SkeletonJointCount + anchor.bone]){
+				body = b;
+			}
+		}
+	}
+	if (body < 0 || body >= SkeletonBodyCount){
+		return false;
+	}
+
+	const int s = body * SkeletonJointCount + anchor.bone;
+	if (!bones.valid[s]){
+		return false;
+	}
+
+	// 2D: along the bone, and across it on the perpendicular ( -dv, du )
+	const float length2d = bones.length2d[s];
+	pose.body = body;
+	pose.location = cv::Point2f(
+		bones.u[s] + (bones.du[s] * anchor.along - bones.dv[s] * anchor.across) * length2d,
+		bones.v[s] + (bones.dv[s] * anchor.along + bones.du[s] * anchor.across) * length2d);
+	pose.length = length2d;
+	pose.angle = static_cast<float>(std::atan2(bones.du[s], bones.dv[s]) * 180. / CV_PI);
+
+	// 3D: along the bone, and across it on the normal
+	const float length = bones.length[s];
+	pose.position = cv::Point3f(
+		bones.ox[s] + (bones.dx[s] * anchor.along + bones.nx[s] * anchor.across) * length,
+		bones.oy[s] + (bones.dy[s] * anchor.along + bones.ny[s] * anchor.across) * length,
+		bones.oz[s] + (bones.dz[s] * anchor.along + bones.nz[s] * anchor.across) * length);
+	pose.length3d = length;
+	pose.direction = cv::Vec3f(bones.dx[s], bones.dy[s], bones.dz[s]);
+	pose.normal = cv::Vec3f(bones.nx[s], bones.ny[s], bones.nz[s]);
+
+	return true;
+}
+
+float limbRadius(const BoneAnchor& anchor, const AnchorPose& pose)
+{
+	if (anchor.bone <= 0 || anchor.bone >= SkeletonJointCount){
+		return 0;
+	}
+
+	// Thicker bodies have longer bones, within reason
+	const float typical = skeletonBoneLength[anchor.bone];
+	const float size = typical > 0 ? std::max(.7f, std::min(1.4f, pose.length3d / typical)) : 1.f;
+
+	const float along = std::max(0.f, std::min(1.f, anchor.along));
+	const float parent = skeletonJointRadius[skeletonParent[anchor.bone]];
+	const float child = skeletonJointRadius[anchor.bone];
+	return (parent + (child - parent) * along) * size;
+}
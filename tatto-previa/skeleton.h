@@ -0,0 +1,117 @@
+#ifndef __SKELETON__
+#define __SKELETON__
+
+#include <opencv2/opencv.hpp>
+
+// Sizes of the Kinect v2 skeleton
+const int SkeletonBodyCount = 6;
+const int SkeletonJointCount = 25;
+const int SkeletonSlots = SkeletonBodyCount * SkeletonJointCount;
+
+// Joint ids, same values as Kinect's JointType
+enum SkeletonJoint
+{
+	Joint_SpineBase, Joint_SpineMid, Joint_Neck, Joint_Head,
+	Joint_ShoulderLeft, Joint_ElbowLeft, Joint_WristLeft, Joint_HandLeft,
+	Joint_ShoulderRight, Joint_ElbowRight, Joint_WristRight, Joint_HandRight,
+	Joint_HipLeft, Joint_KneeLeft, Joint_AnkleLeft, Joint_FootLeft,
+	Joint_HipRight, Joint_KneeRight, Joint_AnkleRight, Joint_FootRight,
+	Joint_SpineShoulder, Joint_HandTipLeft, Joint_ThumbLeft, Joint_HandTipRight, Joint_ThumbRight
+};
+
+// Parent of every joint, -1 for the root. A bone is named after its child joint.
+extern const int skeletonParent[SkeletonJointCount];
+
+// Joint tracking state, same values as Kinect's TrackingState
+enum JointState
+{
+	JointState_NotTracked = 0,
+	JointState_Inferred = 1,
+	JointState_Tracked = 2
+};
+
+// Joints of every body as structure of arrays, slot = body * SkeletonJointCount + joint
+struct JointBuffer
+{
+	// Camera space ( meters )
+	float x[SkeletonSlots], y[SkeletonSlots], z[SkeletonSlots];
+
+	// Color space ( pixels )
+	float u[SkeletonSlots], v[SkeletonSlots];
+
+	// Joint orientation quaternion, all zero when unavailable
+	float qx[SkeletonSlots], qy[SkeletonSlots], qz[SkeletonSlots], qw[SkeletonSlots];
+
+	unsigned char state[SkeletonSlots];
+	bool tracked[SkeletonBodyCount];
+
+	// Mark every body and joint as not tracked, at the origin
+	void clear();
+};
+
+// Frame of every bone as structure of arrays, slot = body * SkeletonJointCount + child joint
+struct BoneFrames
+{
+	// 3D: origin at the parent joint, unit direction, normal and binormal
+	float ox[SkeletonSlots], oy[SkeletonSlots], oz[SkeletonSlots];
+	float dx[SkeletonSlots], dy[SkeletonSlots], dz[SkeletonSlots];
+	float nx[SkeletonSlots], ny[SkeletonSlots], nz[SkeletonSlots];
+	float bx[SkeletonSlots], by[SkeletonSlots], bz[SkeletonSlots];
+	float length[SkeletonSlots];
+
+	// 2D: origin, unit direction and length in color space
+	float u[SkeletonSlots], v[SkeletonSlots];
+	float du[SkeletonSlots], dv[SkeletonSlots];
+	float length2d[SkeletonSlots];
+
+	// Both joints tracked or inferred, and the bone has a length
+	unsigned char valid[SkeletonSlots];
+};
+
+// Compute the frame of every bone of every body in one pass
+void computeBoneFrames(const JointBuffer& joints, BoneFrames& bones);
+
+// Where a tattoo sits on a bone
+struct BoneAnchor
+{
+	// Bone, named after its child joint
+	int bone;
+
+	// Body slot, -1 for the first body with this bone
+	int body;
+
+	// Position along the bone, 0 at the parent joint and 1 at the child
+	float along;
+
+	// Offset across the bone, in bone lengths
+	float across;
+};
+
+// A resolved anchor
+struct AnchorPose
+{
+	int body;
+
+	// Color space position, bone length and angle from the +y axis ( degrees, counter-clockwise )
+	cv::Point2f location;
+	float length;
+	float angle;
+
+	// Camera space position, bone length ( meters ) and bone frame
+	cv::Point3f position;
+	float length3d;
+	cv::Vec3f direction;
+	cv::Vec3f normal;
+};
+
+// Resolve an anchor against computed bone frames, false when the bone is not available
+bool resolveAnchor(const BoneFrames& bones, const BoneAnchor& anchor, AnchorPose& pose);
+
+// Typical adult limb radius at every joint and bone length to the parent ( meters )
+extern const float skeletonJointRadius[SkeletonJointCount];
+extern const float skeletonBoneLength[SkeletonJointCount];
+
+// Limb radius ( meters ) at a resolved anchor, interpolated between its joints and scaled by the tracked bone length
+float limbRadius(const BoneAnchor& anchor, const AnchorPose& pose);
+
+#endif // __SKELETON__
@@ -0,0 +1,163 @@
+#include "skin.h"
+
+// Universal intrinsics, in their own module before OpenCV 3.2
+#if ( CV_MAJOR_VERSION > 3 || ( CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2 ) )
+#include <opencv2/core/hal/intrin.hpp>
+#else
+#include <opencv2/hal/intrin.hpp>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Constructor
+SkinMask::SkinMask(int downscale)
+	: downscale(std::max(2, downscale)), crLow(133), crHigh(173), cbLow(77), cbHigh(127), margin(6)
+{
+	// Rounded up, so the likelihood reaches 0 at the margin; margin * slope fits in 16 bits
+	slope = (255 * 256 + margin - 1) / margin;
+}
+
+bool SkinMask::update(const cv::Mat& frame, const cv::Point2f& a, const cv::Point2f& b, float radius)
+{
+	clear();
+	if (frame.empty() || (frame.channels() != 3 && frame.channels() != 4) || radius <= 0){
+		return false;
+	}
+
+	// Box of the limb on a grid of whole blocks, so every sample reads inside the frame
+	const int step = downscale;
+	const int left = std::max(0, static_cast<int>(std::floor((std::min(a.x, b.x) - radius) / step)) * step);
+	const int top = std::max(0, static_cast<int>(std::floor((std::min(a.y, b.y) - radius) / step)) * step);
+	const int right = std::min(frame.cols, static_cast<int>(std::ceil(std::max(a.x, b.x) + radius)));
+	const int bottom = std::min(frame.rows, static_cast<int>(std::ceil(std::max(a.y, b.y) + radius)));
+	const int columns = (right - left) / step;
+	const int rows = (bottom - top) / step;
+	if (columns < 2 || rows < 2){
+		return false;
+	}
+
+	// One pass over the samples, each the mean of the 2 x 2 pixels at the center of its block, classified in chunks
+	const int channels = frame.channels();
+	const int center = step / 2 - 1;
+	samples.create(rows, columns, CV_8U);
+#pragma omp parallel for if (rows >= 64)
+	for (int y = 0; y < rows; y++){
+		const uchar* row0 = frame.ptr<uchar>(top + y * step + center) + (left + center) * channels;
+		const uchar* row1 = row0 + frame.step[0];
+		uchar* out = samples.ptr<uchar>(y);
+		for (int x0 = 0; x0 < columns; x0 += 64){
+			const int count = std::min(64, columns - x0);
+			uchar blue[64], green[64], red[64];
+			for (int i = 0; i < count; i++, row0 += step * channels, row1 += step * channels){
+				blue[i] = static_cast<uchar>((row0[0] + row0[channels] + row1[0] + row1[channels] + 2) >> 2);
+				green[i] = static_cast<uchar>((row0[1] + row0[channels + 1] + row1[1] + row1[channels + 1] + 2) >> 2);
+				red[i] = static_cast<uchar>((row0[2] + row0[channels + 2] + row1[2] + row1[channels + 2] + 2) >> 2);
+			}
+			classify(blue, green, red, out + x0, count);
+		}
+	}
+
+	// Pores, hair and noise would show as holes at full resolution, they are smoothed away before upsampling
+	cv::blur(samples, smoothed, cv::Size(3, 3));
+	cv::resize(smoothed, alpha, cv::Size(columns * step, rows * step), 0, 0, cv::INTER_LINEAR);
+	origin = cv::Point(left, top);
+	return true;
+}
+
+void SkinMask::clear()
+{
+	alpha.release();
+	origin = cv::Point(0, 0);
+}
+
+void SkinMask::classify(const uchar* blue, const uchar* green, const uchar* red, uchar* out, int count) const
+{
+	int i = 0;
+
+	// BT.601 as cv::COLOR_BGR2YCrCb in fixed point ( 1/256 ): r - y stays within +-179 and b - y within +-227,
+	// so both chroma products fit in 16 signed bits
+#if CV_SIMD128
+	const cv::v_uint16x8 vRed = cv::v_setall_u16(77), vGreen = cv::v_setall_u16(150), vBlue = cv::v_setall_u16(29);
+	const cv::v_int16x8 vCr = cv::v_setall_s16(183), vCb = cv::v_setall_s16(144), vMid = cv::v_setall_s16(128), vZero = cv::v_setall_s16(0);
+	const cv::v_int16x8 vCrLow = cv::v_setall_s16(static_cast<short>(crLow)), vCrHigh = cv::v_setall_s16(static_cast<short>(crHigh));
+	const cv::v_int16x8 vCbLow = cv::v_setall_s16(static_cast<short>(cbLow)), vCbHigh = cv::v_setall_s16(static_cast<short>(cbHigh));
+	const cv::v_int16x8 vMargin = cv::v_setall_s16(static_cast<short>(margin));
+	const cv::v_uint16x8 vSlope = cv::v_setall_u16(static_cast<ushort>(slope)), vFull = cv::v_setall_u16(255);
+	for (; i + 16 <= count; i += 16){
+		cv::v_uint16x8 b[2], g[2], r[2], likelihood[2];
+		cv::v_expand(cv::v_load(blue + i), b[0], b[1]);
+		cv::v_expand(cv::v_load(green + i), g[0], g[1]);
+		cv::v_expand(cv::v_load(red + i), r[0], r[1]);
+		for (int h = 0; h < 2; h++){
+			const cv::v_int16x8 y = cv::v_reinterpret_as_s16((r[h] * vRed + g[h] * vGreen + b[h] * vBlue) >> 8);
+			const cv::v_int16x8 cr = (((cv::v_reinterpret_as_s16(r[h]) - y) * vCr) >> 8) + vMid;
+			const cv::v_int16x8 cb = (((cv::v_reinterpret_as_s16(b[h]) - y) * vCb) >> 8) + vMid;
+
+			// Full inside the chroma box, falling linearly to 0 margin units outside it
+			const cv::v_int16x8 crOut = cv::v_max(vZero, cv::v_max(vCrLow - cr, cr - vCrHigh));
+			const cv::v_int16x8 cbOut = cv::v_max(vZero, cv::v_max(vCbLow - cb, cb - vCbHigh));
+			const cv::v_uint16x8 distance = cv::v_reinterpret_as_u16(cv::v_min(crOut + cbOut, vMargin));
+			likelihood[h] = vFull - ((distance * vSlope) >> 8);
+		}
+		cv::v_store(out + i, cv::v_pack(likelihood[0], likelihood[1]));
+	}
+#endif
+
+	for (; i < count; i++){
+		const int b = blue[i], g = green[i], r = red[i];
+		const int y = (77 * r + 150 * g + 29 * b) >> 8;
+		const int cr = (((r - y) * 183) >> 8) + 128;
+		const int cb = (((b - y) * 144) >> 8) + 128;
+
+		const int distance = std::max(0, std::max(crLow - cr, cr - crHigh)) + std::max(0, std::max(cbLow - cb, cb - cbHigh));
+		out[i] = static_cast<uchar>(255 - ((std::min(distance, margin) * slope) >> 8));
+	}
+}
+
+bool checkSkinMask(std::ostream& log)
+{
+	// Full HD frame on a cool gray wall, a forearm 300 px long and 50 px thick, bare up to the middle and in a blue sleeve after it
+	cv::Mat frame(1080, 1920, CV_8UC4, cv::Scalar(90, 80, 70, 255));
+	const cv::Point2f elbow(800, 500);
+	const cv::Point2f wrist(1100, 540);
+	const cv::Point2f middle = (elbow + wrist) * .5f;
+	const int thickness = 50;
+	cv::line(frame, elbow, middle, cv::Scalar(120, 150, 200, 255), thickness);
+	cv::line(frame, middle, wrist, cv::Scalar(150, 90, 60, 255), thickness);
+
+	// Speckle, so the samples do not all read the same color
+	cv::Mat noise(frame.size(), CV_8UC4);
+	cv::randu(noise, cv::Scalar::all(0), cv::Scalar(13, 13, 13, 1));
+	cv::add(frame, noise, frame);
+	cv::subtract(frame, cv::Scalar(6, 6, 6, 0), frame);
+
+	SkinMask skin;
+	const int runs = 200;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool found = true;
+	for (int i = 0; i < runs; i++){
+		found = skin.update(frame, elbow, wrist, 40) && found;
+	}
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+
+	if (!found || skin.mask().empty()){
+		log << "skin mask: no mask" << std::endl;
+		return false;
+	}
+
+	// Mean likelihood on the bare and the covered half of the arm, and on the background
+	auto mean = [&](const cv::Point2f& point){
+		const cv::Rect box(cvRound(point.x) - 8 - skin.location().x, cvRound(point.y) - 8 - skin.location().y, 16, 16);
+		return cv::mean(skin.mask()(box & cv::Rect(0, 0, skin.mask().cols, skin.mask().rows)))[0];
+	};
+	const double bare = mean(elbow + (middle - elbow) * .5f);
+	const double covered = mean(middle + (wrist - middle) * .5f);
+	const double background = mean(cv::Point2f(middle.x, middle.y - 45));
+
+	const bool ok = bare > 200 && covered < 30 && background < 30 && ms < 1.5;
+	log << "skin mask: " << skin.mask().cols << " x " << skin.mask().rows << " in " << ms << " ms ( budget 1.5 ms ), "
+		<< "skin " << bare << ", sleeve " << covered << ", background " << background << (ok ? " ok" : " FAILED") << std::endl;
+	return ok;
+}
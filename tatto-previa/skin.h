@@ -0,0 +1,50 @@
+#ifndef __SKIN__
+#define __SKIN__
+
+#include <opencv2/opencv.hpp>
+
+#include <ostream>
+
+// Skin likelihood around a limb, so ink over a sleeve is hidden. The frame is sampled at a fraction of its
+// resolution inside the bounding box of the limb only, classified by a soft YCrCb box and the result is
+// smoothed and upsampled into an alpha mask for the compositor ( 255 skin, 0 anything else ).
+class SkinMask
+{
+private:
+	// Frame pixels per sample along each axis
+	int downscale;
+
+	// Chroma box of skin and the distance outside it where the likelihood falls to 0, slope 255 / margin ( 1/256 )
+	int crLow, crHigh;
+	int cbLow, cbHigh;
+	int margin;
+	int slope;
+
+	cv::Mat samples;
+	cv::Mat smoothed;
+	cv::Mat alpha;
+	cv::Point origin;
+
+public:
+	// Constructor ( frame pixels per sample )
+	explicit SkinMask(int downscale = 4);
+
+	// Segment the box around the segment a-b widened by radius ( color space pixels ) of a BGR or BGRA frame.
+	// False, with an empty mask, when the box is outside the frame.
+	bool update(const cv::Mat& frame, const cv::Point2f& a, const cv::Point2f& b, float radius);
+
+	// Likelihood over the box, CV_8U, and the frame position of its top left corner
+	const cv::Mat& mask() const { return alpha; }
+	cv::Point location() const { return origin; }
+
+	void clear();
+
+private:
+	// Likelihood of count samples from their mean colors, 16 at a time in fixed point
+	void classify(const uchar* blue, const uchar* green, const uchar* red, uchar* out, int count) const;
+};
+
+// Segment a synthetic arm half bare and half in a sleeve and time it, false on failure or over 1.5 ms a frame
+bool checkSkinMask(std::ostream& log);
+
+#endif // __SKIN__
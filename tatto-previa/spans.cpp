@@ -0,0 +1,45 @@
+#include "spans.h"
+
+#include <stdexcept>
+
+void TattooSpans::encode(const cv::Mat& image)
+{
+	if (image.type() != CV_8UC4){
+		throw std::runtime_error("TattooSpans needs a BGRA image");
+	}
+
+	spans.clear();
+	rowStart.assign(1, 0);
+	rowStart.reserve(image.rows + 1);
+	width = image.cols;
+	inked = 0;
+
+	for (int y = 0; y < image.rows; y++){
+		const uchar* alpha = image.ptr<uchar>(y) + 3;
+
+		int x = 0;
+		while (x < image.cols){
+			// Skip transparent pixels
+			while (x < image.cols && alpha[x * 4] == 0){
+				x++;
+			}
+			if (x == image.cols){
+				break;
+			}
+
+			// Extend the run while the pixels stay of the same kind
+			TattooSpan span;
+			span.x = x;
+			span.opaque = alpha[x * 4] == 255;
+			while (x < image.cols && alpha[x * 4] != 0 && (alpha[x * 4] == 255) == span.opaque){
+				x++;
+			}
+			span.length = x - span.x;
+
+			inked += span.length;
+			spans.push_back(span);
+		}
+
+		rowStart.push_back(static_cast<int>(spans.size()));
+	}
+}
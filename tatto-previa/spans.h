@@ -0,0 +1,53 @@
+#ifndef __SPANS__
+#define __SPANS__
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+// A run of visible pixels in a row of a BGRA image
+struct TattooSpan
+{
+	int x;
+	int length;
+
+	// Every pixel has alpha 255, otherwise alpha is read per pixel
+	bool opaque;
+};
+
+// Visible pixels of a BGRA image as per-row lists of spans, fully transparent pixels are left out
+class TattooSpans
+{
+private:
+	std::vector<TattooSpan> spans;
+
+	// Spans of row y are [rowStart[y], rowStart[y + 1])
+	std::vector<int> rowStart;
+
+	int width = 0;
+	size_t inked = 0;
+
+public:
+	// Encode a BGRA image, as prepared or after warping
+	void encode(const cv::Mat& image);
+
+	// Spans of a row, ascending by x
+	const TattooSpan* row(int y, int& count) const
+	{
+		count = rowStart[y + 1] - rowStart[y];
+		return spans.data() + rowStart[y];
+	}
+
+	int rows() const { return rowStart.empty() ? 0 : static_cast<int>(rowStart.size()) - 1; }
+	int cols() const { return width; }
+	bool empty() const { return rowStart.empty(); }
+
+	// Pixels covered by spans
+	size_t area() const { return inked; }
+	size_t spanCount() const { return spans.size(); }
+
+	// Approximate memory use
+	size_t bytes() const { return spans.capacity() * sizeof(TattooSpan) + rowStart.capacity() * sizeof(int); }
+};
+
+#endif // __SPANS__
@@ -5,11 +5,17 @@
 #include "iostream"
 
 #include "app.h"
+#include "offline.h"
+#include "foreshorten.h"
+#include "framesync.h"
+#include "renderer.h"
+#include "compositor.h"
+#include "memorybudget.h"
+#include "skin.h"
+#include "bodysnapshot.h"
 
 #include "Kinect.h"
 
-cv::Mat convert_img(cv::Mat &image, double radius);
-
 int main(int argc, char* argv[])
 {
 	
@@ -38,107 +44,140 @@ int main(int argc, char* argv[])
 
 
 
-	//cv::Mat output = convert_img(img, .5);
+	//cv::Mat output = projectCylinder(img, .5);
 	//cv::namedWindow("window", CV_WINDOW_AUTOSIZE);
 	//cv::imshow("window", output);
 	//cv::waitKey(0);
 
 
-	try {
-		Kinect kinect;
-		kinect.setTattoo(filename);
-		kinect.run();
+	// --check-foreshortening compares the foreshortening homography with its cv::Mat chain
+	if (argc > 1 && std::string(argv[1]) == "--check-foreshortening"){
+		return checkForeshortening(std::cout) ? 0 : 1;
 	}
-	catch (std::exception& ex){
-		std::cout << ex.what() << std::endl;
+
+	// --check-sync pairs synthetic color and body streams
+	if (argc > 1 && std::string(argv[1]) == "--check-sync"){
+		return checkFrameSync(std::cout) ? 0 : 1;
 	}
 
+	// --check-renderer runs renderers on several threads at once against a single one
+	if (argc > 1 && std::string(argv[1]) == "--check-renderer"){
+		return checkRenderer(std::cout) ? 0 : 1;
+	}
+
+	// --check-skin segments a synthetic arm half in a sleeve and times it
+	if (argc > 1 && std::string(argv[1]) == "--check-skin"){
+		return checkSkinMask(std::cout) ? 0 : 1;
+	}
 
+	// --check-bodies hands body snapshots to readers while the writer keeps publishing
+	if (argc > 1 && std::string(argv[1]) == "--check-bodies"){
+		return checkBodyExchange(std::cout) ? 0 : 1;
+	}
 
+	// --check-shading blends a shaded tattoo over a Full HD frame against the per pixel formula and times it
+	if (argc > 1 && std::string(argv[1]) == "--check-shading"){
+		return checkShading(std::cout) ? 0 : 1;
+	}
 
-	return 0;
-}
+	// --check-palette warps line art indexed and in BGRA and compares them
+	if (argc > 1 && std::string(argv[1]) == "--check-palette"){
+		return checkPalette(std::cout) ? 0 : 1;
+	}
 
-cv::Point2f convert_pt(cv::Point2f point, int w, int h, double r_factor)
-{
-	//center the point at 0,0
-	cv::Point2f pc(point.x - w / 2, point.y - h / 2);
-
-	// these are your free parameters
-	// cylinder focal length and radius
-	float f = -w;
-	float r = w*r_factor;
-
-	float omega = w / 2;
-	float z0 = f - sqrt(r*r - omega*omega);
-
-	float zc = (2 * z0 + sqrt(4 * z0*z0 - 4 * (pc.x*pc.x / (f*f) + 1)*(z0*z0 - r*r))) / (2 * (pc.x*pc.x / (f*f) + 1));
-	cv::Point2f final_point(pc.x*zc / f, pc.y*zc / f);
-	final_point.x += w / 2;
-	final_point.y += h / 2;
-	return final_point;
-}
+	// --offline <session> <output> [tattoo ...] renders a recorded session with every tattoo, without a sensor
+	if (argc > 3 && std::string(argv[1]) == "--offline"){
+		try {
+			std::vector<std::string> files;
+			for (int i = 4; i < argc; i++){
+				files.push_back(argv[i]);
+			}
+			if (files.empty()){
+				cv::glob("images/*.png", files);
+				std::vector<std::string> vectors;
+				cv::glob("images/*.svg", vectors);
+				files.insert(files.end(), vectors.begin(), vectors.end());
+			}
 
-cv::Mat convert_img(cv::Mat &input, double radius) 
-{
-	int height = input.rows;
-	int width = input.cols;
-
-	bool found = false;
-	double xf, yf;
-
-
-	cv::Mat output = cv::Mat::ones(2 * height, 2 * width, input.type());
-
-	for (int y = 0; y < output.rows; y++)
-	{
-		for (int x = 0; x < output.cols; x++)
-		{
-			cv::Point2f current_pos(x-height/2, y-width/2);
-			current_pos = convert_pt(current_pos, width, height, radius);
-
-			cv::Point2i top_left((int)current_pos.x, (int)current_pos.y); //top left because of integer rounding
-
-			//make sure the point is actually inside the original image
-			if (top_left.x < 0 ||
-				top_left.x > width - 2 ||
-				top_left.y < 0 ||
-				top_left.y > height - 2)
-			{
-				if (!found) {
-					found = true;
-					xf = y;
-					yf = x;
+			std::vector<PreparedTattoo> tattoos;
+			for (const auto& file : files){
+				cv::Mat image = isVectorTattoo(file) ? rasterizeVector(*readVectorTattoo(file), 512) : cv::imread(file, -1);
+				if (!image.data){
+					std::cout << "ERROR: cannot read " << file << std::endl;
+					continue;
 				}
-				continue;
+				tattoos.push_back(prepareTattoo(image, tattooRadii));
+				tattoos.back().name = file;
 			}
 
-			//bilinear interpolation
-			float dx = current_pos.x - top_left.x;
-			float dy = current_pos.y - top_left.y;
-
-			float weight_tl = (1.0 - dx) * (1.0 - dy);
-			float weight_tr = (dx)* (1.0 - dy);
-			float weight_bl = (1.0 - dx) * (dy);
-			float weight_br = (dx)* (dy);
-
-			cv::Vec3b v1 = input.at<cv::Vec3b>(top_left);
-			cv::Vec3b v2 = input.at<cv::Vec3b>(top_left.y, top_left.x + 1);
-			cv::Vec3b v3 = input.at<cv::Vec3b>(top_left.y + 1, top_left.x);
-			cv::Vec3b v4 = input.at<cv::Vec3b>(top_left.y + 1, top_left.x + 1);
-			cv::Vec3b value(0, 0, 0);
-
-			for (int c = 0; c < input.channels(); ++c) {
-				value[c] = weight_tl * v1[c] +
-					weight_tr * v2[c] +
-					weight_bl * v3[c] +
-					weight_br * v4[c];
+			// The workers fill the cores, OpenCV's own threads would only compete with them
+			cv::setNumThreads(1);
+			const std::vector<SessionFrame> frames = readSession(argv[2]);
+			const OfflineStats stats = renderSession(frames, tattoos, argv[3]);
+
+			std::cout << stats.frames << " frames x " << tattoos.size() << " tattoos in " << stats.seconds << " s: "
+				<< stats.framesPerSecond() << " frames/s, " << stats.outputsPerSecond() << " images/s, "
+				<< stats.placed << " with a tattoo" << std::endl;
+			if (stats.failed > 0){
+				std::cout << "ERROR: " << stats.failed << " images could not be written to " << argv[3] << std::endl;
+				return 1;
 			}
-			output.at<cv::Vec3b>(y, x) = value;
 		}
+		catch (std::exception& ex){
+			std::cout << ex.what() << std::endl;
+			return 1;
+		}
+		return 0;
 	}
 
+	try {
+		Kinect kinect;
+		kinect.setTattoo(filename);
 
+		// --publish [name] shares the composited frames with other processes
+		for (int i = 1; i < argc; i++){
+			if (std::string(argv[i]) == "--publish"){
+				kinect.publishFrames(i + 1 < argc ? argv[i + 1] : "tattoo-previa");
+			}
+			// --record <dir> saves color frames and joints for --offline
+			else if (std::string(argv[i]) == "--record" && i + 1 < argc){
+				kinect.recordSession(argv[i + 1]);
+			}
+			// --perf reports hardware counters per stage
+			else if (std::string(argv[i]) == "--perf"){
+				kinect.profileStages();
+			}
+			// --output name:WIDTHxHEIGHT[:mirror][:fullscreen][:skeleton][:ui] adds a window, repeatable
+			else if (std::string(argv[i]) == "--output" && i + 1 < argc){
+				OutputSink sink;
+				if (!parseOutputSink(argv[i + 1], sink)){
+					std::cout << "ERROR: bad output " << argv[i + 1] << std::endl;
+					return 1;
+				}
+				kinect.addOutput(sink);
+			}
+			// --budget tag:MB bounds the image buffers of ingest, assets, warp, composite or ui, repeatable
+			else if (std::string(argv[i]) == "--budget" && i + 1 < argc){
+				const std::string spec = argv[i + 1];
+				const size_t colon = spec.find(':');
+				MemoryTag tag;
+				const int megabytes = colon == std::string::npos ? 0 : std::atoi(spec.c_str() + colon + 1);
+				if (megabytes <= 0 || !parseMemoryTag(spec.substr(0, colon), tag)){
+					std::cout << "ERROR: bad budget " << spec << std::endl;
+					return 1;
+				}
+				MemoryAccounting::instance().setBudget(tag, static_cast<size_t>(megabytes) << 20);
+			}
+		}
 
-	return output;
+		kinect.run();
+	}
+	catch (std::exception& ex){
+		std::cout << ex.what() << std::endl;
+	}
+
+
+
+
+	return 0;
 }
@@ -0,0 +1,182 @@
+#include "ui.h"
+
+#include <algorithm>
+#include <limits>
+#include <iostream>
+
+// Constructor
+ActionDispatcher::ActionDispatcher()
+	: running(true)
+{
+	worker = std::thread(&ActionDispatcher::loop, this);
+}
+
+// Destructor
+ActionDispatcher::~ActionDispatcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	condition.notify_all();
+
+	if (worker.joinable()){
+		worker.join();
+	}
+}
+
+void ActionDispatcher::post(std::function<void()> action)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		actions.push_back(action);
+	}
+	condition.notify_one();
+}
+
+size_t ActionDispatcher::pending()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return actions.size();
+}
+
+void ActionDispatcher::loop()
+{
+	while (true){
+		std::function<void()> action;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]{ return !running || !actions.empty(); });
+			if (!running && actions.empty()){
+				return;
+			}
+			action = actions.front();
+			actions.pop_front();
+		}
+
+		// An action failing must not take the UI thread down
+		try {
+			action();
+		}
+		catch (std::exception& ex){
+			std::cout << "UI action failed: " << ex.what() << std::endl;
+		}
+	}
+}
+
+size_t GestureUI::addButton(const std::string& label, ButtonMode mode, double dwellTime)
+{
+	Button button;
+	button.label = label;
+	button.center = cv::Point(0, 0);
+	button.radius = 0;
+	button.mode = mode;
+	button.dwellTime = dwellTime;
+	button.hovered = false;
+	button.fired = false;
+	button.hoverStart = 0;
+	button.progress = 0;
+
+	buttons.push_back(button);
+	return buttons.size() - 1;
+}
+
+void GestureUI::layout(const cv::Size& frameSize, float radius, float padding, int left)
+{
+	for (size_t i = 0; i < buttons.size(); i++){
+		const float step = (radius * 2 + padding) * (i + 1);
+		const cv::Point center(static_cast<int>(left + radius + padding), static_cast<int>(frameSize.height - step));
+		if (buttons[i].center != center || buttons[i].radius != radius){
+			buttons[i].center = center;
+			buttons[i].radius = radius;
+			revisionCount++;
+		}
+	}
+}
+
+void GestureUI::update(const std::vector<cv::Point>& hands, double time)
+{
+	// First frame has no elapsed time
+	const double elapsed = lastTime < 0 ? 0. : std::max(0., time - lastTime);
+	lastTime = time;
+
+	for (auto& button : buttons){
+		// Nearest hand decides the hover state
+		double distance = std::numeric_limits<double>::max();
+		for (const auto& hand : hands){
+			distance = std::min(distance, cv::norm(hand - button.center));
+		}
+
+		const bool wasHovered = button.hovered;
+		const float lastProgress = button.progress;
+		if (wasHovered){
+			button.hovered = distance < button.radius * exitFactor;
+		}
+		else {
+			button.hovered = distance < button.radius * enterFactor;
+		}
+
+		if (!button.hovered){
+			button.fired = false;
+			button.progress = 0;
+			if (wasHovered || lastProgress != 0){
+				revisionCount++;
+			}
+			continue;
+		}
+
+		if (!wasHovered){
+			button.hoverStart = time;
+		}
+
+		switch (button.mode){
+		case ButtonMode::Hold:
+			if (button.onHold && wasHovered){
+				button.onHold(elapsed);
+			}
+			break;
+		case ButtonMode::Dwell:
+			if (button.fired){
+				break;
+			}
+			button.progress = button.dwellTime > 0 ? static_cast<float>(std::min(1., (time - button.hoverStart) / button.dwellTime)) : 1.f;
+			if (button.progress >= 1.f){
+				button.fired = true;
+				if (button.onActivate){
+					dispatcher.post(button.onActivate);
+				}
+			}
+			break;
+		}
+
+		if (!wasHovered || button.progress != lastProgress){
+			revisionCount++;
+		}
+	}
+}
+
+void GestureUI::draw(cv::Mat& image) const
+{
+	const int fontFace = cv::FONT_HERSHEY_DUPLEX;
+	const double fontScale = 5;
+	const int fontThickness = 10;
+	const cv::Scalar fontColor = cv::Scalar::all(255);
+	const cv::Scalar buttonColor = cv::Scalar::all(60);
+	const cv::Scalar hoverColor = cv::Scalar::all(110);
+	const cv::Scalar progressColor = cv::Scalar(0, 200, 0);
+
+	for (const auto& button : buttons){
+		const int radius = static_cast<int>(button.radius);
+		cv::circle(image, button.center, radius, button.hovered ? hoverColor : buttonColor, -1);
+
+		// Dwell progress as an arc around the button
+		if (button.mode == ButtonMode::Dwell && button.progress > 0){
+			cv::ellipse(image, button.center, cv::Size(radius, radius), -90, 0, 360 * button.progress, progressColor, 12);
+		}
+
+		int baseline = 0;
+		const cv::Size textSize = cv::getTextSize(button.label, fontFace, fontScale, fontThickness, &baseline);
+		const cv::Point origin = button.center + cv::Point(-textSize.width / 2, textSize.height / 2);
+		cv::putText(image, button.label, origin, fontFace, fontScale, fontColor, fontThickness);
+	}
+}
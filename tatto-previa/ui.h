@@ -0,0 +1,115 @@
+#ifndef __UI__
+#define __UI__
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Runs UI actions on a worker thread so that the render loop never blocks
+class ActionDispatcher
+{
+private:
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<std::function<void()>> actions;
+	bool running;
+
+public:
+	// Constructor
+	ActionDispatcher();
+
+	// Destructor
+	~ActionDispatcher();
+
+	// Queue an action, returns immediately
+	void post(std::function<void()> action);
+
+	// Number of actions still waiting
+	size_t pending();
+
+private:
+	// Worker Loop
+	void loop();
+};
+
+// How a button reacts to a hand hovering it
+enum class ButtonMode
+{
+	// Fires every frame while hovered, with the elapsed time since the last frame
+	Hold,
+
+	// Fires once after the hand stays for dwellTime, re-arms when the hand leaves
+	Dwell
+};
+
+struct Button
+{
+	std::string label;
+	cv::Point center;
+	float radius;
+	ButtonMode mode;
+
+	// Seconds the hand must stay over a Dwell button
+	double dwellTime;
+
+	// Runs on the render thread while a Hold button is hovered ( seconds since last frame )
+	std::function<void(double)> onHold;
+
+	// Runs on the dispatcher thread when a Dwell button fires
+	std::function<void()> onActivate;
+
+	// Hover state
+	bool hovered;
+	bool fired;
+	double hoverStart;
+	float progress;
+};
+
+// Buttons activated by hand position, driven by frame timestamps
+class GestureUI
+{
+private:
+	std::vector<Button> buttons;
+	ActionDispatcher dispatcher;
+
+	// Hysteresis: a hand enters at radius * enterFactor and leaves at radius * exitFactor
+	float enterFactor = 1.f;
+	float exitFactor = 1.25f;
+
+	double lastTime = -1;
+
+	// Bumped whenever what draw shows changes
+	unsigned long long revisionCount = 0;
+
+public:
+	// Add a button, returns its index
+	size_t addButton(const std::string& label, ButtonMode mode, double dwellTime = 0.);
+
+	// A button may be edited through the reference, so it counts as a change
+	Button& button(size_t i) { revisionCount++; return buttons[i]; }
+	size_t size() const { return buttons.size(); }
+
+	// Place the buttons in a column at the bottom left of a frame
+	void layout(const cv::Size& frameSize, float radius, float padding, int left);
+
+	// Update hover state and fire actions ( time in seconds )
+	void update(const std::vector<cv::Point>& hands, double time);
+
+	// Draw buttons and dwell progress
+	void draw(cv::Mat& image) const;
+
+	// Changes when draw would draw something else
+	unsigned long long revision() const { return revisionCount; }
+
+	// Queue work on the action thread
+	void post(std::function<void()> action) { dispatcher.post(action); }
+};
+
+#endif // __UI__
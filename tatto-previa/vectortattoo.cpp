@@ -0,0 +1,878 @@
+#include "vectortattoo.h"
+#include "render.h"
+#include "memorybudget.h"
+
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cfloat>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+
+// Subpixel bits of the rasterized points
+static const int rasterShift = 4;
+
+// Paint of the current element, inherited from its groups
+struct VectorStyle
+{
+	bool filled;
+	cv::Scalar fill;
+	double fillOpacity;
+
+	bool stroked;
+	cv::Scalar stroke;
+	double strokeOpacity;
+	double strokeWidth;
+
+	double opacity;
+};
+
+// Position in the path data and the pen
+struct PathState
+{
+	std::vector<VectorSubpath>* subpaths;
+	bool open;
+	cv::Point2f current;
+	cv::Point2f start;
+
+	// Last control point of C / S and of Q / T, for the reflected S and T
+	cv::Point2f cubicControl;
+	cv::Point2f quadControl;
+	char previous;
+};
+
+bool isVectorTattoo(const std::string& filename)
+{
+	if (filename.size() < 4){
+		return false;
+	}
+
+	std::string extension = filename.substr(filename.size() - 4);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".svg";
+}
+
+// Value of an attribute of a tag, false if it is not there
+static bool attribute(const std::string& tag, const char* name, std::string& value)
+{
+	const size_t length = std::strlen(name);
+	size_t at = 0;
+	while ((at = tag.find(name, at)) != std::string::npos){
+		const size_t after = at + length;
+		size_t equals = after;
+		while (equals < tag.size() && std::isspace(static_cast<unsigned char>(tag[equals]))){
+			equals++;
+		}
+
+		// A whole attribute name, not the end of a longer one
+		if (at > 0 && std::isspace(static_cast<unsigned char>(tag[at - 1])) && equals < tag.size() && tag[equals] == '='){
+			size_t quote = equals + 1;
+			while (quote < tag.size() && std::isspace(static_cast<unsigned char>(tag[quote]))){
+				quote++;
+			}
+			if (quote < tag.size() && (tag[quote] == '"' || tag[quote] == '\'')){
+				const size_t end = tag.find(tag[quote], quote + 1);
+				if (end != std::string::npos){
+					value = tag.substr(quote + 1, end - quote - 1);
+					return true;
+				}
+			}
+		}
+		at = after;
+	}
+	return false;
+}
+
+static std::string trim(const std::string& text)
+{
+	size_t first = 0, last = text.size();
+	while (first < last && std::isspace(static_cast<unsigned char>(text[first]))){
+		first++;
+	}
+	while (last > first && std::isspace(static_cast<unsigned char>(text[last - 1]))){
+		last--;
+	}
+	return text.substr(first, last - first);
+}
+
+// A paint property, from the style attribute first and then from the attribute of the same name
+static bool property(const std::string& tag, const std::string& style, const char* name, std::string& value)
+{
+	std::stringstream declarations(style);
+	std::string declaration;
+	while (std::getline(declarations, declaration, ';')){
+		const size_t colon = declaration.find(':');
+		if (colon != std::string::npos && trim(declaration.substr(0, colon)) == name){
+			value = trim(declaration.substr(colon + 1));
+			return true;
+		}
+	}
+
+	if (attribute(tag, name, value)){
+		value = trim(value);
+		return true;
+	}
+	return false;
+}
+
+// BGR of a color, false for none
+static bool parseColor(const std::string& text, cv::Scalar& color)
+{
+	if (text == "none" || text == "transparent"){
+		return false;
+	}
+
+	if (!text.empty() && text[0] == '#'){
+		const std::string hex = text.substr(1);
+		const unsigned long value = std::strtoul(hex.c_str(), nullptr, 16);
+		if (hex.size() == 3){
+			color = cv::Scalar((value & 0xf) * 17., ((value >> 4) & 0xf) * 17., ((value >> 8) & 0xf) * 17.);
+		}
+		else {
+			color = cv::Scalar(static_cast<double>(value & 0xff), static_cast<double>((value >> 8) & 0xff), static_cast<double>((value >> 16) & 0xff));
+		}
+		return true;
+	}
+
+	int r = 0, g = 0, b = 0;
+	if (std::sscanf(text.c_str(), "rgb(%d,%d,%d)", &r, &g, &b) == 3 || std::sscanf(text.c_str(), "rgb( %d , %d , %d )", &r, &g, &b) == 3){
+		color = cv::Scalar(b, g, r);
+		return true;
+	}
+
+	// The few names tattoo art uses, anything else is black
+	static const struct { const char* name; int r, g, b; } names[] = {
+		{ "black", 0, 0, 0 }, { "white", 255, 255, 255 }, { "red", 255, 0, 0 }, { "green", 0, 128, 0 },
+		{ "blue", 0, 0, 255 }, { "yellow", 255, 255, 0 }, { "gray", 128, 128, 128 }, { "grey", 128, 128, 128 },
+		{ "orange", 255, 165, 0 }, { "purple", 128, 0, 128 }, { "navy", 0, 0, 128 }, { "maroon", 128, 0, 0 }
+	};
+	color = cv::Scalar(0, 0, 0);
+	for (const auto& named : names){
+		if (text == named.name){
+			color = cv::Scalar(named.b, named.g, named.r);
+		}
+	}
+	return true;
+}
+
+static double parseOpacity(const std::string& text)
+{
+	return std::max(0., std::min(1., std::atof(text.c_str())));
+}
+
+// Paint set by a tag over the inherited one
+static void applyStyle(const std::string& tag, VectorStyle& style)
+{
+	std::string css;
+	attribute(tag, "style", css);
+
+	std::string value;
+	if (property(tag, css, "fill", value)){
+		style.filled = parseColor(value, style.fill);
+	}
+	if (property(tag, css, "stroke", value)){
+		style.stroked = parseColor(value, style.stroke);
+	}
+	if (property(tag, css, "fill-opacity", value)){
+		style.fillOpacity = parseOpacity(value);
+	}
+	if (property(tag, css, "stroke-opacity", value)){
+		style.strokeOpacity = parseOpacity(value);
+	}
+	if (property(tag, css, "stroke-width", value)){
+		style.strokeWidth = std::max(0., std::atof(value.c_str()));
+	}
+	// Group opacity is applied to every path instead of the group as a whole
+	if (property(tag, css, "opacity", value)){
+		style.opacity *= parseOpacity(value);
+	}
+}
+
+static void skipSeparators(const std::string& d, size_t& at)
+{
+	while (at < d.size() && (std::isspace(static_cast<unsigned char>(d[at])) || d[at] == ',')){
+		at++;
+	}
+}
+
+static float readNumber(const std::string& d, size_t& at)
+{
+	skipSeparators(d, at);
+	const char* begin = d.c_str() + at;
+	char* end = nullptr;
+	const double value = std::strtod(begin, &end);
+	if (end == begin){
+		throw std::runtime_error("Bad number in path data at " + std::to_string(at));
+	}
+	at += end - begin;
+	return static_cast<float>(value);
+}
+
+// Arc flags may be written without separators ( "a5 5 0 011 1" )
+static bool readFlag(const std::string& d, size_t& at)
+{
+	skipSeparators(d, at);
+	if (at >= d.size() || (d[at] != '0' && d[at] != '1')){
+		throw std::runtime_error("Bad arc flag in path data at " + std::to_string(at));
+	}
+	return d[at++] == '1';
+}
+
+static cv::Point2f readPoint(const std::string& d, size_t& at)
+{
+	const float x = readNumber(d, at);
+	const float y = readNumber(d, at);
+	return cv::Point2f(x, y);
+}
+
+static void addSegment(PathState& state, const cv::Point2f& control1, const cv::Point2f& control2, const cv::Point2f& end, bool line)
+{
+	// Drawing after a close starts a new subpath where the last one started
+	if (!state.open){
+		VectorSubpath subpath;
+		subpath.start = state.current;
+		subpath.closed = false;
+		state.subpaths->push_back(subpath);
+		state.open = true;
+	}
+
+	VectorSegment segment;
+	segment.control1 = control1;
+	segment.control2 = control2;
+	segment.end = end;
+	segment.line = line;
+	state.subpaths->back().segments.push_back(segment);
+	state.current = end;
+}
+
+static void addLine(PathState& state, const cv::Point2f& end)
+{
+	addSegment(state, state.current, end, end, true);
+}
+
+// Elliptical arc as cubics of at most a quarter turn ( SVG implementation notes, F.6.5 )
+static void addArc(PathState& state, double rx, double ry, double rotation, bool large, bool sweep, const cv::Point2f& end)
+{
+	const cv::Point2f from = state.current;
+	if (from == end){
+		return;
+	}
+
+	rx = std::abs(rx);
+	ry = std::abs(ry);
+	if (rx == 0 || ry == 0){
+		addLine(state, end);
+		return;
+	}
+
+	const double phi = rotation * CV_PI / 180.;
+	const double c = std::cos(phi), s = std::sin(phi);
+	const double dx = (from.x - end.x) / 2., dy = (from.y - end.y) / 2.;
+	const double x1 = c * dx + s * dy;
+	const double y1 = -s * dx + c * dy;
+
+	// Radii too small to reach the end are scaled up
+	const double lambda = x1 * x1 / (rx * rx) + y1 * y1 / (ry * ry);
+	if (lambda > 1){
+		rx *= std::sqrt(lambda);
+		ry *= std::sqrt(lambda);
+	}
+
+	const double numerator = rx * rx * ry * ry - rx * rx * y1 * y1 - ry * ry * x1 * x1;
+	const double denominator = rx * rx * y1 * y1 + ry * ry * x1 * x1;
+	double coefficient = denominator > 0 ? std::sqrt(std::max(0., numerator / denominator)) : 0.;
+	if (large == sweep){
+		coefficient = -coefficient;
+	}
+	const double cx1 = coefficient * rx * y1 / ry;
+	const double cy1 = -coefficient * ry * x1 / rx;
+	const double cx = c * cx1 - s * cy1 + (from.x + end.x) / 2.;
+	const double cy = s * cx1 + c * cy1 + (from.y + end.y) / 2.;
+
+	const double theta = std::atan2((y1 - cy1) / ry, (x1 - cx1) / rx);
+	double delta = std::atan2((-y1 - cy1) / ry, (-x1 - cx1) / rx) - theta;
+	if (sweep && delta < 0){
+		delta += 2 * CV_PI;
+	}
+	else if (!sweep && delta > 0){
+		delta -= 2 * CV_PI;
+	}
+
+	const int parts = std::max(1, static_cast<int>(std::ceil(std::abs(delta) / (CV_PI / 2) - 1e-6)));
+	const double step = delta / parts;
+	const double k = 4. / 3. * std::tan(step / 4);
+
+	double t = theta;
+	for (int i = 0; i < parts; i++, t += step){
+		const double cos0 = std::cos(t), sin0 = std::sin(t);
+		const double cos1 = std::cos(t + step), sin1 = std::sin(t + step);
+
+		// Unit circle points to the ellipse
+		const double ux[3] = { cos0 - k * sin0, cos1 + k * sin1, cos1 };
+		const double uy[3] = { sin0 + k * cos0, sin1 - k * cos1, sin1 };
+		cv::Point2f points[3];
+		for (int p = 0; p < 3; p++){
+			points[p] = cv::Point2f(
+				static_cast<float>(cx + c * rx * ux[p] - s * ry * uy[p]),
+				static_cast<float>(cy + s * rx * ux[p] + c * ry * uy[p]));
+		}
+		if (i == parts - 1){
+			points[2] = end;
+		}
+		addSegment(state, points[0], points[1], points[2], false);
+	}
+}
+
+static void parsePath(const std::string& d, std::vector<VectorSubpath>& subpaths)
+{
+	PathState state;
+	state.subpaths = &subpaths;
+	state.open = false;
+	state.previous = 0;
+
+	char command = 0;
+	size_t at = 0;
+	while (true){
+		skipSeparators(d, at);
+		if (at >= d.size()){
+			break;
+		}
+
+		// Coordinates without a command repeat the last one
+		if (std::isalpha(static_cast<unsigned char>(d[at]))){
+			command = d[at++];
+		}
+		else if (command == 0){
+			throw std::runtime_error("Path data does not start with a command");
+		}
+
+		const bool relative = std::islower(static_cast<unsigned char>(command)) != 0;
+		const cv::Point2f base = relative ? state.current : cv::Point2f(0, 0);
+		const char type = static_cast<char>(std::toupper(static_cast<unsigned char>(command)));
+
+		switch (type){
+		case 'M': {
+			const cv::Point2f point = readPoint(d, at) + base;
+			VectorSubpath subpath;
+			subpath.start = point;
+			subpath.closed = false;
+			subpaths.push_back(subpath);
+			state.open = true;
+			state.current = state.start = point;
+
+			// Pairs after a move are lines
+			command = relative ? 'l' : 'L';
+			break;
+		}
+		case 'L':
+			addLine(state, readPoint(d, at) + base);
+			break;
+		case 'H':
+			addLine(state, cv::Point2f(readNumber(d, at) + base.x, state.current.y));
+			break;
+		case 'V':
+			addLine(state, cv::Point2f(state.current.x, readNumber(d, at) + base.y));
+			break;
+		case 'C': {
+			const cv::Point2f control1 = readPoint(d, at) + base;
+			const cv::Point2f control2 = readPoint(d, at) + base;
+			const cv::Point2f end = readPoint(d, at) + base;
+			addSegment(state, control1, control2, end, false);
+			state.cubicControl = control2;
+			break;
+		}
+		case 'S': {
+			const cv::Point2f control1 = state.previous == 'C' || state.previous == 'S' ? state.current * 2 - state.cubicControl : state.current;
+			const cv::Point2f control2 = readPoint(d, at) + base;
+			const cv::Point2f end = readPoint(d, at) + base;
+			addSegment(state, control1, control2, end, false);
+			state.cubicControl = control2;
+			break;
+		}
+		case 'Q':
+		case 'T': {
+			const cv::Point2f from = state.current;
+			cv::Point2f control;
+			if (type == 'Q'){
+				control = readPoint(d, at) + base;
+			}
+			else {
+				control = state.previous == 'Q' || state.previous == 'T' ? from * 2 - state.quadControl : from;
+			}
+			const cv::Point2f end = readPoint(d, at) + base;
+
+			// Quadratic as a cubic
+			addSegment(state, from + (control - from) * (2.f / 3), end + (control - end) * (2.f / 3), end, false);
+			state.quadControl = control;
+			break;
+		}
+		case 'A': {
+			const float rx = readNumber(d, at);
+			const float ry = readNumber(d, at);
+			const float rotation = readNumber(d, at);
+			const bool large = readFlag(d, at);
+			const bool sweep = readFlag(d, at);
+			addArc(state, rx, ry, rotation, large, sweep, readPoint(d, at) + base);
+			break;
+		}
+		case 'Z':
+			if (state.open && !subpaths.empty()){
+				subpaths.back().closed = true;
+			}
+			state.open = false;
+			state.current = state.start;
+
+			// Numbers can not follow a close
+			command = 0;
+			break;
+		default:
+			throw std::runtime_error(std::string("Unsupported path command ") + command);
+		}
+		state.previous = type;
+	}
+}
+
+static cv::Rect_<float> controlBounds(const std::vector<VectorSubpath>& subpaths)
+{
+	float left = FLT_MAX, top = FLT_MAX, right = -FLT_MAX, bottom = -FLT_MAX;
+	for (const auto& subpath : subpaths){
+		const cv::Point2f* points[4] = { &subpath.start, nullptr, nullptr, nullptr };
+		left = std::min(left, subpath.start.x);
+		right = std::max(right, subpath.start.x);
+		top = std::min(top, subpath.start.y);
+		bottom = std::max(bottom, subpath.start.y);
+		for (const auto& segment : subpath.segments){
+			points[1] = &segment.control1;
+			points[2] = &segment.control2;
+			points[3] = &segment.end;
+			for (int p = 1; p < 4; p++){
+				left = std::min(left, points[p]->x);
+				right = std::max(right, points[p]->x);
+				top = std::min(top, points[p]->y);
+				bottom = std::max(bottom, points[p]->y);
+			}
+		}
+	}
+	return left <= right ? cv::Rect_<float>(left, top, right - left, bottom - top) : cv::Rect_<float>();
+}
+
+std::shared_ptr<VectorTattoo> readVectorTattoo(const std::string& filename)
+{
+	static std::atomic<unsigned long long> nextId(1);
+
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file){
+		throw std::runtime_error("Cannot read " + filename);
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	const std::string text = contents.str();
+
+	std::shared_ptr<VectorTattoo> tattoo = std::make_shared<VectorTattoo>();
+	tattoo->name = filename;
+	tattoo->id = nextId++;
+
+	// Paint defaults of SVG, one entry per open group
+	VectorStyle initial;
+	initial.filled = true;
+	initial.fill = cv::Scalar(0, 0, 0);
+	initial.fillOpacity = 1;
+	initial.stroked = false;
+	initial.stroke = cv::Scalar(0, 0, 0);
+	initial.strokeOpacity = 1;
+	initial.strokeWidth = 1;
+	initial.opacity = 1;
+	std::vector<VectorStyle> styles(1, initial);
+
+	bool sized = false;
+	size_t at = 0;
+	while ((at = text.find('<', at)) != std::string::npos){
+		if (text.compare(at, 4, "<!--") == 0){
+			const size_t end = text.find("-->", at);
+			at = end == std::string::npos ? text.size() : end + 3;
+			continue;
+		}
+
+		const size_t end = text.find('>', at);
+		if (end == std::string::npos){
+			break;
+		}
+		// Leading space so the first attribute is found like the others
+		const std::string tag = " " + text.substr(at + 1, end - at - 1);
+		const bool selfClosing = end > at && text[end - 1] == '/';
+		at = end + 1;
+
+		std::stringstream words(tag);
+		std::string element;
+		words >> element;
+		if (!element.empty() && element.back() == '/'){
+			element.pop_back();
+		}
+
+		if (element == "svg"){
+			std::string value;
+			float x, y, w, h;
+			if (attribute(tag, "viewBox", value) && std::sscanf(value.c_str(), "%f%*[ ,]%f%*[ ,]%f%*[ ,]%f", &x, &y, &w, &h) == 4){
+				tattoo->origin = cv::Point2f(x, y);
+				tattoo->size = cv::Size2f(w, h);
+				sized = true;
+			}
+			else if (attribute(tag, "width", value) && (w = static_cast<float>(std::atof(value.c_str()))) > 0 &&
+				attribute(tag, "height", value) && (h = static_cast<float>(std::atof(value.c_str()))) > 0){
+				tattoo->size = cv::Size2f(w, h);
+				sized = true;
+			}
+			styles.push_back(styles.back());
+			applyStyle(tag, styles.back());
+		}
+		else if (element == "g"){
+			styles.push_back(styles.back());
+			applyStyle(tag, styles.back());
+			if (selfClosing){
+				styles.pop_back();
+			}
+		}
+		else if ((element == "/g" || element == "/svg") && styles.size() > 1){
+			styles.pop_back();
+		}
+		else if (element == "path"){
+			VectorStyle style = styles.back();
+			applyStyle(tag, style);
+
+			std::string d;
+			if (!attribute(tag, "d", d)){
+				continue;
+			}
+
+			VectorPath path;
+			parsePath(d, path.subpaths);
+			path.filled = style.filled && style.fillOpacity * style.opacity > 0;
+			path.fill = style.fill;
+			path.fillOpacity = style.fillOpacity * style.opacity;
+			path.stroked = style.stroked && style.strokeWidth > 0 && style.strokeOpacity * style.opacity > 0;
+			path.stroke = style.stroke;
+			path.strokeOpacity = style.strokeOpacity * style.opacity;
+			path.strokeWidth = style.strokeWidth;
+			path.bounds = controlBounds(path.subpaths);
+			if (!path.subpaths.empty() && (path.filled || path.stroked)){
+				tattoo->paths.push_back(path);
+			}
+		}
+	}
+
+	if (!sized){
+		throw std::runtime_error(filename + " has no viewBox or size");
+	}
+	return tattoo;
+}
+
+// Fixed point pixel of a document point, pixel centers are on integers
+static cv::Point rasterPoint(const cv::Point2f& point, const cv::Point2f& origin, double scale, const cv::Point& offset)
+{
+	const double one = 1 << rasterShift;
+	return cv::Point(
+		cvRound(((point.x - origin.x) * scale - offset.x - .5) * one),
+		cvRound(((point.y - origin.y) * scale - offset.y - .5) * one));
+}
+
+// Polygons of a path, curves split so they are off by at most a quarter pixel
+static void flattenPath(const VectorPath& path, const cv::Point2f& origin, double scale, const cv::Point& offset, std::vector<std::vector<cv::Point>>& contours)
+{
+	contours.resize(path.subpaths.size());
+	for (size_t i = 0; i < path.subpaths.size(); i++){
+		const VectorSubpath& subpath = path.subpaths[i];
+		std::vector<cv::Point>& contour = contours[i];
+		contour.clear();
+		contour.push_back(rasterPoint(subpath.start, origin, scale, offset));
+
+		cv::Point2f from = subpath.start;
+		for (const auto& segment : subpath.segments){
+			if (!segment.line){
+				// The second difference bounds the curvature, a uniform split of n is off by 6 dd / 8 n^2
+				const cv::Point2f d1 = from - segment.control1 * 2 + segment.control2;
+				const cv::Point2f d2 = segment.control1 - segment.control2 * 2 + segment.end;
+				const double dd = std::max(std::sqrt(d1.dot(d1)), std::sqrt(d2.dot(d2))) * scale;
+				const int parts = std::max(1, std::min(64, static_cast<int>(std::ceil(std::sqrt(3 * dd)))));
+
+				for (int p = 1; p < parts; p++){
+					const float t = static_cast<float>(p) / parts, u = 1 - t;
+					const cv::Point2f point = from * (u * u * u) + segment.control1 * (3 * u * u * t) + segment.control2 * (3 * u * t * t) + segment.end * (t * t * t);
+					contour.push_back(rasterPoint(point, origin, scale, offset));
+				}
+			}
+			contour.push_back(rasterPoint(segment.end, origin, scale, offset));
+			from = segment.end;
+		}
+	}
+}
+
+// Paint a color over the tile where the coverage is set, straight alpha
+static void paint(cv::Mat& output, const cv::Mat& coverage, const cv::Rect& pixels, const cv::Scalar& color, double opacity)
+{
+	const int alpha = cvRound(opacity * 256);
+	const int blue = static_cast<int>(color[0]), green = static_cast<int>(color[1]), red = static_cast<int>(color[2]);
+
+	for (int y = pixels.y; y < pixels.y + pixels.height; y++){
+		const uchar* cover = coverage.ptr<uchar>(y);
+		uchar* px = output.ptr<uchar>(y) + pixels.x * 4;
+		for (int x = pixels.x; x < pixels.x + pixels.width; x++, px += 4){
+			const int a = (cover[x] * alpha) >> 8;
+			if (a == 0){
+				continue;
+			}
+
+			// ( 1/255^2 )
+			const int under = px[3] * (255 - a);
+			const int total = a * 255 + under;
+			px[0] = static_cast<uchar>((blue * a * 255 + px[0] * under + total / 2) / total);
+			px[1] = static_cast<uchar>((green * a * 255 + px[1] * under + total / 2) / total);
+			px[2] = static_cast<uchar>((red * a * 255 + px[2] * under + total / 2) / total);
+			px[3] = static_cast<uchar>((total + 127) / 255);
+		}
+	}
+}
+
+bool rasterizeVector(const VectorTattoo& tattoo, double scale, const cv::Rect& area, cv::Mat& output)
+{
+	output.create(area.size(), CV_8UC4);
+	output.setTo(cv::Scalar::all(0));
+
+	const cv::Rect tile(0, 0, area.width, area.height);
+	cv::Mat coverage(area.size(), CV_8UC1, cv::Scalar(0));
+	std::vector<std::vector<cv::Point>> contours;
+	bool painted = false;
+
+	for (const auto& path : tattoo.paths){
+		// Pixels the path can touch, with its stroke and antialiasing
+		const double margin = (path.stroked ? path.strokeWidth * scale / 2 : 0) + 2;
+		const cv::Point2f corner = (path.bounds.tl() - tattoo.origin) * static_cast<float>(scale);
+		const cv::Rect reach = cv::Rect(
+			cvFloor(corner.x - margin) - area.x, cvFloor(corner.y - margin) - area.y,
+			cvCeil(path.bounds.width * scale + margin * 2) + 1, cvCeil(path.bounds.height * scale + margin * 2) + 1) & tile;
+		if (reach.area() == 0){
+			continue;
+		}
+
+		flattenPath(path, tattoo.origin, scale, area.tl(), contours);
+
+		if (path.filled){
+			cv::fillPoly(coverage, contours, cv::Scalar(255), cv::LINE_AA, rasterShift);
+			paint(output, coverage, reach, path.fill, path.fillOpacity);
+			coverage(reach).setTo(0);
+		}
+
+		if (path.stroked){
+			const int thickness = std::max(1, cvRound(path.strokeWidth * scale));
+			for (size_t i = 0; i < contours.size(); i++){
+				const cv::Point* points = &contours[i][0];
+				const int count = static_cast<int>(contours[i].size());
+				cv::polylines(coverage, &points, &count, 1, path.subpaths[i].closed, cv::Scalar(255), thickness, cv::LINE_AA, rasterShift);
+			}
+			paint(output, coverage, reach, path.stroke, path.strokeOpacity);
+			coverage(reach).setTo(0);
+		}
+		painted = true;
+	}
+	return painted;
+}
+
+cv::Mat rasterizeVector(const VectorTattoo& tattoo, int height)
+{
+	const double scale = tattoo.size.height > 0 ? height / tattoo.size.height : 0;
+	cv::Mat image;
+	rasterizeVector(tattoo, scale, cv::Rect(0, 0, std::max(1, cvCeil(tattoo.size.width * scale)), std::max(1, height)), image);
+	return image;
+}
+
+int vectorScaleStep(double scale)
+{
+	return scale > 0 ? cvRound(std::log(scale) / std::log(2.) * 8) : 0;
+}
+
+double vectorScale(int step)
+{
+	return std::pow(2., step / 8.);
+}
+
+// Constructor
+VectorTileCache::VectorTileCache(int tileSize, size_t capacity)
+	: tileSize(std::max(16, tileSize)), capacity(capacity)
+{
+}
+
+cv::Mat VectorTileCache::raster(const VectorTattoo& tattoo, int scaleStep)
+{
+	const double scale = vectorScale(scaleStep);
+	const cv::Size size(std::max(1, cvCeil(tattoo.size.width * scale)), std::max(1, cvCeil(tattoo.size.height * scale)));
+	const int columns = (size.width + tileSize - 1) / tileSize;
+	const int rows = (size.height + tileSize - 1) / tileSize;
+
+	// Cached tiles first, the missing ones are rasterized in parallel
+	std::vector<cv::Mat> tiles(columns * rows);
+	std::vector<int> missing;
+	for (int i = 0; i < columns * rows; i++){
+		Key key = { tattoo.id, scaleStep, i % columns, i / columns };
+		const auto found = index.find(key);
+		if (found == index.end()){
+			missing.push_back(i);
+			misses++;
+			continue;
+		}
+		entries.splice(entries.begin(), entries, found->second);
+		tiles[i] = found->second->tile;
+		hits++;
+	}
+
+	const cv::Rect whole(cv::Point(0, 0), size);
+#pragma omp parallel for schedule(dynamic)
+	for (int m = 0; m < static_cast<int>(missing.size()); m++){
+		const int i = missing[m];
+		const cv::Rect area = cv::Rect((i % columns) * tileSize, (i / columns) * tileSize, tileSize, tileSize) & whole;
+
+		// Empty tiles are cached without pixels
+		cv::Mat tile;
+		if (rasterizeVector(tattoo, scale, area, tile)){
+			tiles[i] = tile;
+		}
+	}
+
+	for (const int i : missing){
+		Entry entry;
+		entry.key.tattoo = tattoo.id;
+		entry.key.scale = scaleStep;
+		entry.key.x = i % columns;
+		entry.key.y = i / columns;
+		entry.tile = tiles[i];
+		entry.bytes = tiles[i].total() * tiles[i].elemSize() + sizeof(Entry);
+		entries.push_front(entry);
+		index[entry.key] = entries.begin();
+		used += entry.bytes;
+	}
+
+	cv::Mat image(size, CV_8UC4, cv::Scalar::all(0));
+	for (int i = 0; i < columns * rows; i++){
+		if (!tiles[i].empty()){
+			tiles[i].copyTo(image(cv::Rect((i % columns) * tileSize, (i / columns) * tileSize, tiles[i].cols, tiles[i].rows)));
+		}
+	}
+
+	// Least recently used last, the tiles of this raster are all at the front
+	while (used > capacity && !entries.empty()){
+		used -= entries.back().bytes;
+		index.erase(entries.back().key);
+		entries.pop_back();
+	}
+	return image;
+}
+
+void VectorTileCache::clear()
+{
+	entries.clear();
+	index.clear();
+	used = 0;
+}
+
+// Constructor
+VectorRasterizer::VectorRasterizer(int maxSide)
+	: maxSide(std::max(64, maxSide))
+{
+	worker = std::thread(&VectorRasterizer::run, this);
+}
+
+// Destructor
+VectorRasterizer::~VectorRasterizer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void VectorRasterizer::request(const std::shared_ptr<const VectorTattoo>& tattoo, double scale, bool bilinear)
+{
+	if (!tattoo || tattoo->empty() || scale <= 0){
+		return;
+	}
+
+	// Steps below the largest side allowed
+	const double largest = std::max(tattoo->size.width, tattoo->size.height);
+	const double fractional = std::min(std::log(scale), std::log(maxSide / largest)) / std::log(2.) * 8;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Keep the step until the scale is well into another, so jitter at a boundary does not rasterize twice
+	if (tattoo == requestedTattoo && std::abs(fractional - requestedStep) < .75){
+		return;
+	}
+
+	requestedTattoo = tattoo;
+	requestedStep = std::min(cvRound(fractional), cvFloor(std::log(maxSide / largest) / std::log(2.) * 8));
+	job.tattoo = tattoo;
+	job.scaleStep = requestedStep;
+	job.bilinear = bilinear;
+	queued = true;
+	wake.notify_one();
+}
+
+bool VectorRasterizer::take(PreparedTattoo& tattoo)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!ready){
+		return false;
+	}
+
+	tattoo = *ready;
+	ready.reset();
+	return true;
+}
+
+void VectorRasterizer::dropTiles()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		dropping = true;
+	}
+	wake.notify_one();
+}
+
+void VectorRasterizer::run()
+{
+	// Rasters and tiles are counted as assets
+	MemoryScope scope(Memory_Assets);
+
+	while (true){
+		Job current;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]{ return stopping || queued || dropping; });
+			if (stopping){
+				return;
+			}
+			if (dropping){
+				tiles.clear();
+				dropping = false;
+			}
+			if (!queued){
+				continue;
+			}
+			current = job;
+			job.tattoo.reset();
+			queued = false;
+		}
+
+		const cv::Mat image = tiles.raster(*current.tattoo, current.scaleStep);
+		std::unique_ptr<PreparedTattoo> prepared(new PreparedTattoo(prepareTattoo(image, tattooRadii, current.bilinear)));
+		prepared->name = current.tattoo->name;
+		prepared->source = current.tattoo;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		ready = std::move(prepared);
+	}
+}
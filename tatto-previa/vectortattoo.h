@@ -0,0 +1,204 @@
+#ifndef __VECTORTATTOO__
+#define __VECTORTATTOO__
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstddef>
+
+struct PreparedTattoo;
+
+// Cubic segment of a path, lines have their controls on the line
+struct VectorSegment
+{
+	cv::Point2f control1;
+	cv::Point2f control2;
+	cv::Point2f end;
+	bool line;
+};
+
+struct VectorSubpath
+{
+	cv::Point2f start;
+	std::vector<VectorSegment> segments;
+	bool closed;
+};
+
+// A filled and / or stroked path, in document units
+struct VectorPath
+{
+	std::vector<VectorSubpath> subpaths;
+
+	bool filled;
+	cv::Scalar fill;
+	double fillOpacity;
+
+	bool stroked;
+	cv::Scalar stroke;
+	double strokeOpacity;
+	double strokeWidth;
+
+	// Control point bounds, without the stroke
+	cv::Rect_<float> bounds;
+};
+
+// A tattoo drawn from paths, rasterized at any scale
+struct VectorTattoo
+{
+	std::string name;
+
+	// Unique for every tattoo read, keys its tiles
+	unsigned long long id = 0;
+
+	// viewBox origin and size, in document units
+	cv::Point2f origin;
+	cv::Size2f size;
+
+	// Painted in order
+	std::vector<VectorPath> paths;
+
+	bool empty() const { return paths.empty() || size.width <= 0 || size.height <= 0; }
+};
+
+// True for the files readVectorTattoo reads ( .svg )
+bool isVectorTattoo(const std::string& filename);
+
+// Read the SVG subset of tattoos: <path> with M L H V C S Q T A Z, fill, stroke, stroke-width,
+// the opacities ( also in style ) and their inheritance from <g>. Transforms and other elements
+// are ignored. Throws if the file can not be read or has no viewBox or size.
+std::shared_ptr<VectorTattoo> readVectorTattoo(const std::string& filename);
+
+// Rasterize the area of a tattoo at scale ( pixels per unit ) into a BGRA tile, transparent
+// where nothing is painted. The area is in pixels of the whole raster. False if no path reaches the area.
+bool rasterizeVector(const VectorTattoo& tattoo, double scale, const cv::Rect& area, cv::Mat& output);
+
+// Rasterize the whole tattoo height pixels tall
+cv::Mat rasterizeVector(const VectorTattoo& tattoo, int height);
+
+// Least recently used tiles of rasterized tattoos, by tattoo, scale step and tile position
+class VectorTileCache
+{
+private:
+	struct Key
+	{
+		unsigned long long tattoo;
+		int scale;
+		int x;
+		int y;
+
+		bool operator==(const Key& other) const
+		{
+			return tattoo == other.tattoo && scale == other.scale && x == other.x && y == other.y;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			size_t hash = std::hash<unsigned long long>()(key.tattoo);
+			hash = hash * 31 + std::hash<int>()(key.scale);
+			hash = hash * 31 + std::hash<int>()(key.x);
+			hash = hash * 31 + std::hash<int>()(key.y);
+			return hash;
+		}
+	};
+
+	struct Entry
+	{
+		Key key;
+		cv::Mat tile;
+		size_t bytes;
+	};
+
+	std::list<Entry> entries;
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+
+	int tileSize;
+	size_t capacity;
+	size_t used = 0;
+
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+
+public:
+	// Constructor ( tile side in pixels, capacity in bytes )
+	explicit VectorTileCache(int tileSize = 256, size_t capacity = 64 << 20);
+
+	// Assemble the raster of a tattoo at a scale step, rasterizing only the tiles not cached
+	cv::Mat raster(const VectorTattoo& tattoo, int scaleStep);
+
+	// Drop every tile
+	void clear();
+
+	// Statistics
+	double hitRate() const { return hits + misses == 0 ? 0. : static_cast<double>(hits) / (hits + misses); }
+	size_t bytes() const { return used; }
+};
+
+// Scale steps are an eighth of an octave, smaller zoom changes reuse the raster and the warp makes up the rest
+int vectorScaleStep(double scale);
+double vectorScale(int step);
+
+// Rasterizes and projects vector tattoos at the scale they are shown on a background thread.
+// The render thread requests a scale every frame and takes the prepared tattoo once it is ready.
+class VectorRasterizer
+{
+private:
+	struct Job
+	{
+		std::shared_ptr<const VectorTattoo> tattoo;
+		int scaleStep;
+		bool bilinear;
+	};
+
+	VectorTileCache tiles;
+
+	// Largest side of a raster, the projected tattoo is twice as big
+	int maxSide;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	bool queued = false;
+	bool dropping = false;
+	Job job;
+
+	// Last requested, so repeated requests are free
+	std::shared_ptr<const VectorTattoo> requestedTattoo;
+	int requestedStep = 0;
+
+	std::unique_ptr<PreparedTattoo> ready;
+	std::thread worker;
+
+public:
+	// Constructor ( largest raster side in pixels )
+	explicit VectorRasterizer(int maxSide = 1024);
+
+	// Destructor, waits for a job in progress
+	~VectorRasterizer();
+
+	// Ask for the tattoo at scale ( pixels per unit ), replaces a request not started yet
+	void request(const std::shared_ptr<const VectorTattoo>& tattoo, double scale, bool bilinear);
+
+	// The newest prepared tattoo, false while none is ready
+	bool take(PreparedTattoo& tattoo);
+
+	// Free the cached tiles, on the worker thread as soon as it is idle
+	void dropTiles();
+
+private:
+	void run();
+
+	VectorRasterizer(const VectorRasterizer&);
+	VectorRasterizer& operator=(const VectorRasterizer&);
+};
+
+#endif // __VECTORTATTOO__
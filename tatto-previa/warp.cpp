@@ -0,0 +1,108 @@
+#include "warp.h"
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+
+// Depth scale of a column centered at pcx, the cylinder only bends along x
+static inline float cylinderScale(float pcx, int w, double r_factor)
+{
+	// these are your free parameters
+	// cylinder focal length and radius
+	float f = -w;
+	float r = w*r_factor;
+
+	float omega = w / 2;
+	float z0 = f - sqrt(r*r - omega*omega);
+
+	float a = pcx*pcx / (f*f) + 1;
+	float zc = (2 * z0 + sqrt(4 * z0*z0 - 4 * a*(z0*z0 - r*r))) / (2 * a);
+	return zc / f;
+}
+
+cv::Point2f cylinderSourcePoint(const cv::Point2f point, int w, int h, double r_factor)
+{
+	//center the point at 0,0
+	cv::Point2f pc(point.x - w / 2, point.y - h / 2);
+
+	const float scale = cylinderScale(pc.x, w, r_factor);
+	cv::Point2f final_point(pc.x*scale, pc.y*scale);
+	final_point.x += w / 2;
+	final_point.y += h / 2;
+	return final_point;
+}
+
+cv::Mat projectCylinder(const cv::Mat &input, double r_factor, bool bilinear)
+{
+	if (input.depth() != CV_8U){
+		throw std::runtime_error("projectCylinder needs an 8 bit image");
+	}
+
+	const int height = input.rows;
+	const int width = input.cols;
+	const int channels = input.channels();
+
+	// Padding is zero, so it is transparent for BGRA
+	cv::Mat output = cv::Mat::zeros(2 * height, 2 * width, input.type());
+	if (input.empty()){
+		return output;
+	}
+
+	// The source column and the vertical scale only depend on the output column
+	std::vector<float> sourceX(output.cols);
+	std::vector<float> scaleY(output.cols);
+	for (int x = 0; x < output.cols; x++){
+		// the source is centered in the output
+		const float pcx = static_cast<float>(x - width / 2 - width / 2);
+		scaleY[x] = cylinderScale(pcx, width, r_factor);
+		sourceX[x] = pcx * scaleY[x] + width / 2;
+	}
+
+#pragma omp parallel for
+	for (int y = 0; y < output.rows; y++)
+	{
+		uchar* out = output.ptr<uchar>(y);
+		const float pcy = static_cast<float>(y - height / 2 - height / 2);
+
+		for (int x = 0; x < output.cols; x++)
+		{
+			const float sx = sourceX[x];
+			const float sy = pcy * scaleY[x] + height / 2;
+
+			//make sure the point is actually inside the original image ( also rejects NaN )
+			if (!(sx >= 0 && sx < width - 1 && sy >= 0 && sy < height - 1))
+			{
+				continue;
+			}
+
+			const int left = static_cast<int>(sx);
+			const int top = static_cast<int>(sy);
+
+			//bilinear interpolation, or the nearest of the four texels
+			float dx = sx - left;
+			float dy = sy - top;
+			if (!bilinear) {
+				dx = dx < .5f ? 0.f : 1.f;
+				dy = dy < .5f ? 0.f : 1.f;
+			}
+
+			const float weight_tl = (1.f - dx) * (1.f - dy);
+			const float weight_tr = dx * (1.f - dy);
+			const float weight_bl = (1.f - dx) * dy;
+			const float weight_br = dx * dy;
+
+			const uchar* tl = input.ptr<uchar>(top) + left * channels;
+			const uchar* bl = input.ptr<uchar>(top + 1) + left * channels;
+			uchar* value = out + x * channels;
+
+			for (int c = 0; c < channels; ++c) {
+				value[c] = static_cast<uchar>(weight_tl * tl[c] +
+					weight_tr * tl[c + channels] +
+					weight_bl * bl[c] +
+					weight_br * bl[c + channels] + .5f);
+			}
+		}
+	}
+
+	return output;
+}
@@ -0,0 +1,13 @@
+#ifndef __WARP__
+#define __WARP__
+
+#include <opencv2/opencv.hpp>
+
+// Map a point of a w x h frame through the cylinder back to the source image
+cv::Point2f cylinderSourcePoint(const cv::Point2f point, int w, int h, double r_factor);
+
+// Project an image onto a cylinder of radius r_factor * width.
+// The output is twice the input size; pixels outside the source are zero ( transparent for BGRA ).
+cv::Mat projectCylinder(const cv::Mat &input, double r_factor, bool bilinear = true);
+
+#endif // __WARP__
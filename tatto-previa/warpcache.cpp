@@ -0,0 +1,114 @@
+#include "warpcache.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Constructor
+WarpCache::WarpCache(size_t capacity, double angleStep, double scaleStep)
+	: angleStep(angleStep), scaleStep(scaleStep), capacity(capacity)
+{
+	setQuantization(angleStep, scaleStep);
+}
+
+void WarpCache::setQuantization(double angle, double scale)
+{
+	angleStep = std::max(1e-3, angle);
+	scaleStep = std::max(1e-4, scale);
+	clear();
+}
+
+void WarpCache::setCapacity(size_t bytes)
+{
+	capacity = bytes;
+	evict(capacity);
+}
+
+WarpKey WarpCache::key(unsigned long long tattoo, double angle, double scale, int variant) const
+{
+	WarpKey key;
+	key.tattoo = tattoo;
+	key.angle = static_cast<int>(std::floor(angle / angleStep + .5));
+	// scale is quantized on a log scale, so the step is relative
+	key.scale = scale > 0 ? static_cast<int>(std::floor(std::log(scale) / std::log1p(scaleStep) + .5)) : 0;
+	key.variant = variant;
+	return key;
+}
+
+double WarpCache::angle(const WarpKey& key) const
+{
+	return key.angle * angleStep;
+}
+
+double WarpCache::scale(const WarpKey& key) const
+{
+	return std::exp(key.scale * std::log1p(scaleStep));
+}
+
+bool WarpCache::find(const WarpKey& key, cv::Mat& image)
+{
+	std::shared_ptr<const TattooSpans> spans;
+	return find(key, image, spans);
+}
+
+bool WarpCache::find(const WarpKey& key, cv::Mat& image, std::shared_ptr<const TattooSpans>& spans)
+{
+	const auto found = index.find(key);
+	if (found == index.end()){
+		misses++;
+		return false;
+	}
+
+	// Move to the front, most recently used
+	entries.splice(entries.begin(), entries, found->second);
+	image = found->second->image;
+	spans = found->second->spans;
+	hits++;
+	return true;
+}
+
+void WarpCache::insert(const WarpKey& key, const cv::Mat& image, const std::shared_ptr<const TattooSpans>& spans)
+{
+	const size_t bytes = image.total() * image.elemSize() + (spans ? spans->bytes() : 0);
+	if (bytes > capacity){
+		return;
+	}
+
+	const auto found = index.find(key);
+	if (found != index.end()){
+		used -= found->second->bytes;
+		entries.erase(found->second);
+		index.erase(found);
+	}
+
+	evict(capacity - bytes);
+
+	Entry entry;
+	entry.key = key;
+	entry.image = image;
+	entry.spans = spans;
+	entry.bytes = bytes;
+	entries.push_front(entry);
+	index[key] = entries.begin();
+	used += bytes;
+}
+
+void WarpCache::trim(size_t bytes)
+{
+	evict(bytes);
+}
+
+void WarpCache::clear()
+{
+	entries.clear();
+	index.clear();
+	used = 0;
+}
+
+void WarpCache::evict(size_t limit)
+{
+	while (used > limit && !entries.empty()){
+		used -= entries.back().bytes;
+		index.erase(entries.back().key);
+		entries.pop_back();
+	}
+}
@@ -0,0 +1,105 @@
+#ifndef __WARPCACHE__
+#define __WARPCACHE__
+
+#include "spans.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstddef>
+
+// Quantized pose of a warped tattoo
+struct WarpKey
+{
+	unsigned long long tattoo;
+	int angle;
+	int scale;
+	int variant;
+
+	bool operator==(const WarpKey& other) const
+	{
+		return tattoo == other.tattoo && angle == other.angle && scale == other.scale && variant == other.variant;
+	}
+};
+
+struct WarpKeyHash
+{
+	size_t operator()(const WarpKey& key) const
+	{
+		size_t hash = std::hash<unsigned long long>()(key.tattoo);
+		hash = hash * 31 + std::hash<int>()(key.angle);
+		hash = hash * 31 + std::hash<int>()(key.scale);
+		hash = hash * 31 + std::hash<int>()(key.variant);
+		return hash;
+	}
+};
+
+// Least recently used cache of warped tattoo rasters
+class WarpCache
+{
+private:
+	struct Entry
+	{
+		WarpKey key;
+		cv::Mat image;
+		std::shared_ptr<const TattooSpans> spans;
+		size_t bytes;
+	};
+
+	std::list<Entry> entries;
+	std::unordered_map<WarpKey, std::list<Entry>::iterator, WarpKeyHash> index;
+
+	// Quantization: degrees per angle step, relative change per scale step
+	double angleStep;
+	double scaleStep;
+
+	size_t capacity;
+	size_t used = 0;
+
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+
+public:
+	// Constructor ( capacity in bytes )
+	explicit WarpCache(size_t capacity = 64 << 20, double angleStep = 1., double scaleStep = .01);
+
+	// Change the quantization, drops every entry
+	void setQuantization(double angleStep, double scaleStep);
+
+	// Change the memory limit, evicting as needed
+	void setCapacity(size_t bytes);
+
+	// Key of a pose, variant separates rasters made with different settings
+	WarpKey key(unsigned long long tattoo, double angle, double scale, int variant) const;
+
+	// The pose a key stands for, warps must use it so that entries are exact
+	double angle(const WarpKey& key) const;
+	double scale(const WarpKey& key) const;
+
+	// Look up a raster, shares the cached data on hit
+	bool find(const WarpKey& key, cv::Mat& image);
+	bool find(const WarpKey& key, cv::Mat& image, std::shared_ptr<const TattooSpans>& spans);
+
+	// Add a raster and optionally its spans, the cache keeps a reference so it must not be written afterwards
+	void insert(const WarpKey& key, const cv::Mat& image, const std::shared_ptr<const TattooSpans>& spans = nullptr);
+
+	// Evict the least recently used entries down to bytes, the capacity stays
+	void trim(size_t bytes);
+
+	// Drop every entry
+	void clear();
+
+	// Statistics
+	unsigned long long hitCount() const { return hits; }
+	unsigned long long missCount() const { return misses; }
+	double hitRate() const { return hits + misses == 0 ? 0. : static_cast<double>(hits) / (hits + misses); }
+	size_t bytes() const { return used; }
+	size_t size() const { return entries.size(); }
+
+private:
+	void evict(size_t limit);
+};
+
+#endif // __WARPCACHE__
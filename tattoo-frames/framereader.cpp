@@ -0,0 +1,76 @@
+// framereader.cpp : Reads the frames published by tattoo-previa or tattoo-render --publish from another process.
+//
+// Usage: tattoo-frames [name] [-show]
+// Prints frame number, latency and pose of each new frame, and counts frames the writer overwrote while being read.
+
+#include "sharedframe.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+
+int main(int argc, char* argv[])
+{
+	std::string name = "tattoo-previa";
+	bool show = false;
+	for (int i = 1; i < argc; i++){
+		const std::string arg = argv[i];
+		if (arg == "-show"){
+			show = true;
+		}
+		else {
+			name = arg;
+		}
+	}
+
+	FrameReader reader;
+	uint64_t last = 0;
+	uint64_t frames = 0;
+	uint64_t torn = 0;
+	while (true){
+		// First time, and again whenever the publisher leaves the region ( new format or exit )
+		if (reader.closed()){
+			while (!reader.open(name)){
+				std::cout << "waiting for " << name << "..." << std::endl;
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+			}
+			last = 0;
+		}
+
+		FrameView view;
+		if (!reader.latest(view, last)){
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			continue;
+		}
+
+		// Same clock as the publisher ( steady clock, microseconds )
+		const int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		// Touch the pixels in place, then make sure the writer did not overwrite them meanwhile
+		const cv::Scalar average = cv::mean(view.image);
+		if (show){
+			cv::Mat preview;
+			cv::resize(view.image, preview, cv::Size(), .5, .5);
+			cv::imshow(name, preview);
+			cv::waitKey(1);
+		}
+		if (!reader.valid(view)){
+			torn++;
+			continue;
+		}
+
+		frames++;
+		if (last != 0 && view.frame != last + 1){
+			std::cout << "skipped " << view.frame - last - 1 << " frames" << std::endl;
+		}
+		last = view.frame;
+
+		std::cout << "frame " << view.frame << " latency " << (now - view.timestampUs) / 1000. << " ms"
+			<< " mean " << average[0] << " tattoo " << (view.pose.placed ? "at " : "none ")
+			<< (view.pose.placed ? std::to_string(view.pose.x) + "," + std::to_string(view.pose.y) : std::string())
+			<< " torn " << torn << "/" << frames + torn << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,170 @@
+// prewarp.cpp : Cylinder-warps a directory of tattoo designs for a list of radii.
+//
+// Usage: tattoo-prewarp <input dir> <output dir> <radius> [radius ...] [-j threads] [-nearest]
+// Every <input dir>/*.png is written to <output dir>/<name>_r<radius>.png ( the output directory must exist ).
+// Jobs are design x radius on a pool of threads, each design is decoded once for all of its radii.
+
+#include "warp.h"
+#include "pool.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+
+struct Job
+{
+	size_t image;
+	double radius;
+};
+
+// A design decoded by the first of its jobs, released by the last
+struct Design
+{
+	std::once_flag decoded;
+	cv::Mat image;
+	std::atomic<size_t> pending;
+};
+
+static std::string baseName(const std::string& path)
+{
+	const size_t slash = path.find_last_of("/\\");
+	const size_t start = slash == std::string::npos ? 0 : slash + 1;
+	const size_t dot = path.find_last_of('.');
+	return path.substr(start, dot == std::string::npos || dot < start ? std::string::npos : dot - start);
+}
+
+static void usage()
+{
+	std::cout << "usage: tattoo-prewarp <input dir> <output dir> <radius> [radius ...] [-j threads] [-nearest]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4){
+		usage();
+		return 1;
+	}
+
+	const std::string inputDir = argv[1];
+	const std::string outputDir = argv[2];
+
+	std::vector<double> radii;
+	unsigned int threads = std::thread::hardware_concurrency();
+	bool bilinear = true;
+	for (int i = 3; i < argc; i++){
+		const std::string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc){
+			threads = static_cast<unsigned int>(std::atoi(argv[++i]));
+		}
+		else if (arg == "-nearest"){
+			bilinear = false;
+		}
+		else {
+			const double radius = std::atof(argv[i]);
+			if (radius <= .5){
+				// the cylinder must be wider than half the image
+				std::cout << "ERROR: radius must be greater than 0.5: " << arg << std::endl;
+				return 1;
+			}
+			radii.push_back(radius);
+		}
+	}
+	if (radii.empty()){
+		usage();
+		return 1;
+	}
+	if (threads == 0){
+		threads = 1;
+	}
+
+	std::vector<cv::String> files;
+	cv::glob(inputDir + "/*.png", files, false);
+	if (files.empty()){
+		std::cout << "ERROR: no png in " << inputDir << std::endl;
+		return 1;
+	}
+
+	std::vector<Job> jobs;
+	std::vector<std::unique_ptr<Design>> designs;
+	for (size_t i = 0; i < files.size(); i++){
+		for (const double radius : radii){
+			Job job = { i, radius };
+			jobs.push_back(job);
+		}
+		designs.push_back(std::unique_ptr<Design>(new Design));
+		designs.back()->pending = radii.size();
+	}
+
+	// Workers pull jobs until none is left
+	std::atomic<size_t> next(0);
+	std::atomic<size_t> failed(0);
+	std::atomic<long long> pixels(0);
+	std::mutex logMutex;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads; t++){
+		workers.push_back(std::thread([&]{
+			// The pool fills the cores, the projection loop stays on this thread
+			serialPoolThread();
+
+			for (size_t j = next++; j < jobs.size(); j = next++){
+				const Job& job = jobs[j];
+				const std::string& file = files[job.image];
+				Design& design = *designs[job.image];
+
+				// -1 is to guarantee that the transparancy is read
+				std::call_once(design.decoded, [&]{
+					design.image = cv::imread(file, -1);
+					if (design.image.empty()){
+						std::lock_guard<std::mutex> lock(logMutex);
+						std::cout << "ERROR: cannot read " << file << std::endl;
+					}
+				});
+
+				if (design.image.empty()){
+					failed++;
+				}
+				else {
+					const cv::Mat projected = projectCylinder(design.image, job.radius, bilinear);
+
+					std::ostringstream name;
+					name << outputDir << "/" << baseName(file) << "_r" << job.radius << ".png";
+					if (cv::imwrite(name.str(), projected)){
+						pixels += static_cast<long long>(projected.total());
+					}
+					else {
+						failed++;
+						std::lock_guard<std::mutex> lock(logMutex);
+						std::cout << "ERROR: cannot write " << name.str() << std::endl;
+					}
+				}
+
+				if (--design.pending == 0){
+					design.image.release();
+				}
+			}
+		}));
+	}
+	for (auto& worker : workers){
+		worker.join();
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const size_t done = jobs.size() - failed;
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< done << " images ( " << files.size() << " designs x " << radii.size() << " radii ) in " << seconds << " s on " << threads << " threads: "
+		<< done / seconds << " images/s, " << pixels / seconds / 1e6 << " Mpx/s" << std::endl;
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,436 @@
+// tattoorender.cpp : Renders a recorded session with the embeddable renderer, one renderer per thread.
+//
+// Usage: tattoo-render <session dir> <tattoo> <output dir> [-j threads] [--perf]
+//        tattoo-render --serve <tattoo> <session dir>[=<tattoo>] ... [-j threads] [-n loops] [--publish name] [--perf]
+//        tattoo-render --regress <images dir> <golden dir> [--reference] [--timings file [--record-timings]] [--psnr dB] [--slack fraction] [--perf]
+//        tattoo-render --grid <session dir> <tattoo> ... [-n loops]
+//        tattoo-render --check
+// Every thread owns a TattooRenderer and a consecutive run of frames; the tattoo handle is shared.
+// Frames are written to <output dir>/<frame>.png ( the output directory must exist ).
+// --serve plays every session at its recorded pace as a kiosk of a RenderServer and prints their rates;
+// with --publish every kiosk's frames go to shared memory for tattoo-frames ( name, or name-<kiosk> with several ).
+// --regress compares renders with the golden images --reference rendered, and with --timings the stage times with
+// committed ratios ( see regress.h ), exits with 1 on a regression.
+// --grid times the try-on grid ( TryOnGrid, 3 x 3 tiles ) over a recorded session, the frames decoded outside the timing.
+// --perf prints the time and hardware counters of every stage at the end ( see perf.h ).
+
+#include "renderer.h"
+#include "compositor.h"
+#include "recording.h"
+#include "server.h"
+#include "regress.h"
+#include "sharedframe.h"
+#include "perf.h"
+#include "grid.h"
+#include "pool.h"
+#include "framesync.h"
+#include "skin.h"
+#include "bodysnapshot.h"
+#include "foreshorten.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include <limits>
+
+static void usage()
+{
+	std::cout << "usage: tattoo-render <session dir> <tattoo> <output dir> [-j threads] [--perf]" << std::endl;
+	std::cout << "       tattoo-render --serve <tattoo> <session dir>[=<tattoo>] ... [-j threads] [-n loops] [--publish name] [--perf]" << std::endl;
+	std::cout << "       tattoo-render --regress <images dir> <golden dir> [--reference] [--timings file [--record-timings]] [--psnr dB] [--slack fraction] [--perf]" << std::endl;
+	std::cout << "       tattoo-render --grid <session dir> <tattoo> ... [-n loops]" << std::endl;
+	std::cout << "       tattoo-render --check" << std::endl;
+}
+
+// Kiosks replaying recorded sessions in real time on one server
+static int serve(int argc, char* argv[])
+{
+	unsigned int threads = 0;
+	int loops = 1;
+	std::string publish;
+	bool perf = false;
+	std::vector<std::pair<std::string, std::string>> kiosks;
+	for (int i = 3; i < argc; i++){
+		const std::string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc){
+			threads = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "-n" && i + 1 < argc){
+			loops = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--publish" && i + 1 < argc){
+			publish = argv[++i];
+		}
+		else if (arg == "--perf"){
+			perf = true;
+		}
+		else {
+			const size_t equals = arg.find('=');
+			kiosks.push_back(equals == std::string::npos ? std::make_pair(arg, std::string(argv[2])) : std::make_pair(arg.substr(0, equals), arg.substr(equals + 1)));
+		}
+	}
+	if (kiosks.empty()){
+		usage();
+		return 1;
+	}
+
+	// The pool fills the cores, OpenCV's own threads would only compete with it
+	cv::setNumThreads(1);
+
+	try {
+		// Declared before the server, so they outlive its threads
+		std::vector<std::unique_ptr<FramePublisher>> publishers;
+		TattooLibrary library;
+		RenderServer server(threads);
+		server.setProfiling(perf);
+		std::atomic<int> playing(static_cast<int>(kiosks.size()));
+		std::mutex errorMutex;
+		std::string error;
+
+		std::vector<std::thread> players;
+		for (size_t k = 0; k < kiosks.size(); k++){
+			// One publisher per kiosk, its frames come one at a time; the sink has no pose, only whether a tattoo was placed
+			RenderServer::FrameSink sink;
+			if (!publish.empty()){
+				publishers.push_back(std::unique_ptr<FramePublisher>(new FramePublisher()));
+				FramePublisher* publisher = publishers.back().get();
+				const std::string name = kiosks.size() == 1 ? publish : publish + "-" + std::to_string(k);
+				sink = [publisher, name](int, cv::Mat& frame, int64_t timestampUs, bool placed){
+					SharedPose pose = SharedPose();
+					pose.placed = placed ? 1 : 0;
+					publisher->publish(frame, timestampUs, pose, name);
+				};
+			}
+			const int session = server.openSession(RendererSettings(), sink);
+			players.push_back(std::thread([&, k, session](){
+				try {
+					const std::vector<SessionFrame> frames = readSession(kiosks[k].first);
+					server.setTattoo(session, library.acquire(kiosks[k].second));
+
+					// Submitted at the recorded timestamps, decoding is the kiosk's part; stamped with the steady clock
+					// like the camera frames, so tattoo-frames shows the latency through the server
+					const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					const int64_t first = frames.empty() ? 0 : frames.front().timestampUs;
+					const int64_t length = frames.empty() ? 0 : frames.back().timestampUs - first + 33333;
+					for (int loop = 0; loop < loops; loop++){
+						for (const auto& frame : frames){
+							const cv::Mat image = cv::imread(frame.image, -1);
+							if (image.empty()){
+								throw std::runtime_error("Cannot read " + frame.image);
+							}
+							std::this_thread::sleep_until(start + std::chrono::microseconds(frame.timestampUs - first + loop * length));
+							const int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+							server.submit(session, image, now, frame.joints);
+						}
+					}
+				}
+				catch (std::exception& ex){
+					std::lock_guard<std::mutex> lock(errorMutex);
+					error = ex.what();
+				}
+				playing--;
+			}));
+		}
+
+		// Rates every couple of seconds while the kiosks play
+		for (int ticks = 1; playing > 0; ticks++){
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (ticks % 20 == 0){
+				server.report(std::cout);
+			}
+		}
+		for (auto& player : players){
+			player.join();
+		}
+		server.wait();
+
+		if (!error.empty()){
+			std::cout << error << std::endl;
+			return 1;
+		}
+		std::cout << kiosks.size() << " sessions on " << server.threads() << " threads, " << library.loaded() << " tattoo(s) loaded for them" << std::endl;
+		server.report(std::cout);
+		if (perf){
+			server.reportProfile(std::cout);
+		}
+	}
+	catch (std::exception& ex){
+		std::cout << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Try-on grid over a recorded session, every tile with one of the tattoos placed like the live view
+static int benchmarkGrid(int argc, char* argv[])
+{
+	int loops = 1;
+	std::vector<std::string> files;
+	for (int i = 3; i < argc; i++){
+		const std::string arg = argv[i];
+		if (arg == "-n" && i + 1 < argc){
+			loops = std::max(1, std::atoi(argv[++i]));
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	if (files.empty()){
+		usage();
+		return 1;
+	}
+
+	try {
+		const std::vector<SessionFrame> frames = readSession(argv[2]);
+		// Reduced to 256 px, like the tattoos of the grid in the live view
+		std::vector<PreparedTattoo> tattoos;
+		for (const auto& file : files){
+			cv::Mat image = isVectorTattoo(file) ? rasterizeVector(*readVectorTattoo(file), 256) : cv::imread(file, -1);
+			if (image.empty()){
+				throw std::runtime_error("Cannot read " + file);
+			}
+			if (std::max(image.cols, image.rows) > 256){
+				const double factor = 256. / std::max(image.cols, image.rows);
+				cv::resize(image, image, cv::Size(), factor, factor, cv::INTER_AREA);
+			}
+			tattoos.push_back(*makeTattooHandle(image));
+		}
+
+		TryOnGrid grid;
+		grid.setTattoos(tattoos);
+		const RendererSettings settings;
+		std::unique_ptr<BoneFrames> bones(new BoneFrames);
+
+		int rendered = 0, placed = 0;
+		double total = 0, best = std::numeric_limits<double>::infinity(), worst = 0;
+		cv::Size size;
+		cv::Mat output;
+		for (int loop = 0; loop < loops; loop++){
+			for (const auto& frame : frames){
+				const cv::Mat image = cv::imread(frame.image, -1);
+				if (image.empty()){
+					throw std::runtime_error("Cannot read " + frame.image);
+				}
+				size = image.size();
+
+				TryOnPlacement placement;
+				computeBoneFrames(frame.joints, *bones);
+				const bool tracked = resolveAnchor(*bones, settings.anchor, placement.pose);
+				if (tracked){
+					placement.limbRadius = limbRadius(settings.anchor, placement.pose);
+					placement.zoom = settings.zoom;
+					placement.interpolation = settings.interpolation;
+					placement.mipBias = settings.mipBias;
+					placement.variant = 0;
+					placement.opacity = settings.opacity;
+					placement.shading = settings.shading;
+					placed++;
+				}
+
+				const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				grid.render(image, tracked ? &placement : nullptr, output);
+				const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				total += ms;
+				best = std::min(best, ms);
+				worst = std::max(worst, ms);
+				rendered++;
+			}
+		}
+
+		if (rendered == 0){
+			std::cout << "grid: no frames in " << argv[2] << std::endl;
+			return 1;
+		}
+		std::cout << "grid: " << rendered << " frames of " << size.width << " x " << size.height << ", " << std::min(grid.capacity(), static_cast<int>(tattoos.size()))
+			<< " tattoos, " << placed << " placed: " << total / rendered << " ms per frame ( best " << best << ", worst " << worst << " ), "
+			<< 1000. * rendered / total << " frames/s" << std::endl;
+	}
+	catch (std::exception& ex){
+		std::cout << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && std::string(argv[1]) == "--check"){
+		// Every check runs, even after one fails
+		bool ok = checkRenderer(std::cout);
+		ok = checkRenderServer(std::cout) && ok;
+		ok = checkShading(std::cout) && ok;
+		ok = checkFrameSync(std::cout) && ok;
+		ok = checkSkinMask(std::cout) && ok;
+		ok = checkBodyExchange(std::cout) && ok;
+		ok = checkForeshortening(std::cout) && ok;
+		ok = checkPalette(std::cout) && ok;
+		return ok ? 0 : 1;
+	}
+
+	if (argc > 3 && std::string(argv[1]) == "--serve"){
+		return serve(argc, argv);
+	}
+
+	if (argc > 3 && std::string(argv[1]) == "--grid"){
+		return benchmarkGrid(argc, argv);
+	}
+
+	if (argc > 3 && std::string(argv[1]) == "--regress"){
+		PerfProfiler profiler;
+		RegressionOptions options;
+		options.images = argv[2];
+		options.golden = argv[3];
+		for (int i = 4; i < argc; i++){
+			const std::string arg = argv[i];
+			if (arg == "--reference"){
+				options.reference = true;
+			}
+			else if (arg == "--timings" && i + 1 < argc){
+				options.timings = argv[++i];
+			}
+			else if (arg == "--record-timings"){
+				options.recordTimings = true;
+			}
+			else if (arg == "--psnr" && i + 1 < argc){
+				options.minPsnr = std::atof(argv[++i]);
+			}
+			else if (arg == "--slack" && i + 1 < argc){
+				options.slack = std::atof(argv[++i]);
+			}
+			else if (arg == "--perf"){
+				options.profiler = &profiler;
+			}
+			else {
+				usage();
+				return 1;
+			}
+		}
+		if (options.recordTimings && options.timings.empty()){
+			usage();
+			return 1;
+		}
+		try {
+			const bool ok = runRegression(options, std::cout);
+			if (options.profiler != nullptr){
+				profiler.report(std::cout);
+			}
+			return ok ? 0 : 1;
+		}
+		catch (std::exception& ex){
+			std::cout << ex.what() << std::endl;
+			return 1;
+		}
+	}
+
+	if (argc < 4){
+		usage();
+		return 1;
+	}
+
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	bool perf = false;
+	for (int i = 4; i < argc; i++){
+		if (std::string(argv[i]) == "-j" && i + 1 < argc){
+			threads = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (std::string(argv[i]) == "--perf"){
+			perf = true;
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	// The workers fill the cores, OpenCV's own threads would only compete with them
+	cv::setNumThreads(1);
+
+	try {
+		// Stages of this thread, the workers' are added to them
+		std::unique_ptr<PerfProfiler> profile(perf ? new PerfProfiler : nullptr);
+		std::mutex profileMutex;
+
+		const std::vector<SessionFrame> frames = readSession(argv[1]);
+		TattooHandle tattoo;
+		{
+			PerfStage stage(profile.get(), "project");
+			tattoo = loadTattooHandle(argv[2]);
+		}
+		const std::string output = argv[3];
+
+		std::atomic<int> placed(0);
+		std::mutex errorMutex;
+		std::string error;
+
+		// Consecutive frames per thread, so the limb radius is smoothed like in the live view
+		const size_t chunk = (frames.size() + threads - 1) / threads;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> workers;
+		for (unsigned int t = 0; t < threads; t++){
+			workers.push_back(std::thread([&, t](){
+				serialPoolThread();
+				TattooRenderer renderer;
+				std::unique_ptr<PerfProfiler> profiler(perf ? new PerfProfiler : nullptr);
+				renderer.setProfiler(profiler.get());
+
+				const size_t first = t * chunk;
+				const size_t last = std::min(frames.size(), first + chunk);
+				for (size_t f = first; f < last; f++){
+					cv::Mat image;
+					{
+						PerfStage stage(profiler.get(), "read");
+						image = cv::imread(frames[f].image, -1);
+					}
+					if (image.empty()){
+						std::lock_guard<std::mutex> lock(errorMutex);
+						error = "Cannot read " + frames[f].image;
+						return;
+					}
+					if (renderer.render(image, frames[f].joints, tattoo)){
+						placed++;
+					}
+
+					std::ostringstream path;
+					path << output << "/" << std::setw(6) << std::setfill('0') << frames[f].index << ".png";
+					PerfStage stage(profiler.get(), "write");
+					cv::imwrite(path.str(), image);
+				}
+
+				if (profiler){
+					std::lock_guard<std::mutex> lock(profileMutex);
+					profile->merge(*profiler);
+				}
+			}));
+		}
+		for (auto& worker : workers){
+			worker.join();
+		}
+
+		if (!error.empty()){
+			std::cout << error << std::endl;
+			return 1;
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << frames.size() << " frames on " << threads << " threads in " << elapsed.count() << " s: "
+			<< (elapsed.count() > 0 ? frames.size() / elapsed.count() : 0) << " frames/s, " << placed << " with a tattoo" << std::endl;
+		if (profile){
+			profile->report(std::cout);
+		}
+	}
+	catch (std::exception& ex){
+		std::cout << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}